@@ -0,0 +1,169 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: ActionStatistics.cpp
+// Purpose: Accumulates the changes in the label statistics made by an operation
+// Notes: Dense arrays indexed by label. Partial statistics computed in different threads can be
+//        merged into one. Voxel count variations are also kept per slab (plane of the volume
+//        perpendicular to an axis) to allow exact bounding box updates.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// project includes
+#include "ActionStatistics.h"
+
+// c++ includes
+#include <algorithm>
+#include <limits>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+ActionStatistics::ActionStatistics()
+: m_dimensions{Vector3ui{0, 0, 0}}
+, m_slabOffset{0, 0, 0}
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ActionStatistics::setDimensions(const Vector3ui &dimensions)
+{
+  clear();
+
+  m_dimensions = dimensions;
+  m_slabOffset[0] = 0;
+  m_slabOffset[1] = dimensions[0];
+  m_slabOffset[2] = dimensions[0] + dimensions[1];
+
+  // slab vectors are created again when the labels are modified.
+  m_slabs.assign(m_slabs.size(), std::vector<long long int>());
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ActionStatistics::clear()
+{
+  // only the modified labels need to be reset, the arrays keep their size for the next operation.
+  for (auto label: m_labels)
+  {
+    auto index = 3 * label;
+    m_voxels[label] = 0;
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+      m_sums[index + i] = 0;
+    }
+    std::fill(m_slabs[label].begin(), m_slabs[label].end(), 0);
+    m_touched[label] = false;
+  }
+
+  m_labels.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ActionStatistics::touch(const LabelType label)
+{
+  if (label >= m_touched.size())
+  {
+    // grow geometrically, labels are usually modified in increasing order when created.
+    unsigned long long int labels = std::max<unsigned long long int>(label + 1ULL, 2 * m_touched.size());
+    labels = std::min<unsigned long long int>(labels, std::numeric_limits<LabelType>::max() + 1ULL);
+
+    m_voxels.resize(labels, 0);
+    m_sums.resize(3 * labels, 0);
+    m_slabs.resize(labels);
+    m_touched.resize(labels, false);
+  }
+
+  // slab vectors are only allocated for the labels that are modified.
+  m_slabs[label].resize(m_dimensions[0] + m_dimensions[1] + m_dimensions[2], 0);
+
+  m_touched[label] = true;
+  m_labels.push_back(label);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ActionStatistics::merge(const ActionStatistics &other)
+{
+  for (auto label: other.m_labels)
+  {
+    if ((label >= m_touched.size()) || !m_touched[label]) touch(label);
+
+    auto index = 3 * label;
+    m_voxels[label] += other.m_voxels[label];
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+      m_sums[index + i] += other.m_sums[index + i];
+    }
+
+    auto &slabs = m_slabs[label];
+    auto &otherSlabs = other.m_slabs[label];
+    for (unsigned int i = 0; i < slabs.size(); ++i)
+    {
+      slabs[i] += otherSlabs[i];
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+std::vector<long long int> ActionStatistics::pack() const
+{
+  // for each label: label, voxels, coordinate sums, number of slabs and the pairs (slab, voxels).
+  std::vector<long long int> packed;
+
+  for (auto label: m_labels)
+  {
+    auto index = 3 * label;
+    packed.push_back(label);
+    packed.push_back(m_voxels[label]);
+    packed.insert(packed.end(), m_sums.begin() + index, m_sums.begin() + index + 3);
+
+    auto count = packed.size();
+    packed.push_back(0);
+
+    auto &slabs = m_slabs[label];
+    for (unsigned int i = 0; i < slabs.size(); ++i)
+    {
+      if (slabs[i] == 0) continue;
+
+      packed.push_back(i);
+      packed.push_back(slabs[i]);
+      ++packed[count];
+    }
+  }
+
+  packed.shrink_to_fit();
+
+  return packed;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ActionStatistics::merge(const std::vector<long long int> &packed, const bool inverse)
+{
+  const long long int sign = inverse ? -1 : 1;
+
+  unsigned long long int position = 0;
+  while (position < packed.size())
+  {
+    auto label = static_cast<LabelType>(packed[position++]);
+    if ((label >= m_touched.size()) || !m_touched[label]) touch(label);
+
+    auto index = 3 * label;
+    m_voxels[label] += sign * packed[position++];
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+      m_sums[index + i] += sign * packed[position++];
+    }
+
+    auto &slabs = m_slabs[label];
+    auto count = packed[position++];
+    for (long long int i = 0; i < count; ++i)
+    {
+      auto slab = packed[position++];
+      slabs[slab] += sign * packed[position++];
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+Vector3ll ActionStatistics::coordinatesSum(const LabelType label) const
+{
+  auto index = 3 * label;
+  return Vector3ll{m_sums[index], m_sums[index + 1], m_sums[index + 2]};
+}
@@ -0,0 +1,171 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: ActionStatistics.h
+// Purpose: Accumulates the changes in the label statistics made by an operation
+// Notes: Dense arrays indexed by label. Partial statistics computed in different threads can be
+//        merged into one. Voxel count variations are also kept per slab (plane of the volume
+//        perpendicular to an axis) to allow exact bounding box updates.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _ACTIONSTATISTICS_H_
+#define _ACTIONSTATISTICS_H_
+
+// project includes
+#include "LabelType.h"
+#include "VectorSpaceAlgebra.h"
+
+// c++ includes
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// ActionStatistics class
+//
+class ActionStatistics
+{
+  public:
+    /** \brief ActionStatistics class constructor.
+     *
+     */
+    ActionStatistics();
+
+    /** \brief Sets the dimensions of the volume, needed for the slab counts. Resets the statistics.
+     * \param[in] dimensions volume dimensions.
+     *
+     */
+    void setDimensions(const Vector3ui &dimensions);
+
+    /** \brief Returns the dimensions of the volume.
+     *
+     */
+    const Vector3ui &dimensions() const
+    { return m_dimensions; }
+
+    /** \brief Resets the statistics of the modified labels.
+     *
+     */
+    void clear();
+
+    /** \brief Returns true if no label has been modified.
+     *
+     */
+    const bool isEmpty() const
+    { return m_labels.empty(); }
+
+    /** \brief Accounts a voxel added to the given label.
+     * \param[in] label label value.
+     * \param[in] x voxel x coordinate.
+     * \param[in] y voxel y coordinate.
+     * \param[in] z voxel z coordinate.
+     *
+     */
+    inline void add(const LabelType label, const unsigned int x, const unsigned int y, const unsigned int z);
+
+    /** \brief Accounts a voxel removed from the given label.
+     * \param[in] label label value.
+     * \param[in] x voxel x coordinate.
+     * \param[in] y voxel y coordinate.
+     * \param[in] z voxel z coordinate.
+     *
+     */
+    inline void remove(const LabelType label, const unsigned int x, const unsigned int y, const unsigned int z);
+
+    /** \brief Adds the statistics of the given object to this one.
+     * \param[in] other statistics to add.
+     *
+     */
+    void merge(const ActionStatistics &other);
+
+    /** \brief Returns a compact copy of the statistics with only the modified labels and the non-zero
+     * slab variations, used to store the statistics of an action in the undo/redo system.
+     *
+     */
+    std::vector<long long int> pack() const;
+
+    /** \brief Adds the statistics packed by pack() to this one.
+     * \param[in] packed packed statistics, must have the same dimensions.
+     * \param[in] inverse true to subtract the variations instead of adding them.
+     *
+     */
+    void merge(const std::vector<long long int> &packed, const bool inverse = false);
+
+    /** \brief Returns the modified labels, in order of first modification.
+     *
+     */
+    const std::vector<LabelType> &labels() const
+    { return m_labels; }
+
+    /** \brief Returns the variation of the number of voxels of the given label.
+     * \param[in] label label value.
+     *
+     */
+    const long long int voxels(const LabelType label) const
+    { return m_voxels[label]; }
+
+    /** \brief Returns the variation of the sum of the voxel coordinates of the given label.
+     * \param[in] label label value.
+     *
+     */
+    Vector3ll coordinatesSum(const LabelType label) const;
+
+    /** \brief Returns the variation of the number of voxels of the given label in each slab of the
+     * given axis, one value per coordinate of the axis.
+     * \param[in] label label value.
+     * \param[in] axis axis index.
+     *
+     */
+    const long long int *slabs(const LabelType label, const unsigned int axis) const
+    { return m_slabs[label].data() + m_slabOffset[axis]; }
+
+  private:
+    /** \brief Makes room for the given label and adds it to the list of modified labels.
+     * \param[in] label label value.
+     *
+     */
+    void touch(const LabelType label);
+
+    Vector3ui                               m_dimensions;    /** volume dimensions.                                          */
+    unsigned int                            m_slabOffset[3]; /** position of the slabs of each axis in the slab vectors.      */
+    std::vector<long long int>              m_voxels;        /** variation of the number of voxels of each label.             */
+    std::vector<long long int>              m_sums;          /** variation of the sum of the coordinates, three per label.    */
+    std::vector<std::vector<long long int>> m_slabs;         /** variation of the voxels of each slab, x, y and z slabs.      */
+    std::vector<bool>                       m_touched;       /** true for the labels in m_labels.                             */
+    std::vector<LabelType>                  m_labels;        /** modified labels.                                             */
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+inline void ActionStatistics::add(const LabelType label, const unsigned int x, const unsigned int y, const unsigned int z)
+{
+  if ((label >= m_touched.size()) || !m_touched[label]) touch(label);
+
+  auto index = 3 * label;
+  m_voxels[label] += 1;
+  m_sums[index]     += x;
+  m_sums[index + 1] += y;
+  m_sums[index + 2] += z;
+
+  auto &slabs = m_slabs[label];
+  slabs[x] += 1;
+  slabs[m_slabOffset[1] + y] += 1;
+  slabs[m_slabOffset[2] + z] += 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+inline void ActionStatistics::remove(const LabelType label, const unsigned int x, const unsigned int y, const unsigned int z)
+{
+  if ((label >= m_touched.size()) || !m_touched[label]) touch(label);
+
+  auto index = 3 * label;
+  m_voxels[label] -= 1;
+  m_sums[index]     -= x;
+  m_sums[index + 1] -= y;
+  m_sums[index + 2] -= z;
+
+  auto &slabs = m_slabs[label];
+  slabs[x] -= 1;
+  slabs[m_slabOffset[1] + y] -= 1;
+  slabs[m_slabOffset[2] + z] -= 1;
+}
+
+#endif // _ACTIONSTATISTICS_H_
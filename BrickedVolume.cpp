@@ -0,0 +1,320 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: BrickedVolume.cpp
+// Purpose: Sparse storage of a label volume as a grid of bricks of 32x32x32 voxels
+// Notes: Bricks with the same value in all their voxels only store that value. Bricks are
+//        allocated when a voxel is written and released again when compacted if they become
+//        uniform.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// project includes
+#include "BrickedVolume.h"
+
+// c++ includes
+#include <algorithm>
+#include <cstring>
+
+// Qt
+#include <QtGlobal>
+
+const unsigned int BrickedVolume::BRICK_SIZE;
+
+namespace
+{
+  const unsigned int BRICK_VOXELS = BrickedVolume::BRICK_SIZE * BrickedVolume::BRICK_SIZE * BrickedVolume::BRICK_SIZE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+BrickedVolume::Iterator::Iterator(const BrickedVolume &volume, const Vector3ui &min, const Vector3ui &max)
+: m_volume{volume}
+, m_min   {min}
+, m_max   {max}
+, m_first {Vector3ui{min[0] / BRICK_SIZE, min[1] / BRICK_SIZE, min[2] / BRICK_SIZE}}
+, m_last  {Vector3ui{max[0] / BRICK_SIZE, max[1] / BRICK_SIZE, max[2] / BRICK_SIZE}}
+, m_brick {m_first}
+, m_atEnd {false}
+{
+  auto &dimensions = volume.dimensions();
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    if ((min[i] > max[i]) || (max[i] >= dimensions[i])) m_atEnd = true;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void BrickedVolume::Iterator::next()
+{
+  if (m_atEnd) return;
+
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    if (m_brick[i] < m_last[i])
+    {
+      ++m_brick[i];
+      return;
+    }
+
+    m_brick[i] = m_first[i];
+  }
+
+  m_atEnd = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+BrickedVolume::Brick BrickedVolume::Iterator::brick() const
+{
+  Brick brick;
+  brick.origin = Vector3ui{m_brick[0] * BRICK_SIZE, m_brick[1] * BRICK_SIZE, m_brick[2] * BRICK_SIZE};
+
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    brick.min[i] = std::max(m_min[i], brick.origin[i]);
+    brick.max[i] = std::min(m_max[i], brick.origin[i] + BRICK_SIZE - 1);
+  }
+
+  auto index = m_volume.brickIndex(brick.origin);
+  brick.data    = m_volume.brickVoxels(index);
+  brick.uniform = brick.data.isNull();
+  brick.value   = m_volume.m_values[index];
+  brick.strideY = BRICK_SIZE;
+  brick.strideZ = BRICK_SIZE * BRICK_SIZE;
+
+  return brick;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+BrickedVolume::BrickedVolume(const Vector3ui &dimensions, const bool narrow, const LabelType value)
+: m_dimensions{dimensions}
+, m_bricks    {Vector3ui{(dimensions[0] + BRICK_SIZE - 1) / BRICK_SIZE, (dimensions[1] + BRICK_SIZE - 1) / BRICK_SIZE, (dimensions[2] + BRICK_SIZE - 1) / BRICK_SIZE}}
+, m_narrow    {narrow}
+{
+  auto bricks = m_bricks[0] * m_bricks[1] * m_bricks[2];
+
+  m_values.resize(bricks, value);
+  m_data.resize(bricks);
+  m_modified.resize(bricks, false);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void BrickedVolume::fromDense(const LabelType *buffer)
+{
+  m_modifiedList.clear();
+  m_modified.assign(m_modified.size(), false);
+
+  fromDense(Vector3ui{0, 0, 0}, m_dimensions - Vector3ui{1, 1, 1}, buffer);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void BrickedVolume::fromDense(const Vector3ui &min, const Vector3ui &max, const LabelType *buffer)
+{
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    Q_ASSERT((0 == min[i] % BRICK_SIZE) && ((max[i] + 1 == m_dimensions[i]) || (0 == (max[i] + 1) % BRICK_SIZE)));
+  }
+
+  unsigned long long int dimX = max[0] - min[0] + 1;
+  unsigned long long int dimXY = dimX * (max[1] - min[1] + 1);
+
+  auto position = [&](const unsigned int x, const unsigned int y, const unsigned int z)
+  {
+    return buffer + (x - min[0]) + (y - min[1]) * dimX + (z - min[2]) * dimXY;
+  };
+
+  for (Iterator it(*this, min, max); !it.isAtEnd(); it.next())
+  {
+    auto brick = it.brick();
+    auto index = brickIndex(brick.origin);
+    auto value = *position(brick.min[0], brick.min[1], brick.min[2]);
+
+    // check if the brick is uniform before allocating it.
+    bool uniform = true;
+    for (auto z = brick.min[2]; uniform && z <= brick.max[2]; ++z)
+    {
+      for (auto y = brick.min[1]; uniform && y <= brick.max[1]; ++y)
+      {
+        auto source = position(brick.min[0], y, z);
+        for (unsigned int x = 0; x <= brick.max[0] - brick.min[0]; ++x)
+        {
+          if (source[x] != value)
+          {
+            uniform = false;
+            break;
+          }
+        }
+      }
+    }
+
+    m_values[index] = value;
+    if (uniform)
+    {
+      m_data[index].reset();
+      continue;
+    }
+
+    // voxels of the brick outside the volume keep the first value of the brick.
+    auto data = allocate(index);
+
+    for (auto z = brick.min[2]; z <= brick.max[2]; ++z)
+    {
+      for (auto y = brick.min[1]; y <= brick.max[1]; ++y)
+      {
+        (data + voxelIndex(Vector3ui{brick.min[0], y, z})).write(brick.max[0] - brick.min[0] + 1, position(brick.min[0], y, z));
+      }
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void BrickedVolume::toDense(const Vector3ui &min, const Vector3ui &max, LabelType *buffer) const
+{
+  unsigned long long int dimX = max[0] - min[0] + 1;
+  unsigned long long int dimXY = dimX * (max[1] - min[1] + 1);
+
+  for (Iterator it(*this, min, max); !it.isAtEnd(); it.next())
+  {
+    auto brick = it.brick();
+    auto length = brick.max[0] - brick.min[0] + 1;
+
+    for (auto z = brick.min[2]; z <= brick.max[2]; ++z)
+    {
+      for (auto y = brick.min[1]; y <= brick.max[1]; ++y)
+      {
+        auto destination = buffer + (brick.min[0] - min[0]) + (y - min[1]) * dimX + (z - min[2]) * dimXY;
+        if (brick.uniform)
+        {
+          std::fill(destination, destination + length, brick.value);
+        }
+        else
+        {
+          (brick.data + voxelIndex(Vector3ui{brick.min[0], y, z})).read(length, destination);
+        }
+      }
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+LabelType BrickedVolume::voxel(const Vector3ui &point) const
+{
+  auto index = brickIndex(point);
+  auto data = brickVoxels(index);
+
+  return data.isNull() ? m_values[index] : data[voxelIndex(point)];
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const bool BrickedVolume::isUniform(const Vector3ui &point, LabelType &value) const
+{
+  auto index = brickIndex(point);
+  value = m_values[index];
+
+  return (m_data[index] == nullptr);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+LabelVoxels BrickedVolume::row(const Vector3ui &point, unsigned int &length)
+{
+  Q_ASSERT((point[0] < m_dimensions[0]) && (point[1] < m_dimensions[1]) && (point[2] < m_dimensions[2]));
+
+  auto index = brickIndex(point);
+  auto data = brickVoxels(index);
+
+  if (data.isNull()) data = allocate(index);
+
+  if (!m_modified[index])
+  {
+    m_modified[index] = true;
+    m_modifiedList.push_back(index);
+  }
+
+  length = std::min(BRICK_SIZE - (point[0] % BRICK_SIZE), m_dimensions[0] - point[0]);
+
+  return data + voxelIndex(point);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void BrickedVolume::compact()
+{
+  for (auto index: m_modifiedList)
+  {
+    m_modified[index] = false;
+
+    auto data = brickVoxels(index);
+    if (!data.isNull() && isUniformBrick(index))
+    {
+      m_values[index] = data[0];
+      m_data[index].reset();
+    }
+  }
+
+  m_modifiedList.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const unsigned long long int BrickedVolume::memoryUsage() const
+{
+  unsigned long long int allocated = std::count_if(m_data.cbegin(), m_data.cend(), [](const std::unique_ptr<char[]> &data) { return data != nullptr; });
+
+  return allocated * BRICK_VOXELS * LabelVoxels::voxelSize(m_narrow) +
+         m_values.size() * (sizeof(LabelType) + sizeof(std::unique_ptr<char[]>)) +
+         m_modified.size() / 8 + m_modifiedList.capacity() * sizeof(unsigned int);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const bool BrickedVolume::isUniformBrick(const unsigned int index) const
+{
+  auto data = brickVoxels(index);
+  if (data.isNull()) return true;
+
+  // only the voxels of the brick inside the volume are checked.
+  Vector3ui origin{(index % m_bricks[0]) * BRICK_SIZE, ((index / m_bricks[0]) % m_bricks[1]) * BRICK_SIZE, (index / (m_bricks[0] * m_bricks[1])) * BRICK_SIZE};
+  auto length = std::min(BRICK_SIZE, m_dimensions[0] - origin[0]);
+  auto rows   = std::min(BRICK_SIZE, m_dimensions[1] - origin[1]);
+  auto slices = std::min(BRICK_SIZE, m_dimensions[2] - origin[2]);
+  auto value  = data[0];
+
+  for (unsigned int z = 0; z < slices; ++z)
+  {
+    for (unsigned int y = 0; y < rows; ++y)
+    {
+      auto row = data + BRICK_SIZE * (y + BRICK_SIZE * z);
+      for (unsigned int x = 0; x < length; ++x)
+      {
+        if (row[x] != value) return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+LabelVoxels BrickedVolume::allocate(const unsigned int index)
+{
+  m_data[index].reset(new char[BRICK_VOXELS * LabelVoxels::voxelSize(m_narrow)]);
+
+  auto data = brickVoxels(index);
+  data.fill(BRICK_VOXELS, m_values[index]);
+
+  return data;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void BrickedVolume::setNarrow(const bool narrow)
+{
+  if (m_narrow == narrow) return;
+
+  std::vector<LabelType> buffer(BRICK_VOXELS);
+  for (auto &data: m_data)
+  {
+    if (data == nullptr) continue;
+
+    LabelVoxels(data.get(), m_narrow).read(BRICK_VOXELS, buffer.data());
+    data.reset(new char[BRICK_VOXELS * LabelVoxels::voxelSize(narrow)]);
+    LabelVoxels(data.get(), narrow).write(BRICK_VOXELS, buffer.data());
+  }
+
+  m_narrow = narrow;
+}
@@ -0,0 +1,223 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: BrickedVolume.h
+// Purpose: Sparse storage of a label volume as a grid of bricks of 32x32x32 voxels
+// Notes: Bricks with the same value in all their voxels only store that value. Bricks are
+//        allocated when a voxel is written and released again when compacted if they become
+//        uniform. The voxels are stored in 16 bits if the labels fit, see LabelVoxels.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _BRICKEDVOLUME_H_
+#define _BRICKEDVOLUME_H_
+
+// project includes
+#include "LabelType.h"
+#include "LabelVoxels.h"
+#include "VectorSpaceAlgebra.h"
+
+// c++ includes
+#include <memory>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// BrickedVolume class
+//
+class BrickedVolume
+{
+  public:
+    static const unsigned int BRICK_SIZE = 32;
+
+    /** \brief Voxels of a brick inside a region.
+     *
+     */
+    struct Brick
+    {
+        Vector3ui               min;     /** first voxel of the brick inside the region.            */
+        Vector3ui               max;     /** last voxel of the brick inside the region.             */
+        Vector3ui               origin;  /** coordinates of the first value of data.                */
+        bool                    uniform; /** true if all the voxels of the brick have the same value. */
+        LabelType               value;   /** value of the voxels if the brick is uniform.           */
+        LabelVoxels             data;    /** voxel values if the brick is not uniform.               */
+        unsigned long long int  strideY; /** distance in data between consecutive rows.             */
+        unsigned long long int  strideZ; /** distance in data between consecutive slices.           */
+
+        Brick()
+        : min{Vector3ui{0, 0, 0}}, max{Vector3ui{0, 0, 0}}, origin{Vector3ui{0, 0, 0}}, uniform{true}, value{0}, data{}, strideY{0}, strideZ{0} {};
+
+        /** \brief Returns the value of the given voxel of the brick.
+         * \param[in] x x coordinate.
+         * \param[in] y y coordinate.
+         * \param[in] z z coordinate.
+         *
+         */
+        LabelType voxel(const unsigned int x, const unsigned int y, const unsigned int z) const
+        { return uniform ? value : data[(x - origin[0]) + (y - origin[1]) * strideY + (z - origin[2]) * strideZ]; }
+    };
+
+    /** \brief Iterates the bricks that intersect a region of the volume, x varying fastest.
+     *
+     */
+    class Iterator
+    {
+      public:
+        /** \brief Iterator class constructor.
+         * \param[in] volume iterated volume.
+         * \param[in] min region minimum coordinates.
+         * \param[in] max region maximum coordinates.
+         *
+         */
+        Iterator(const BrickedVolume &volume, const Vector3ui &min, const Vector3ui &max);
+
+        /** \brief Returns true if all the bricks have been visited.
+         *
+         */
+        const bool isAtEnd() const
+        { return m_atEnd; }
+
+        /** \brief Moves to the next brick.
+         *
+         */
+        void next();
+
+        /** \brief Returns the current brick.
+         *
+         */
+        Brick brick() const;
+
+      private:
+        const BrickedVolume &m_volume; /** iterated volume.                */
+        Vector3ui            m_min;    /** region minimum coordinates.     */
+        Vector3ui            m_max;    /** region maximum coordinates.     */
+        Vector3ui            m_first;  /** first brick of the region.      */
+        Vector3ui            m_last;   /** last brick of the region.       */
+        Vector3ui            m_brick;  /** current brick.                  */
+        bool                 m_atEnd;  /** true if the iteration finished. */
+    };
+
+    /** \brief BrickedVolume class constructor.
+     * \param[in] dimensions volume dimensions.
+     * \param[in] narrow true to store the voxels as NarrowLabelType and false as LabelType.
+     * \param[in] value initial value of all the voxels.
+     *
+     */
+    BrickedVolume(const Vector3ui &dimensions, const bool narrow, const LabelType value = 0);
+
+    /** \brief Returns the volume dimensions.
+     *
+     */
+    const Vector3ui &dimensions() const
+    { return m_dimensions; }
+
+    /** \brief Returns true if the voxels are stored as NarrowLabelType.
+     *
+     */
+    const bool isNarrow() const
+    { return m_narrow; }
+
+    /** \brief Stores the voxels as NarrowLabelType or as LabelType from now on, converting the
+     * allocated bricks. The values must fit in the new type.
+     * \param[in] narrow true to store the voxels as NarrowLabelType and false as LabelType.
+     *
+     */
+    void setNarrow(const bool narrow);
+
+    /** \brief Copies the values of a dense buffer of the volume dimensions, x varying fastest.
+     * \param[in] buffer dense buffer.
+     *
+     */
+    void fromDense(const LabelType *buffer);
+
+    /** \brief Copies the values of a dense buffer of the given region, x varying fastest. The region
+     * must be made of complete bricks, clipped to the volume.
+     * \param[in] min region minimum coordinates.
+     * \param[in] max region maximum coordinates.
+     * \param[in] buffer dense buffer.
+     *
+     */
+    void fromDense(const Vector3ui &min, const Vector3ui &max, const LabelType *buffer);
+
+    /** \brief Copies the values of the given region to a dense buffer, x varying fastest.
+     * \param[in] min region minimum coordinates.
+     * \param[in] max region maximum coordinates.
+     * \param[out] buffer dense buffer of the region size.
+     *
+     */
+    void toDense(const Vector3ui &min, const Vector3ui &max, LabelType *buffer) const;
+
+    /** \brief Returns the value of the given voxel.
+     * \param[in] point voxel coordinates.
+     *
+     */
+    LabelType voxel(const Vector3ui &point) const;
+
+    /** \brief Returns true if the brick of the given voxel is uniform and its value in the given parameter.
+     * \param[in] point voxel coordinates.
+     * \param[out] value value of the brick voxels if uniform.
+     *
+     */
+    const bool isUniform(const Vector3ui &point, LabelType &value) const;
+
+    /** \brief Returns the given voxel and the following ones of the same row of the brick to write
+     * them, allocating the brick if it's uniform.
+     * \param[in] point voxel coordinates.
+     * \param[out] length number of voxels of the row of the brick starting at the given voxel.
+     *
+     */
+    LabelVoxels row(const Vector3ui &point, unsigned int &length);
+
+    /** \brief Releases the memory of the modified bricks that have become uniform.
+     *
+     */
+    void compact();
+
+    /** \brief Returns the number of bytes used by the volume.
+     *
+     */
+    const unsigned long long int memoryUsage() const;
+
+  private:
+    /** \brief Returns the index of the brick of the given voxel.
+     * \param[in] point voxel coordinates.
+     *
+     */
+    const unsigned int brickIndex(const Vector3ui &point) const
+    { return (point[0] / BRICK_SIZE) + m_bricks[0] * ((point[1] / BRICK_SIZE) + m_bricks[1] * (point[2] / BRICK_SIZE)); }
+
+    /** \brief Returns the position of the given voxel in its brick data.
+     * \param[in] point voxel coordinates.
+     *
+     */
+    static const unsigned int voxelIndex(const Vector3ui &point)
+    { return (point[0] % BRICK_SIZE) + BRICK_SIZE * ((point[1] % BRICK_SIZE) + BRICK_SIZE * (point[2] % BRICK_SIZE)); }
+
+    /** \brief Returns true if all the voxels of the given brick inside the volume have the same value.
+     * \param[in] index brick index.
+     *
+     */
+    const bool isUniformBrick(const unsigned int index) const;
+
+    /** \brief Returns the voxels of the given brick, null if the brick is uniform.
+     * \param[in] index brick index.
+     *
+     */
+    LabelVoxels brickVoxels(const unsigned int index) const
+    { return LabelVoxels(m_data[index].get(), m_narrow); }
+
+    /** \brief Allocates the voxels of the given brick with its uniform value and returns them.
+     * \param[in] index brick index.
+     *
+     */
+    LabelVoxels allocate(const unsigned int index);
+
+    Vector3ui                                      m_dimensions;   /** volume dimensions.                                    */
+    Vector3ui                                      m_bricks;       /** number of bricks in each axis.                        */
+    bool                                           m_narrow;       /** true if the voxels are stored as NarrowLabelType.     */
+    std::vector<LabelType>                         m_values;       /** value of each uniform brick.                          */
+    std::vector<std::unique_ptr<char[]>>           m_data;         /** voxels of each brick, null if the brick is uniform.   */
+    std::vector<bool>                              m_modified;     /** true for the bricks in m_modifiedList.                */
+    std::vector<unsigned int>                      m_modifiedList; /** bricks written since the last compaction.             */
+};
+
+#endif // _BRICKEDVOLUME_H_
@@ -0,0 +1,99 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: ColorRegistry.cpp
+// Purpose: Keeps the set of colors used by the labels and generates new distinct colors
+// Notes: Colors are stored packed with 8 bits per component, the precision of the lookuptable.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// project includes
+#include "ColorRegistry.h"
+
+// c++ includes
+#include <cmath>
+#include <unordered_set>
+
+namespace
+{
+  // g is the root of x^4 = x + 1, the steps 1/g, 1/g^2 and 1/g^3 give the most uniform sequence in three dimensions.
+  const double G = 1.22074408460575947536;
+  const double STEP_H = 1.0 / G;
+  const double STEP_S = 1.0 / (G * G);
+  const double STEP_V = 1.0 / (G * G * G);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+ColorRegistry::ColorRegistry()
+: m_sequence{0}
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ColorRegistry::clear()
+{
+  m_uses.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ColorRegistry::insert(const QColor &color)
+{
+  ++m_uses[pack(color)];
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ColorRegistry::remove(const QColor &color)
+{
+  auto it = m_uses.find(pack(color));
+  if (it == m_uses.end()) return;
+
+  if (0 == --(*it).second) m_uses.erase(it);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const bool ColorRegistry::contains(const QColor &color) const
+{
+  return (m_uses.find(pack(color)) != m_uses.end());
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+std::vector<QColor> ColorRegistry::distinctColors(const unsigned int count)
+{
+  std::vector<QColor> colors;
+  colors.reserve(count);
+
+  // positions of the sequence that fall in a used color after rounding are skipped.
+  std::unordered_set<unsigned int> generated;
+  while (colors.size() < count)
+  {
+    auto color = sequenceColor(m_sequence++);
+    auto packed = pack(color);
+
+    if ((m_uses.find(packed) == m_uses.end()) && generated.insert(packed).second)
+    {
+      colors.push_back(color);
+    }
+  }
+
+  return colors;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+unsigned int ColorRegistry::pack(const QColor &color)
+{
+  auto component = [](const double value) { return static_cast<unsigned int>(std::lround(value * 255.0)) & 0xFF; };
+
+  return (component(color.redF()) << 16) | (component(color.greenF()) << 8) | component(color.blueF());
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+QColor ColorRegistry::sequenceColor(const unsigned long long int index)
+{
+  double integral;
+  auto h = std::modf(0.5 + STEP_H * index, &integral);
+  auto s = std::modf(0.5 + STEP_S * index, &integral);
+  auto v = std::modf(0.5 + STEP_V * index, &integral);
+
+  // dark and grey colors are avoided, they are difficult to tell apart from the background.
+  return QColor::fromHsvF(h, 0.45 + 0.55 * s, 0.55 + 0.45 * v);
+}
@@ -0,0 +1,79 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: ColorRegistry.h
+// Purpose: Keeps the set of colors used by the labels and generates new distinct colors
+// Notes: Colors are stored packed with 8 bits per component, the precision of the lookuptable.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _COLORREGISTRY_H_
+#define _COLORREGISTRY_H_
+
+// c++ includes
+#include <unordered_map>
+#include <vector>
+
+// Qt
+#include <QColor>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// ColorRegistry class
+//
+class ColorRegistry
+{
+  public:
+    /** \brief ColorRegistry class constructor.
+     *
+     */
+    ColorRegistry();
+
+    /** \brief Removes all the colors of the registry. The sequence of generated colors isn't restarted.
+     *
+     */
+    void clear();
+
+    /** \brief Adds a use of the given color.
+     * \param[in] color color.
+     *
+     */
+    void insert(const QColor &color);
+
+    /** \brief Removes a use of the given color.
+     * \param[in] color color.
+     *
+     */
+    void remove(const QColor &color);
+
+    /** \brief Returns true if the given color is in use.
+     * \param[in] color color.
+     *
+     */
+    const bool contains(const QColor &color) const;
+
+    /** \brief Returns the given number of colors that aren't in use and are different between them.
+     * Colors are taken from a low discrepancy sequence in HSV space (the three dimensional extension
+     * of the golden ratio sequence) so consecutive colors are well separated.
+     * \param[in] count number of colors.
+     *
+     */
+    std::vector<QColor> distinctColors(const unsigned int count);
+
+  private:
+    /** \brief Returns the packed value of the given color.
+     * \param[in] color color.
+     *
+     */
+    static unsigned int pack(const QColor &color);
+
+    /** \brief Returns the color of the given position of the sequence.
+     * \param[in] index position in the sequence.
+     *
+     */
+    static QColor sequenceColor(const unsigned long long int index);
+
+    std::unordered_map<unsigned int, unsigned int> m_uses;     /** number of uses of each packed color. */
+    unsigned long long int                         m_sequence; /** next position of the sequence.       */
+};
+
+#endif // _COLORREGISTRY_H_
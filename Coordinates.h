@@ -19,10 +19,11 @@
 #include <iostream>
 
 // project includes
+#include "LabelType.h"
 #include "VectorSpaceAlgebra.h"
 
 // types for labels and label maps
-using ImageType = itk::Image<unsigned short, 3>;
+using ImageType = itk::Image<LabelType, 3>;
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // CoordinatesTransform Class
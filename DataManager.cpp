@@ -10,325 +10,1527 @@
 
 // itk includes
 #include <itkMacro.h>
-#include <itkChangeLabelLabelMapFilter.h>
-#include <itkShapeLabelMapFilter.h>
-#include <itkImageRegion.h>
+#include <itkExtractImageFilter.h>
 
 // vtk includes
+#include <vtkPointData.h>
 #include <vtkStructuredPoints.h>
+#include <vtkTypeTraits.h>
+#include <vtkUnsignedIntArray.h>
+#include <vtkUnsignedShortArray.h>
 
 // project includes
 #include "DataManager.h"
 #include "UndoRedoSystem.h"
 #include "VectorSpaceAlgebra.h"
 
+// c++ includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <unordered_map>
+
 // Qt
 #include <QDebug>
+#include <QDir>
+
+using ExtractType = itk::ExtractImageFilter<ImageType, ImageType>;
+
+#ifdef ESPINA_32BIT_LABELS
+  using LabelArrayType = vtkUnsignedIntArray;
+#else
+  using LabelArrayType = vtkUnsignedShortArray;
+#endif
+
+namespace
+{
+  const unsigned long long int MINIMUM_VOXELS_PER_THREAD = 256 * 1024;
+  const unsigned long long int CONVERSION_VOXELS         = 1024 * 1024;
+
+  /** \brief Returns the number of threads to use to process the given number of voxels.
+   * \param[in] voxels number of voxels.
+   *
+   */
+  unsigned int ThreadsFor(const unsigned long long int voxels)
+  {
+    unsigned long long int threads = std::max(1u, std::thread::hardware_concurrency());
+    return static_cast<unsigned int>(std::max(1ULL, std::min(threads, voxels / MINIMUM_VOXELS_PER_THREAD)));
+  }
+
+  /** \brief Splits [0, count) in the given number of consecutive ranges and calls the function
+   * function(part, begin, end) for each one in a different thread.
+   * \param[in] count number of elements.
+   * \param[in] parts number of ranges.
+   * \param[in] function function to call.
+   *
+   */
+  template<class Function> void ParallelRanges(const unsigned long long int count, const unsigned int parts, Function function)
+  {
+    if (parts <= 1)
+    {
+      function(0, 0, count);
+      return;
+    }
+
+    std::vector<std::thread> threads;
+    for (unsigned int part = 0; part < parts; ++part)
+    {
+      threads.emplace_back(function, part, (count * part) / parts, (count * (part + 1)) / parts);
+    }
+
+    for (auto &thread: threads)
+    {
+      thread.join();
+    }
+  }
+
+  /** \brief Exact statistics of the labels of an image.
+   *
+   */
+  struct VolumeStatistics
+  {
+      std::vector<unsigned long long int> voxels; /** number of voxels of each label.               */
+      std::vector<unsigned long long int> sums;   /** sum of the voxel coordinates, three per label. */
+      std::vector<unsigned int>           min;    /** bounding box minimum, three per label.         */
+      std::vector<unsigned int>           max;    /** bounding box maximum, three per label.         */
+
+      explicit VolumeStatistics(const unsigned int labels)
+      : voxels(labels, 0), sums(3 * labels, 0), min(3 * labels, std::numeric_limits<unsigned int>::max()), max(3 * labels, 0) {};
+
+      /** \brief Accounts a box of voxels of the given label.
+       * \param[in] label label value.
+       * \param[in] first box minimum coordinates.
+       * \param[in] last box maximum coordinates.
+       *
+       */
+      void add(const LabelType label, const Vector3ui &first, const Vector3ui &last)
+      {
+        unsigned long long int count = 1;
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+          count *= last[i] - first[i] + 1;
+        }
+
+        voxels[label] += count;
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+          // sum of the coordinates of the box in the axis, the product is always even.
+          auto index = 3 * label + i;
+          sums[index] += (count * (static_cast<unsigned long long int>(first[i]) + last[i])) / 2;
+          min[index] = std::min(min[index], first[i]);
+          max[index] = std::max(max[index], last[i]);
+        }
+      }
+
+      /** \brief Adds the statistics of the given object to this one.
+       * \param[in] other statistics to add.
+       *
+       */
+      void merge(const VolumeStatistics &other)
+      {
+        for (unsigned int label = 0; label < voxels.size(); ++label)
+        {
+          if (0 == other.voxels[label]) continue;
+
+          voxels[label] += other.voxels[label];
+          for (auto index = 3 * label; index < 3 * (label + 1); ++index)
+          {
+            sums[index] += other.sums[index];
+            min[index] = std::min(min[index], other.min[index]);
+            max[index] = std::max(max[index], other.max[index]);
+          }
+        }
+      }
+  };
+
+  /** \brief Computes the exact statistics of the given bricks in one pass, the bricks are split
+   * between threads. Values equal or greater than the number of labels are ignored.
+   * \param[in] bricks image bricks.
+   * \param[in] labels number of labels.
+   *
+   */
+  VolumeStatistics ComputeVolumeStatistics(const std::vector<BrickedVolume::Brick> &bricks, const unsigned int labels)
+  {
+    unsigned long long int work = 0;
+    for (auto &brick: bricks)
+    {
+      if (!brick.uniform) work += (brick.max[0] - brick.min[0] + 1) * (brick.max[1] - brick.min[1] + 1) * (brick.max[2] - brick.min[2] + 1);
+    }
+
+    std::vector<VolumeStatistics> partials(ThreadsFor(work), VolumeStatistics(labels));
+
+    ParallelRanges(bricks.size(), partials.size(), [&](const unsigned int part, const unsigned long long int begin, const unsigned long long int end)
+    {
+      auto &partial = partials[part];
+
+      for (auto i = begin; i < end; ++i)
+      {
+        auto &brick = bricks[i];
+        if (brick.uniform)
+        {
+          if (brick.value < labels) partial.add(brick.value, brick.min, brick.max);
+          continue;
+        }
+
+        for (auto z = brick.min[2]; z <= brick.max[2]; ++z)
+        {
+          for (auto y = brick.min[1]; y <= brick.max[1]; ++y)
+          {
+            auto x = brick.min[0];
+            while (x <= brick.max[0])
+            {
+              auto value = brick.voxel(x, y, z);
+              unsigned int length = 1;
+              while ((x + length <= brick.max[0]) && (brick.voxel(x + length, y, z) == value)) ++length;
+
+              if (value < labels) partial.add(value, Vector3ui{x, y, z}, Vector3ui{x + length - 1, y, z});
+              x += length;
+            }
+          }
+        }
+      }
+    });
+
+    // merged in order, the result doesn't depend on the number of threads.
+    for (unsigned int part = 1; part < partials.size(); ++part)
+    {
+      partials[0].merge(partials[part]);
+    }
+
+    return partials[0];
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// DataManager class
+//
+DataManager::DataManager()
+: m_structuredPoints{nullptr}
+, m_lookupTable     {nullptr}
+, m_orientationData {nullptr}
+, m_actionsBuffer   {std::make_shared<UndoRedoSystem>(this)}
+, m_firstFreeValue  {1}
+, m_brickedStorage  {false}
+, m_mappedStorage   {false}
+, m_narrowVoxels    {true}
+, m_snapshotVersion {0}
+{
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::Initialize(itk::SmartPointer<ImageReaderType> reader, std::shared_ptr<Coordinates> coordinates, std::shared_ptr<Metadata> metadata,
+                             const bool scalars, std::function<void(const int)> progress)
+{
+  m_orientationData = coordinates;
+
+  auto output  = reader->GetOutput();
+  auto region  = output->GetLargestPossibleRegion();
+  auto index   = region.GetIndex();
+  auto size    = region.GetSize();
+  auto spacing = output->GetSpacing();
+
+  // the slabs are layers of complete bricks, the reader only reads the requested slab.
+  auto slabs = static_cast<unsigned int>((size[2] + BrickedVolume::BRICK_SIZE - 1) / BrickedVolume::BRICK_SIZE);
+  auto passes = scalars ? 2 : 1;
+  auto extractor = ExtractType::New();
+  extractor->SetInput(output);
+  extractor->SetDirectionCollapseToSubmatrix();
+
+  auto readSlab = [&](const unsigned int slab, const unsigned int pass)
+  {
+    auto slabRegion = region;
+    slabRegion.SetIndex(2, index[2] + slab * BrickedVolume::BRICK_SIZE);
+    slabRegion.SetSize(2, std::min<unsigned long long int>(BrickedVolume::BRICK_SIZE, size[2] - slab * BrickedVolume::BRICK_SIZE));
+
+    extractor->SetExtractionRegion(slabRegion);
+    extractor->Update();
+
+    if (progress) progress((100 * (pass * slabs + slab + 1)) / (passes * slabs));
+
+    return extractor->GetOutput();
+  };
+
+  if (scalars)
+  {
+    // count the voxels of each scalar, the images have long runs of the same value.
+    std::unordered_map<LabelType, unsigned long long int> counts;
+    for (unsigned int slab = 0; slab < slabs; ++slab)
+    {
+      auto image = readSlab(slab, 0);
+      auto buffer = image->GetBufferPointer();
+      auto voxels = image->GetPixelContainer()->Size();
+
+      unsigned long long int i = 0;
+      while (i < voxels)
+      {
+        auto value = buffer[i];
+        auto first = i;
+        while ((++i < voxels) && (buffer[i] == value));
+
+        counts[value] += i - first;
+      }
+    }
+
+    std::vector<LabelType> imageScalars;
+    imageScalars.reserve(counts.size());
+    for (auto &count: counts)
+    {
+      if (0 != count.first) imageScalars.push_back(count.first);
+    }
+    std::sort(imageScalars.begin(), imageScalars.end());
+
+    // background label, centroid and bounding box are computed from the image later.
+    auto imagesize = m_orientationData->GetImageSize();
+    auto imagespacing = m_orientationData->GetImageSpacing();
+
+    ObjectInformation object;
+    object.scalar   = 0;
+    object.centroid = Vector3d((imagesize[0] / 2.0) * imagespacing[0], (imagesize[1] / 2.0) * imagespacing[1], (imagesize[2] / 2.0) / imagespacing[2]);
+    object.size     = counts[0];
+    object.min      = Vector3ui(0, 0, 0);
+    object.max      = Vector3ui(imagesize[0], imagesize[1], imagesize[2]);
+
+    m_labelTable.clear();
+    m_labelTable.insert(0, object);
+
+    object.centroid = Vector3d(0, 0, 0);
+    object.max      = Vector3ui(0, 0, 0);
+    for (unsigned int i = 0; i < imageScalars.size(); ++i)
+    {
+      object.scalar = imageScalars[i];
+      object.size   = counts[imageScalars[i]];
+
+      m_labelTable.insert(i + 1, object);
+
+      // need to mark object label as used to correct errors in the segmha metadata (defined labels but empty objects)
+      if (metadata) metadata->markAsUsed(imageScalars[i]);
+    }
+  }
+
+  // start entering new labels at the end of the scalar range
+  m_firstFreeValue = GetScalarForLabel(GetNumberOfLabels() - 1) + 1;
+
+  // generate the initial vtkLookupTable
+  m_lookupTable = vtkSmartPointer<vtkLookupTable>::New();
+  GenerateLookupTable();
+  m_lookupTable->Modified();
+
+  DetachSnapshots();
+  ReleaseMappedFile();
+  m_structuredPoints = vtkSmartPointer<vtkStructuredPoints>::New();
+  m_structuredPoints->SetExtent(index[0], index[0] + size[0] - 1, index[1], index[1] + size[1] - 1, index[2], index[2] + size[2] - 1);
+  m_structuredPoints->SetSpacing(spacing[0], spacing[1], spacing[2]);
+  m_structuredPoints->SetOrigin(0, 0, 0);
+  m_bricks = nullptr;
+  m_narrowVoxels = LabelVoxels::fitsNarrow(m_labelTable.size());
+
+  LabelVoxels storage;
+  if (m_brickedStorage)
+  {
+    Q_ASSERT((0 == index[0]) && (0 == index[1]) && (0 == index[2]));
+    m_bricks = std::unique_ptr<BrickedVolume>(new BrickedVolume(Vector3ui(size[0], size[1], size[2]), m_narrowVoxels));
+  }
+  else
+  {
+    storage = SetScalars(static_cast<unsigned long long int>(size[0]) * size[1] * size[2], m_narrowVoxels);
+  }
+
+  // flatten the scalars (make all labels consecutive starting from 1) and store the slab.
+  for (unsigned int slab = 0; slab < slabs; ++slab)
+  {
+    auto image = readSlab(slab, passes - 1);
+    auto buffer = image->GetBufferPointer();
+    auto voxels = image->GetPixelContainer()->Size();
+
+    unsigned long long int i = 0;
+    while (scalars && (i < voxels))
+    {
+      auto value = buffer[i];
+      auto label = m_labelTable.labelForScalar(value);
+      for (; (i < voxels) && (buffer[i] == value); ++i)
+      {
+        buffer[i] = label;
+      }
+    }
+
+    if (m_bricks)
+    {
+      auto min = Vector3ui{0u, 0u, slab * BrickedVolume::BRICK_SIZE};
+      auto max = Vector3ui{static_cast<unsigned int>(size[0] - 1), static_cast<unsigned int>(size[1] - 1), static_cast<unsigned int>(min[2] + voxels / (size[0] * size[1]) - 1)};
+      m_bricks->fromDense(min, max, buffer);
+    }
+    else
+    {
+      storage.write(voxels, buffer);
+      storage = storage + voxels;
+    }
+  }
+  m_structuredPoints->Modified();
+
+  ComputeLabelIndices();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+DataManager::~DataManager()
+{
+  m_labelTable.clear();
+
+  DetachSnapshots();
+  ReleaseMappedFile();
+
+  m_structuredPoints = nullptr;
+  m_lookupTable = nullptr;
+
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::SetStructuredPoints(vtkSmartPointer<vtkStructuredPoints> points)
+{
+  int extent[6];
+  points->GetExtent(extent);
+  auto dimensions = Vector3ui(extent[1] + 1, extent[3] + 1, extent[5] + 1);
+
+  DetachSnapshots();
+  ReleaseMappedFile();
+  m_structuredPoints = vtkSmartPointer<vtkStructuredPoints>::New();
+  m_bricks = nullptr;
+  m_narrowVoxels = LabelVoxels::fitsNarrow(m_labelTable.size());
+
+  if (m_brickedStorage)
+  {
+    // only the geometry of the image is kept in the structured points.
+    Q_ASSERT((0 == extent[0]) && (0 == extent[2]) && (0 == extent[4]));
+    m_structuredPoints->CopyStructure(points);
+    m_bricks = std::unique_ptr<BrickedVolume>(new BrickedVolume(dimensions, m_narrowVoxels));
+    m_bricks->fromDense(static_cast<LabelType *>(points->GetScalarPointer()));
+  }
+  else
+  {
+    auto voxels = static_cast<unsigned long long int>(dimensions[0]) * dimensions[1] * dimensions[2];
+
+    m_structuredPoints->CopyStructure(points);
+    SetScalars(voxels, m_narrowVoxels).write(voxels, static_cast<LabelType *>(points->GetScalarPointer()));
+  }
+  m_structuredPoints->Modified();
+
+  ComputeLabelIndices();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::ComputeLabelIndices()
+{
+  int extent[6];
+  m_structuredPoints->GetExtent(extent);
+
+  m_actionStatistics.setDimensions(Vector3ui(extent[1] + 1, extent[3] + 1, extent[5] + 1));
+  m_runIndex.setRowLength(extent[1] - extent[0] + 1);
+  m_labelTable.clearSlabs();
+  m_dirty = DirtyRegion();
+
+  // background label doesn't need a bounding box.
+  for (auto &brick: GetBricks(Vector3ui(extent[0], extent[2], extent[4]), Vector3ui(extent[1], extent[3], extent[5])))
+  {
+    if (brick.uniform && ((0 == brick.value) || !m_labelTable.contains(brick.value))) continue;
+
+    for (auto z = brick.min[2]; z <= brick.max[2]; ++z)
+    {
+      for (auto y = brick.min[1]; y <= brick.max[1]; ++y)
+      {
+        auto x = brick.min[0];
+        while (x <= brick.max[0])
+        {
+          auto value = brick.voxel(x, y, z);
+          unsigned int length = 1;
+          while ((x + length <= brick.max[0]) && (brick.voxel(x + length, y, z) == value)) ++length;
+
+          if ((0 != value) && m_labelTable.contains(value))
+          {
+            m_labelTable.addSlabsRun(value, x, y, z, length);
+          }
+          x += length;
+        }
+      }
+    }
+  }
+
+  UpdateStatistics(false);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+const unsigned int DataManager::VerifyStatistics()
+{
+  return UpdateStatistics(true);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+const unsigned int DataManager::UpdateStatistics(const bool report)
+{
+  int extent[6];
+  m_structuredPoints->GetExtent(extent);
+
+  auto statistics = ComputeVolumeStatistics(GetBricks(Vector3ui(extent[0], extent[2], extent[4]), Vector3ui(extent[1], extent[3], extent[5])), m_labelTable.size());
+
+  unsigned int differences = 0;
+  for (LabelType label = 0; label < m_labelTable.size(); ++label)
+  {
+    if (!m_labelTable.contains(label)) continue;
+
+    auto voxels = statistics.voxels[label];
+    auto equal = (voxels == m_labelTable.voxels(label));
+    m_labelTable.setVoxels(label, voxels);
+
+    // no need to recalculate centroid or bounding box for background label
+    if ((0 != label) && (0 != voxels))
+    {
+      auto index = 3 * label;
+      auto centroid = Vector3d(statistics.sums[index] / static_cast<double>(voxels), statistics.sums[index + 1] / static_cast<double>(voxels), statistics.sums[index + 2] / static_cast<double>(voxels));
+      auto min = Vector3ui(statistics.min[index], statistics.min[index + 1], statistics.min[index + 2]);
+      auto max = Vector3ui(statistics.max[index], statistics.max[index + 1], statistics.max[index + 2]);
+
+      auto tableCentroid = m_labelTable.centroid(label);
+      for (unsigned int i = 0; i < 3; ++i)
+      {
+        equal &= (std::abs(tableCentroid[i] - centroid[i]) < 1e-3);
+      }
+      equal &= (min == m_labelTable.min(label)) && (max == m_labelTable.max(label));
+
+      m_labelTable.setCentroid(label, centroid);
+      m_labelTable.setBoundingBox(label, min, max);
+    }
+    else
+    {
+      if ((0 != label) && (m_labelTable.centroid(label) != Vector3d(0, 0, 0)))
+      {
+        equal = false;
+        m_labelTable.setCentroid(label, Vector3d(0, 0, 0));
+      }
+    }
+
+    if (!equal)
+    {
+      ++differences;
+      if (report) qWarning() << "statistics of label" << label << "differ from the image, voxels" << voxels;
+    }
+  }
+
+  return differences;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::SetBrickedStorage(const bool enabled)
+{
+  m_brickedStorage = enabled;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+const bool DataManager::IsBrickedStorageEnabled() const
+{
+  return m_brickedStorage;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+const bool DataManager::IsBrickedStorage() const
+{
+  return (m_bricks != nullptr);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::SetMappedStorage(const bool enabled)
+{
+  m_mappedStorage = enabled;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+const bool DataManager::IsMappedStorage() const
+{
+  return m_mappedStorage;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+LabelVoxels DataManager::SetScalars(const unsigned long long int voxels, const bool narrow)
+{
+  auto bytes = static_cast<qint64>(voxels * LabelVoxels::voxelSize(narrow));
+
+  void *data = nullptr;
+  std::unique_ptr<QTemporaryFile> file;
+  if (m_mappedStorage)
+  {
+    file = std::unique_ptr<QTemporaryFile>(new QTemporaryFile(QDir::tempPath() + QString("/espinaeditor-volume-XXXXXX")));
+    if (!file->open() || !file->resize(bytes) || ((data = file->map(0, bytes)) == nullptr))
+    {
+      qWarning() << "couldn't create or map the image file, using memory instead -" << file->errorString();
+      file = nullptr;
+    }
+  }
+
+  // the array doesn't release the mapped memory, it's unmapped when the file is closed.
+  auto save = (file != nullptr) ? 1 : 0;
+
+  vtkSmartPointer<vtkDataArray> scalars;
+  if (narrow)
+  {
+    auto array = vtkSmartPointer<vtkUnsignedShortArray>::New();
+    auto buffer = file ? static_cast<NarrowLabelType *>(data) : new NarrowLabelType[voxels];
+    array->SetArray(buffer, voxels, save, vtkUnsignedShortArray::VTK_DATA_ARRAY_DELETE);
+    data = buffer;
+    scalars = array;
+  }
+  else
+  {
+    auto array = vtkSmartPointer<LabelArrayType>::New();
+    auto buffer = file ? static_cast<LabelType *>(data) : new LabelType[voxels];
+    array->SetArray(buffer, voxels, save, LabelArrayType::VTK_DATA_ARRAY_DELETE);
+    data = buffer;
+    scalars = array;
+  }
+  scalars->SetNumberOfComponents(1);
+
+  m_structuredPoints->GetPointData()->SetScalars(scalars);
+  m_mappedFile = std::move(file);
+
+  return LabelVoxels(data, narrow);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::SetVoxelWidth(const bool narrow)
+{
+  if (m_narrowVoxels == narrow) return;
+
+  // the snapshots read the voxels from the storage that is going to be replaced.
+  DetachSnapshots();
+  m_narrowVoxels = narrow;
+
+  if (m_bricks)
+  {
+    m_bricks->setNarrow(narrow);
+  }
+  else
+  {
+    int extent[6];
+    m_structuredPoints->GetExtent(extent);
+    auto voxels = static_cast<unsigned long long int>(extent[1] - extent[0] + 1) * (extent[3] - extent[2] + 1) * (extent[5] - extent[4] + 1);
+
+    // the previous array and file are kept until the voxels have been converted.
+    vtkSmartPointer<vtkDataArray> previous = m_structuredPoints->GetPointData()->GetScalars();
+    auto previousFile = std::move(m_mappedFile);
+
+    auto source = LabelVoxels(previous->GetVoidPointer(0), !narrow);
+    auto target = SetScalars(voxels, narrow);
+    std::vector<LabelType> buffer(std::min(voxels, CONVERSION_VOXELS));
+    for (unsigned long long int offset = 0; offset < voxels; offset += buffer.size())
+    {
+      auto count = std::min<unsigned long long int>(voxels - offset, buffer.size());
+      (source + offset).read(count, buffer.data());
+      (target + offset).write(count, buffer.data());
+    }
+  }
+
+  m_structuredPoints->Modified();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::ReleaseMappedFile()
+{
+  if (!m_mappedFile) return;
+
+  // the image could be still referenced by the views, it must not point to the unmapped memory.
+  if (m_structuredPoints) m_structuredPoints->ReleaseData();
+
+  m_mappedFile = nullptr;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+vtkSmartPointer<vtkImageData> DataManager::GetImageData() const
+{
+  if (!m_bricks) return m_structuredPoints;
+
+  int extent[6];
+  m_structuredPoints->GetExtent(extent);
+
+  return GetImageData(Vector3ui(extent[0], extent[2], extent[4]), Vector3ui(extent[1], extent[3], extent[5]));
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+vtkSmartPointer<vtkImageData> DataManager::GetImageData(const Vector3ui &min, const Vector3ui &max) const
+{
+  int extent[6];
+  m_structuredPoints->GetExtent(extent);
+
+  Vector3ui regionMin, regionMax;
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    regionMin[i] = std::max(static_cast<int>(min[i]), extent[2*i]);
+    regionMax[i] = std::min(static_cast<int>(max[i]), extent[2*i + 1]);
+
+    if (regionMin[i] > regionMax[i])
+    {
+      qWarning() << "region out of range - min[" << min[0] << min[1] << min[2] << "] max[" << max[0] << max[1] << max[2] << "]";
+      return nullptr;
+    }
+  }
+
+  auto image = vtkSmartPointer<vtkImageData>::New();
+  image->SetSpacing(m_structuredPoints->GetSpacing());
+  image->SetOrigin(m_structuredPoints->GetOrigin());
+  image->SetExtent(regionMin[0], regionMax[0], regionMin[1], regionMax[1], regionMin[2], regionMax[2]);
+  image->AllocateScalars(vtkTypeTraits<LabelType>::VTKTypeID(), 1);
+
+  CopyRegion(regionMin, regionMax, static_cast<LabelType*>(image->GetScalarPointer()));
+
+  return image;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+itk::SmartPointer<ImageType> DataManager::GetItkImage(const bool copy) const
+{
+  int extent[6];
+  m_structuredPoints->GetExtent(extent);
+
+  return GetItkImage(Vector3ui(extent[0], extent[2], extent[4]), Vector3ui(extent[1], extent[3], extent[5]), copy);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+itk::SmartPointer<ImageType> DataManager::GetItkImage(const Vector3ui &min, const Vector3ui &max, const bool copy) const
+{
+  int extent[6];
+  m_structuredPoints->GetExtent(extent);
+  auto spacing = m_structuredPoints->GetSpacing();
+  auto origin  = m_structuredPoints->GetOrigin();
+
+  Vector3ui regionMin, regionMax;
+  ImageType::IndexType index;
+  ImageType::SizeType size;
+  ImageType::SpacingType imageSpacing;
+  ImageType::PointType imageOrigin;
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    regionMin[i] = std::max(static_cast<int>(min[i]), extent[2*i]);
+    regionMax[i] = std::min(static_cast<int>(max[i]), extent[2*i + 1]);
+
+    if (regionMin[i] > regionMax[i])
+    {
+      qWarning() << "region out of range - min[" << min[0] << min[1] << min[2] << "] max[" << max[0] << max[1] << max[2] << "]";
+      return nullptr;
+    }
+
+    // the index is the voxel coordinates and the origin the one of the volume, as in the vtk images.
+    index[i]        = regionMin[i];
+    size[i]         = regionMax[i] - regionMin[i] + 1;
+    imageSpacing[i] = spacing[i];
+    imageOrigin[i]  = origin[i];
+  }
+
+  auto image = ImageType::New();
+  image->SetRegions(ImageType::RegionType(index, size));
+  image->SetSpacing(imageSpacing);
+  image->SetOrigin(imageOrigin);
+
+  auto slices = (static_cast<int>(regionMin[0]) == extent[0]) && (static_cast<int>(regionMax[0]) == extent[1]) &&
+                (static_cast<int>(regionMin[1]) == extent[2]) && (static_cast<int>(regionMax[1]) == extent[3]);
+
+  if (!copy && !m_bricks && slices && (LabelVoxels::voxelSize(m_narrowVoxels) == sizeof(LabelType)))
+  {
+    // the container doesn't own the voxels, they are released with the vtk image.
+    auto container = ImageType::PixelContainer::New();
+    auto buffer = static_cast<LabelType*>(m_structuredPoints->GetScalarPointer(regionMin[0], regionMin[1], regionMin[2]));
+    container->SetImportPointer(buffer, size[0] * size[1] * size[2], false);
+    image->SetPixelContainer(container);
+
+    return image;
+  }
+
+  image->Allocate();
+  CopyRegion(regionMin, regionMax, image->GetBufferPointer());
+
+  return image;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::CopyRegion(const Vector3ui &min, const Vector3ui &max, LabelType *buffer) const
+{
+  if (m_bricks)
+  {
+    m_bricks->toDense(min, max, buffer);
+    return;
+  }
+
+  auto length = max[0] - min[0] + 1;
+  for (auto z = min[2]; z <= max[2]; ++z)
+  {
+    for (auto y = min[1]; y <= max[1]; ++y)
+    {
+      LabelVoxels(m_structuredPoints->GetScalarPointer(min[0], y, z), m_narrowVoxels).read(length, buffer);
+      buffer += length;
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+std::shared_ptr<VolumeSnapshot> DataManager::CreateSnapshot()
+{
+  int extent[6];
+  m_structuredPoints->GetExtent(extent);
+  auto spacing = m_structuredPoints->GetSpacing();
+  auto origin  = m_structuredPoints->GetOrigin();
+
+  auto offset     = Vector3ui(extent[0], extent[2], extent[4]);
+  auto dimensions = Vector3ui(extent[1] - extent[0] + 1, extent[3] - extent[2] + 1, extent[5] - extent[4] + 1);
+
+  auto source = [this, offset](const Vector3ui &min, const Vector3ui &max, LabelType *buffer)
+  {
+    CopyRegion(min + offset, max + offset, buffer);
+  };
+
+  auto snapshot = std::make_shared<VolumeSnapshot>(dimensions, Vector3d(spacing[0], spacing[1], spacing[2]), Vector3d(origin[0], origin[1], origin[2]), source);
+
+  m_snapshots.erase(std::remove_if(m_snapshots.begin(), m_snapshots.end(), [](const std::weak_ptr<VolumeSnapshot> &pointer) { return pointer.expired(); }), m_snapshots.end());
+  m_snapshots.push_back(snapshot);
+
+  // bricks copied for previous snapshots must be copied again for this one before being written.
+  auto bricks = snapshot->bricks();
+  if (!m_brickVersions)
+  {
+    auto count = static_cast<unsigned long long int>(bricks[0]) * bricks[1] * bricks[2];
+    m_brickVersions.reset(new std::atomic<unsigned int>[count]);
+    for (unsigned long long int i = 0; i < count; ++i)
+    {
+      m_brickVersions[i].store(m_snapshotVersion);
+    }
+  }
+  ++m_snapshotVersion;
+
+  return snapshot;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::PreserveSnapshots(const Vector3ui &point, const unsigned int length)
+{
+  if (m_snapshots.empty()) return;
+
+  int extent[6];
+  m_structuredPoints->GetExtent(extent);
+
+  const auto size = BrickedVolume::BRICK_SIZE;
+  unsigned long long int bricksX = (extent[1] - extent[0] + size) / size;
+  unsigned long long int bricksY = (extent[3] - extent[2] + size) / size;
+
+  auto x = point[0] - extent[0];
+  auto rowIndex = ((point[1] - extent[2]) / size) * bricksX + ((point[2] - extent[4]) / size) * bricksX * bricksY;
+
+  for (auto brick = x / size; brick <= (x + length - 1) / size; ++brick)
+  {
+    auto index = rowIndex + brick;
+
+    // the version is only behind the current one the first time the brick is written after a snapshot.
+    if (m_brickVersions[index].load(std::memory_order_acquire) == m_snapshotVersion) continue;
+
+    std::lock_guard<std::mutex> lock(m_snapshotsMutex);
+    if (m_brickVersions[index].load(std::memory_order_relaxed) == m_snapshotVersion) continue;
+
+    for (auto &pointer: m_snapshots)
+    {
+      auto snapshot = pointer.lock();
+      if (snapshot) snapshot->preserve(index);
+    }
+
+    m_brickVersions[index].store(m_snapshotVersion, std::memory_order_release);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::DetachSnapshots()
+{
+  for (auto &pointer: m_snapshots)
+  {
+    auto snapshot = pointer.lock();
+    if (snapshot) snapshot->detach();
+  }
+
+  m_snapshots.clear();
+  m_brickVersions = nullptr;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+std::vector<BrickedVolume::Brick> DataManager::GetBricks(const Vector3ui &min, const Vector3ui &max) const
+{
+  std::vector<BrickedVolume::Brick> bricks;
+
+  if (m_bricks)
+  {
+    for (BrickedVolume::Iterator it(*m_bricks, min, max); !it.isAtEnd(); it.next())
+    {
+      bricks.push_back(it.brick());
+    }
+
+    return bricks;
+  }
+
+  int extent[6];
+  m_structuredPoints->GetExtent(extent);
+
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    if ((min[i] > max[i]) || (static_cast<int>(min[i]) < extent[2*i]) || (static_cast<int>(max[i]) > extent[2*i + 1])) return bricks;
+  }
+
+  // same brick grid as the bricked storage over the dense image.
+  const auto size = BrickedVolume::BRICK_SIZE;
+  for (auto z = (min[2] / size) * size; z <= max[2]; z += size)
+  {
+    for (auto y = (min[1] / size) * size; y <= max[1]; y += size)
+    {
+      for (auto x = (min[0] / size) * size; x <= max[0]; x += size)
+      {
+        BrickedVolume::Brick brick;
+        brick.min     = Vector3ui(std::max(x, min[0]), std::max(y, min[1]), std::max(z, min[2]));
+        brick.max     = Vector3ui(std::min(x + size - 1, max[0]), std::min(y + size - 1, max[1]), std::min(z + size - 1, max[2]));
+        brick.origin  = brick.min;
+        brick.uniform = false;
+        brick.data    = LabelVoxels(m_structuredPoints->GetScalarPointer(brick.min[0], brick.min[1], brick.min[2]), m_narrowVoxels);
+        brick.strideY = extent[1] - extent[0] + 1;
+        brick.strideZ = brick.strideY * (extent[3] - extent[2] + 1);
+
+        bricks.push_back(brick);
+      }
+    }
+  }
+
+  return bricks;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+vtkSmartPointer<vtkStructuredPoints> DataManager::GetStructuredPoints() const
+{
+  return m_structuredPoints;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::GetRegionScalars(const Vector3ui &min, const Vector3ui &max, LabelType *buffer) const
+{
+  CopyRegion(min, max, buffer);
+
+  auto voxels = static_cast<unsigned long long int>(max[0] - min[0] + 1) * (max[1] - min[1] + 1) * (max[2] - min[2] + 1);
+
+  unsigned long long int i = 0;
+  while (i < voxels)
+  {
+    auto label = buffer[i];
+    auto scalar = m_labelTable.scalar(label);
+    for (; (i < voxels) && (buffer[i] == label); ++i)
+    {
+      buffer[i] = scalar;
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+std::shared_ptr<Coordinates> DataManager::GetOrientationData() const
+{
+  return m_orientationData;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+LabelTable* DataManager::GetObjectTablePointer()
+{
+  return &m_labelTable;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+const LabelType DataManager::GetVoxelScalar(const Vector3ui &point) const
+{
+  if (m_bricks) return m_bricks->voxel(point);
+
+  return LabelVoxels(m_structuredPoints->GetScalarPointer(point[0], point[1], point[2]), m_narrowVoxels)[0];
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::SetVoxelScalar(const Vector3ui &point, const LabelType scalar)
+{
+  int extent[6];
+  m_structuredPoints->GetExtent(extent);
+  if(extent[0] > point[0] || extent[1] < point[0] || extent[2] > point[1] || extent[3] < point[1] || extent[4] > point[2] || extent[5] < point[2])
+  {
+    qWarning() << "point out of range - point[" << point[0] << point[1] << point[2] << "] extent[" << extent[0] << extent[1] << extent[2] << extent[3] << extent[4] << extent[5] << "]";
+    return;
+  }
+
+  auto x = point[0];
+  auto y = point[1];
+  auto z = point[2];
+
+  if (scalar == GetVoxelScalar(point)) return;
+
+  auto pixel = VoxelPointer(point);
+  auto previous = pixel[0];
+
+  m_actionStatistics.remove(previous, x, y, z);
+  m_actionStatistics.add(scalar, x, y, z);
+
+  TrackChange(point, 1, previous, scalar);
+
+  m_actionsBuffer->storePoint(GetVoxelOffset(point), previous);
+  pixel.set(0, scalar);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+const unsigned long long int DataManager::GetVoxelOffset(const Vector3ui &point) const
+{
+  int extent[6];
+  m_structuredPoints->GetExtent(extent);
+
+  unsigned long long int dimX = extent[1] - extent[0] + 1;
+  unsigned long long int dimY = extent[3] - extent[2] + 1;
+
+  return (point[0] - extent[0]) + (point[1] - extent[2]) * dimX + (point[2] - extent[4]) * dimX * dimY;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+const Vector3ui DataManager::GetVoxelCoordinates(const unsigned long long int offset) const
+{
+  int extent[6];
+  m_structuredPoints->GetExtent(extent);
+
+  unsigned long long int dimX = extent[1] - extent[0] + 1;
+  unsigned long long int dimY = extent[3] - extent[2] + 1;
+
+  return Vector3ui(static_cast<unsigned int>(offset % dimX) + extent[0],
+                   static_cast<unsigned int>((offset / dimX) % dimY) + extent[2],
+                   static_cast<unsigned int>(offset / (dimX * dimY)) + extent[4]);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+std::vector<bool> DataManager::ReplaceableValues(const std::set<LabelType> &labels) const
+{
+  std::vector<bool> replaceable;
+
+  if (!labels.empty())
+  {
+    // the volume only holds label indices, the table size covers all of them.
+    replaceable.resize(std::max<unsigned long long int>(m_labelTable.size(), *labels.rbegin() + 1ULL), false);
+    for (auto label: labels)
+    {
+      replaceable[label] = true;
+    }
+  }
+
+  return replaceable;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::WriteRun(const unsigned long long int offset, const unsigned int length, const LabelType value,
+                           const std::vector<bool> &replaceable, WritePartial &partial)
+{
+  int extent[6];
+  m_structuredPoints->GetExtent(extent);
+
+  unsigned long long int dimX = extent[1] - extent[0] + 1;
+  unsigned long long int dimY = extent[3] - extent[2] + 1;
+
+  auto x = static_cast<unsigned int>(offset % dimX) + extent[0];
+  auto y = static_cast<unsigned int>((offset / dimX) % dimY) + extent[2];
+  auto z = static_cast<unsigned int>(offset / (dimX * dimY)) + extent[4];
+
+  Q_ASSERT(x - extent[0] + length <= dimX);
+
+  auto writeVoxels = [&](const LabelVoxels &buffer, const unsigned int first, const unsigned int count)
+  {
+    for (auto i = first; i < first + count; ++i)
+    {
+      auto previous = buffer[i - first];
+      if ((previous == value) || (!replaceable.empty() && !replaceable[previous])) continue;
+
+      partial.statistics.remove(previous, x + i, y, z);
+      partial.statistics.add(value, x + i, y, z);
+      partial.changed.add(offset + i, previous);
+      buffer.set(i - first, value);
+    }
+  };
+
+  if (!m_bricks)
+  {
+    PreserveSnapshots(Vector3ui{x, y, z}, length);
+    writeVoxels(LabelVoxels(m_structuredPoints->GetScalarPointer(), m_narrowVoxels) + offset, 0, length);
+    return;
+  }
+
+  // write the run brick by brick, the uniform bricks that won't change are skipped without allocating them.
+  unsigned int i = 0;
+  while (i < length)
+  {
+    auto point = Vector3ui{x + i, y, z};
+    auto count = std::min(BrickedVolume::BRICK_SIZE - (point[0] % BrickedVolume::BRICK_SIZE), length - i);
+
+    LabelType uniformValue;
+    if (m_bricks->isUniform(point, uniformValue) && ((uniformValue == value) || (!replaceable.empty() && !replaceable[uniformValue])))
+    {
+      i += count;
+      continue;
+    }
+
+    PreserveSnapshots(point, count);
+
+    unsigned int rowLength;
+    auto buffer = m_bricks->row(point, rowLength);
+    writeVoxels(buffer, i, std::min(count, rowLength));
+    i += count;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+std::vector<DataManager::WritePartial> DataManager::WritePartials(const unsigned int count) const
+{
+  // bricked storage allocates bricks while writing and can't be written by several threads.
+  std::vector<WritePartial> partials(m_bricks ? 1 : count);
+  for (auto &partial: partials)
+  {
+    partial.statistics.setDimensions(m_actionStatistics.dimensions());
+  }
+
+  return partials;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::StorePartials(std::vector<WritePartial> &partials, const LabelType value)
+{
+  for (auto &partial: partials)
+  {
+    m_actionStatistics.merge(partial.statistics);
+    TrackChanges(partial.changed, value);
+    m_actionsBuffer->storePoints(partial.changed);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::TrackChanges(const VoxelDeltas &changed, const LabelType value)
+{
+  int extent[6];
+  m_structuredPoints->GetExtent(extent);
+
+  unsigned long long int dimX = extent[1] - extent[0] + 1;
+
+  // runs of consecutive offsets are split in runs of the same row.
+  for (auto &run: changed.runs())
+  {
+    auto offset = run.offset;
+    auto remaining = run.length;
+    while (remaining > 0)
+    {
+      auto length = static_cast<unsigned int>(std::min<unsigned long long int>(remaining, dimX - (offset % dimX)));
+      TrackChange(GetVoxelCoordinates(offset), length, run.value, value);
+
+      offset += length;
+      remaining -= length;
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::TrackChange(const Vector3ui &point, const unsigned int length, const LabelType previous, const LabelType value)
+{
+  auto offset = GetVoxelOffset(point);
+  m_runIndex.touch(previous, offset);
+  m_runIndex.touch(value, offset);
+
+  auto last = Vector3ui{point[0] + length - 1, point[1], point[2]};
+  if (m_dirty.isEmpty())
+  {
+    m_dirty.min = point;
+    m_dirty.max = last;
+  }
+  else
+  {
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+      m_dirty.min[i] = std::min(m_dirty.min[i], point[i]);
+      m_dirty.max[i] = std::max(m_dirty.max[i], last[i]);
+    }
+  }
+
+  m_dirty.labels.insert(previous);
+  m_dirty.labels.insert(value);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::SetVoxelScalars(const std::vector<unsigned long long int> &offsets, const LabelType value, const std::set<LabelType> &labels)
+{
+  int extent[6];
+  m_structuredPoints->GetExtent(extent);
+
+  unsigned long long int dimX = extent[1] - extent[0] + 1;
+  unsigned long long int voxels = dimX * (extent[3] - extent[2] + 1) * (extent[5] - extent[4] + 1);
+
+  auto replaceable = ReplaceableValues(labels);
+  auto partials = WritePartials(ThreadsFor(offsets.size()));
+
+  ParallelRanges(offsets.size(), partials.size(), [&](const unsigned int part, const unsigned long long int begin, const unsigned long long int end)
+  {
+    auto &partial = partials[part];
+
+    // consecutive offsets of the same row are written as a run
+    auto i = begin;
+    while (i < end)
+    {
+      if (offsets[i] >= voxels)
+      {
+        qWarning() << "voxel offset out of range - offset" << offsets[i] << "voxels" << voxels;
+        ++i;
+        continue;
+      }
+
+      unsigned int length = 1;
+      while ((i + length < end) && (offsets[i + length] == offsets[i] + length) && (0 != (offsets[i + length] % dimX)))
+      {
+        ++length;
+      }
+
+      WriteRun(offsets[i], length, value, replaceable, partial);
+      i += length;
+    }
+  });
+
+  StorePartials(partials, value);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::SetVoxelScalars(const std::vector<VoxelRun> &runs, const LabelType value, const std::set<LabelType> &labels)
+{
+  int extent[6];
+  m_structuredPoints->GetExtent(extent);
+
+  unsigned long long int dimX = extent[1] - extent[0] + 1;
+  unsigned long long int voxels = dimX * (extent[3] - extent[2] + 1) * (extent[5] - extent[4] + 1);
+
+  unsigned long long int work = 0;
+  for (auto &run: runs)
+  {
+    work += run.length;
+  }
+
+  auto replaceable = ReplaceableValues(labels);
+  auto partials = WritePartials(ThreadsFor(work));
+
+  ParallelRanges(runs.size(), partials.size(), [&](const unsigned int part, const unsigned long long int begin, const unsigned long long int end)
+  {
+    for (auto i = begin; i < end; ++i)
+    {
+      auto &run = runs[i];
+      if ((run.offset + run.length > voxels) || ((run.offset % dimX) + run.length > dimX))
+      {
+        qWarning() << "voxel run out of range - offset" << run.offset << "length" << run.length << "voxels" << voxels;
+        continue;
+      }
+
+      WriteRun(run.offset, run.length, value, replaceable, partials[part]);
+    }
+  });
+
+  StorePartials(partials, value);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::SetVoxelScalars(const Vector3ui &min, const Vector3ui &max, const std::vector<unsigned char> &mask, const LabelType value, const std::set<LabelType> &labels)
+{
+  int extent[6];
+  m_structuredPoints->GetExtent(extent);
+
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    if ((static_cast<int>(min[i]) < extent[2*i]) || (static_cast<int>(max[i]) > extent[2*i + 1]) || (min[i] > max[i]))
+    {
+      qWarning() << "region out of range - min[" << min[0] << min[1] << min[2] << "] max[" << max[0] << max[1] << max[2] << "] extent[" << extent[0] << extent[1] << extent[2] << extent[3] << extent[4] << extent[5] << "]";
+      return;
+    }
+  }
+
+  unsigned long long int rowLength = max[0] - min[0] + 1;
+  unsigned long long int rowsY = max[1] - min[1] + 1;
+  unsigned long long int rows = rowsY * (max[2] - min[2] + 1);
+  if (!mask.empty() && (mask.size() != rowLength * rows))
+  {
+    qWarning() << "region mask size mismatch - mask size" << mask.size();
+    return;
+  }
+
+  auto replaceable = ReplaceableValues(labels);
+  auto partials = WritePartials(ThreadsFor(rowLength * rows));
+
+  ParallelRanges(rows, partials.size(), [&](const unsigned int part, const unsigned long long int begin, const unsigned long long int end)
+  {
+    auto &partial = partials[part];
+
+    for (auto row = begin; row < end; ++row)
+    {
+      auto y = static_cast<unsigned int>(min[1] + (row % rowsY));
+      auto z = static_cast<unsigned int>(min[2] + (row / rowsY));
+      auto offset = GetVoxelOffset(Vector3ui{min[0], y, z});
+
+      if (mask.empty())
+      {
+        WriteRun(offset, rowLength, value, replaceable, partial);
+        continue;
+      }
 
-using ChangeType = itk::ChangeLabelLabelMapFilter<LabelMapType>;
-using ImageRegionType = itk::ImageRegion<3>;
+      // write the runs of masked voxels of the row
+      auto maskRow = mask.data() + row * rowLength;
+      unsigned int x = 0;
+      while (x < rowLength)
+      {
+        if (0 == maskRow[x])
+        {
+          ++x;
+          continue;
+        }
 
-//////////////////////////////////////////////////////////////////////////////////////////////////
-// DataManager class
-//
-DataManager::DataManager()
-: m_labelMap        {nullptr}
-, m_structuredPoints{nullptr}
-, m_lookupTable     {nullptr}
-, m_orientationData {nullptr}
-, m_actionsBuffer   {std::make_shared<UndoRedoSystem>(this)}
-, m_firstFreeValue  {1}
-{
+        unsigned int length = 1;
+        while ((x + length < rowLength) && (0 != maskRow[x + length])) ++length;
+
+        WriteRun(offset + x, length, value, replaceable, partial);
+        x += length;
+      }
+    }
+  });
+
+  StorePartials(partials, value);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-void DataManager::Initialize(itk::SmartPointer<LabelMapType> labelMap, std::shared_ptr<Coordinates> coordinates, std::shared_ptr<Metadata> metadata)
+void DataManager::RestoreVoxelScalars(const VoxelDeltas &points)
 {
-  m_orientationData = coordinates;
-  auto spacing      = m_orientationData->GetImageSpacing();
-  auto imageorigin  = m_orientationData->GetImageOrigin();
-  auto imagesize    = m_orientationData->GetImageSize();
+  // runs must be restored in reverse order, a point can appear in more than one. The voxels of a run
+  // are different and are restored in increasing order so the new runs are as long as the restored ones.
+  int extent[6];
+  m_structuredPoints->GetExtent(extent);
+  const unsigned long long int dimX = extent[1] - extent[0] + 1;
 
-  // insert background label info, initially all voxels are background, we'll subtract later
-  auto object = std::make_shared<ObjectInformation>();
-  object->scalar   = 0;
-  object->centroid = Vector3d((imagesize[0] / 2.0) * spacing[0], (imagesize[1] / 2.0) * spacing[1], (imagesize[2] / 2.0) / spacing[2]);
-  object->size     = imagesize[0] * imagesize[1] * imagesize[2];
-  object->min      = Vector3ui(0, 0, 0);
-  object->max      = Vector3ui(imagesize[0], imagesize[1], imagesize[2]);
+  VoxelDeltas changed;
 
-  ObjectVector.insert(std::pair<unsigned short, std::shared_ptr<ObjectInformation>>(0, object));
+  auto runs = points.runs();
+  for (auto run = runs.rbegin(); run != runs.rend(); ++run)
+  {
+    auto value     = (*run).value;
+    auto offset    = (*run).offset;
+    auto remaining = (*run).length;
 
-  // evaluate shapelabelobjects to get the centroid of the object
-  auto evaluator = itk::ShapeLabelMapFilter<LabelMapType>::New();
-  evaluator->SetInput(labelMap);
-  evaluator->ComputePerimeterOff();
-  evaluator->ComputeFeretDiameterOff();
-  evaluator->SetInPlace(true);
-  evaluator->Update();
+    // the run is written in segments that don't cross rows or bricks, each one through its buffer row.
+    while (remaining > 0)
+    {
+      auto point  = GetVoxelCoordinates(offset);
+      auto length = static_cast<unsigned int>(std::min<unsigned long long int>(remaining, dimX - (offset % dimX)));
 
-  // get voxel count for each label for statistics and "flatten" the labelmap (make all labels consecutive starting from 1)
-  auto labelChanger = ChangeType::New();
-  labelChanger->SetInput(evaluator->GetOutput());
-  labelChanger->SetInPlace(true);
+      LabelType uniformValue;
+      if (m_bricks)
+      {
+        length = std::min(length, BrickedVolume::BRICK_SIZE - (point[0] % BrickedVolume::BRICK_SIZE));
 
-  ImageRegionType region;
-  unsigned short i = 1;
-  itk::Point<double, 3> centroid;
+        if (m_bricks->isUniform(point, uniformValue) && (uniformValue == value))
+        {
+          offset += length;
+          remaining -= length;
+          continue;
+        }
+      }
 
-  for (int i = 0; i < evaluator->GetOutput()->GetNumberOfLabelObjects(); ++i)
-  {
-    auto labelObject = evaluator->GetOutput()->GetNthLabelObject(i);
-    auto scalar = labelObject->GetLabel();
-    centroid = labelObject->GetCentroid();
-    region = labelObject->GetBoundingBox();
-    auto regionOrigin = region.GetIndex();
-    auto regionSize = region.GetSize();
+      PreserveSnapshots(point, length);
 
-    object = std::make_shared<ObjectInformation>();
-    object->scalar   = scalar;
-    object->centroid = Vector3d(centroid[0] / spacing[0], centroid[1] / spacing[1], centroid[2] / spacing[2]);
-    object->size     = labelObject->Size();
-    object->min      = Vector3ui(regionOrigin[0], regionOrigin[1], regionOrigin[2]);
-    object->max      = Vector3ui(regionSize[0] + regionOrigin[0], regionSize[1] + regionOrigin[1], regionSize[2] + regionOrigin[2]) - Vector3ui(1, 1, 1);
+      LabelVoxels pixel;
+      if (m_bricks)
+      {
+        unsigned int rowLength;
+        pixel = m_bricks->row(point, rowLength);
+      }
+      else
+      {
+        pixel = LabelVoxels(m_structuredPoints->GetScalarPointer(), m_narrowVoxels) + offset;
+      }
 
-    ObjectVector.insert(std::pair<unsigned short, std::shared_ptr<ObjectInformation>>(i, object));
+      unsigned int i = 0;
+      while (i < length)
+      {
+        auto previous = pixel[i];
+        if (previous == value)
+        {
+          ++i;
+          continue;
+        }
 
-    // substract the voxels of this object from the background label
-    ObjectVector[0]->size -= labelObject->Size();
+        auto first = i;
+        while ((i < length) && (pixel[i] == previous))
+        {
+          pixel.set(i++, value);
+        }
 
-    // need to mark object label as used to correct errors in the segmha metadata (defined labels but empty objects)
-    metadata->markAsUsed(scalar);
+        changed.add(offset + first, previous, i - first);
+        TrackChange(Vector3ui{point[0] + first, point[1], point[2]}, i - first, previous, value);
+      }
 
-    // flatten label
-    labelChanger->SetChange(scalar, i);
+      offset += length;
+      remaining -= length;
+    }
   }
 
-  // start entering new labels at the end of the scalar range
-  m_firstFreeValue = GetScalarForLabel(GetNumberOfLabels() - 1) + 1;
-
-  // apply all the changes made to labels
-  labelChanger->Update();
-
-  m_labelMap = LabelMapType::New();
-  m_labelMap = labelChanger->GetOutput();
-  m_labelMap->Optimize();
-  m_labelMap->Update();
-
-  // generate the initial vtkLookupTable
-  m_lookupTable = vtkSmartPointer<vtkLookupTable>::New();
-  GenerateLookupTable();
-  m_lookupTable->Modified();
+  m_actionsBuffer->storePoints(changed);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-DataManager::~DataManager()
+void DataManager::SwapVoxelScalars(const Vector3ui &min, const Vector3ui &max, std::vector<LabelType> &values)
 {
-  for(auto it: ObjectVector)
-  {
-    it.second = nullptr;
-  }
-  ObjectVector.clear();
+  unsigned int rowLength = max[0] - min[0] + 1;
+  Q_ASSERT(values.size() == static_cast<unsigned long long int>(rowLength) * (max[1] - min[1] + 1) * (max[2] - min[2] + 1));
 
-  for(auto it: ActionInformationVector)
+  std::vector<LabelType> previous(values.size());
+  CopyRegion(min, max, previous.data());
+
+  auto value   = values.data();
+  auto current = previous.data();
+  for (auto z = min[2]; z <= max[2]; ++z)
   {
-    it.second = nullptr;
-  }
-  ActionInformationVector.clear();
+    for (auto y = min[1]; y <= max[1]; ++y)
+    {
+      unsigned int x = 0;
+      while (x < rowLength)
+      {
+        if (value[x] == current[x])
+        {
+          ++x;
+          continue;
+        }
 
-  m_labelMap = nullptr;
-  m_structuredPoints = nullptr;
-  m_lookupTable = nullptr;
+        // voxels with the same change are written as a run, without crossing brick boundaries.
+        unsigned int length = 1;
+        while ((x + length < rowLength) && ((min[0] + x + length) % BrickedVolume::BRICK_SIZE != 0) &&
+               (value[x + length] == value[x]) && (current[x + length] == current[x]))
+        {
+          ++length;
+        }
 
-}
+        auto point = Vector3ui{min[0] + x, y, z};
+        VoxelPointer(point).fill(length, value[x]);
 
-//////////////////////////////////////////////////////////////////////////////////////////////////
-void DataManager::SetStructuredPoints(vtkSmartPointer<vtkStructuredPoints> points)
-{
-  m_structuredPoints = vtkSmartPointer<vtkStructuredPoints>::New();
-  m_structuredPoints->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
-  m_structuredPoints->CopyInformationFromPipeline(points->GetInformation());
-  m_structuredPoints->DeepCopy(points);
-  m_structuredPoints->Modified();
-}
+        TrackChange(point, length, current[x], value[x]);
+        x += length;
+      }
 
-//////////////////////////////////////////////////////////////////////////////////////////////////
-vtkSmartPointer<vtkStructuredPoints> DataManager::GetStructuredPoints() const
-{
-  return m_structuredPoints;
-}
+      value   += rowLength;
+      current += rowLength;
+    }
+  }
 
-//////////////////////////////////////////////////////////////////////////////////////////////////
-itk::SmartPointer<LabelMapType> DataManager::GetLabelMap() const
-{
-  return m_labelMap;
+  values.swap(previous);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-std::shared_ptr<Coordinates> DataManager::GetOrientationData() const
+void DataManager::SetVoxelScalarRaw(const Vector3ui &point, const LabelType scalar)
 {
-  return m_orientationData;
-}
+  if (scalar == GetVoxelScalar(point)) return;
 
-//////////////////////////////////////////////////////////////////////////////////////////////////
-std::map<unsigned short, std::shared_ptr<DataManager::ObjectInformation>>* DataManager::GetObjectTablePointer()
-{
-  return &ObjectVector;
-}
+  auto pixel = VoxelPointer(point);
 
-//////////////////////////////////////////////////////////////////////////////////////////////////
-const unsigned short DataManager::GetVoxelScalar(const Vector3ui &point) const
-{
-  auto pixel = static_cast<unsigned short*>(m_structuredPoints->GetScalarPointer(point[0], point[1], point[2]));
-  return *pixel;
+  TrackChange(point, 1, pixel[0], scalar);
+
+  pixel.set(0, scalar);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-void DataManager::SetVoxelScalar(const Vector3ui &point, const unsigned short scalar)
+LabelVoxels DataManager::VoxelPointer(const Vector3ui &point)
 {
-  int extent[6];
-  m_structuredPoints->GetExtent(extent);
-  if(extent[0] > point[0] || extent[1] < point[0] || extent[2] > point[1] || extent[3] < point[1] || extent[4] > point[2] || extent[5] < point[2])
-  {
-    qWarning() << "point out of range - point[" << point[0] << point[1] << point[2] << "] extent[" << extent[0] << extent[1] << extent[2] << extent[3] << extent[4] << extent[5] << "]";
-    return;
-  }
-
-  auto x = point[0];
-  auto y = point[1];
-  auto z = point[2];
-  auto pixel = static_cast<unsigned short*>(m_structuredPoints->GetScalarPointer(x,y,z));
-
-  if (scalar == *pixel) return;
-
-  if (ActionInformationVector.find(*pixel) == ActionInformationVector.end())
-  {
-    auto action = std::make_shared<ActionInformation>();
-    ActionInformationVector[*pixel] = action;
-    action->min = Vector3ui(x, y, z);
-    action->max = Vector3ui(x, y, z);
-  }
-  ActionInformationVector[*pixel]->size -= 1;
-  ActionInformationVector[*pixel]->centroid[0] -= x;
-  ActionInformationVector[*pixel]->centroid[1] -= y;
-  ActionInformationVector[*pixel]->centroid[2] -= z;
+  PreserveSnapshots(point, 1);
 
-  if (ActionInformationVector.find(scalar) == ActionInformationVector.end())
+  if (m_bricks)
   {
-    auto action = std::make_shared<ActionInformation>();
-    ActionInformationVector[scalar] = action;
-    action->min = Vector3ui(x, y, z);
-    action->max = Vector3ui(x, y, z);
+    unsigned int length;
+    return m_bricks->row(point, length);
   }
-  ActionInformationVector[scalar]->size += 1;
-  ActionInformationVector[scalar]->centroid[0] += x;
-  ActionInformationVector[scalar]->centroid[1] += y;
-  ActionInformationVector[scalar]->centroid[2] += z;
-
-  // have to check if the added voxel is out of the object region to make the bounding box grow
-  Vector3ui min = ActionInformationVector[scalar]->min;
-  Vector3ui max = ActionInformationVector[scalar]->max;
-
-  if (x < min[0]) min[0] = x;
-
-  if (x > max[0]) max[0] = x;
 
-  if (y < min[1]) min[1] = y;
-
-  if (y > max[1]) max[1] = y;
-
-  if (z < min[2]) min[2] = z;
-
-  if (z > max[2]) max[2] = z;
-
-  ActionInformationVector[scalar]->min = min;
-  ActionInformationVector[scalar]->max = max;
-
-  m_actionsBuffer->storePoint(Vector3ui(x, y, z), *pixel);
-  *pixel = scalar;
+  return LabelVoxels(m_structuredPoints->GetScalarPointer(point[0], point[1], point[2]), m_narrowVoxels);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-void DataManager::SetVoxelScalarRaw(const Vector3ui &point, const unsigned short scalar)
+const LabelType DataManager::SetLabel(const QColor &color)
 {
-  auto pixel = static_cast<unsigned short*>(m_structuredPoints->GetScalarPointer(point[0], point[1], point[2]));
-
-  if (scalar == *pixel) return;
+  auto labels = CreateLabels(std::vector<QColor>{color});
 
-  *pixel = scalar;
+  return labels.empty() ? 0 : labels.front();
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-const unsigned short DataManager::SetLabel(const QColor &color)
+std::vector<LabelType> DataManager::CreateLabels(const std::vector<QColor> &colors)
 {
-  // labelvalues usually goes 0-n, that's n+1 values = m_labelValues.size();
-  auto newlabel = ObjectVector.size();
+  std::vector<LabelType> labels;
+  if (colors.empty()) return labels;
+
+  labels.reserve(colors.size());
+
+  // labelvalues usually goes 0-n, that's n+1 values = m_labelValues.size(). The label values
+  // must fit in the voxels.
+  auto firstLabel = m_labelTable.size();
+  auto maximum = static_cast<unsigned int>(std::numeric_limits<LabelType>::max());
+  auto count = std::min(static_cast<unsigned int>(colors.size()), maximum - std::min(maximum, firstLabel));
+  ResizeLookupTable(firstLabel + count);
 
-  // we need to find an unused scalar value in our table
-  bool free = false;
-  auto freevalue = m_firstFreeValue;
+  // volumes loaded with voxels of 16 bits need wider ones to store the new labels.
+  if (m_narrowVoxels && !LabelVoxels::fitsNarrow(firstLabel + count)) SetVoxelWidth(false);
 
-  while (!free)
+  auto scalar = m_firstFreeValue;
+  for (unsigned int i = 0; i < count; ++i)
   {
-    free = true;
+    auto newlabel = m_labelTable.size();
 
-    // can't use find() as the value we're searching is the 'second' field
-    for (auto it: ObjectVector)
-    {
-      if (it.second->scalar == freevalue)
-      {
-        free = false;
-        freevalue++;
-      }
-    }
-  }
+    // we need to find an unused scalar value in our table, the search continues from the last one.
+    // Scalar 0 is the background's, a label can't use it.
+    scalar = m_labelTable.firstFreeScalar(scalar);
+    if (0 == scalar) break;
 
-  auto object = std::make_shared<ObjectInformation>();
-  object->scalar   = freevalue;
-  object->size     = 0;
-  object->centroid = Vector3d{0, 0, 0};
-  object->min      = Vector3ui{0, 0, 0};
-  object->max      = Vector3ui{0, 0, 0};
+    ObjectInformation object;
+    object.scalar = scalar;
 
-  ObjectVector.insert(std::pair<unsigned short, std::shared_ptr<ObjectInformation>>(newlabel, object));
+    m_labelTable.insert(newlabel, object);
 
-  m_actionsBuffer->storeObject(std::pair<unsigned short, std::shared_ptr<ObjectInformation>>(newlabel, object));
+    m_actionsBuffer->storeObject(std::pair<LabelType, ObjectInformation>(newlabel, object));
 
-  auto temptable = vtkSmartPointer<vtkLookupTable>::New();
-  CopyLookupTable(m_lookupTable, temptable);
+    auto &color = colors[i];
+    SetTableValue(newlabel, color.redF(), color.greenF(), color.blueF(), DIM_ALPHA);
+    m_colors.insert(color);
+    labels.push_back(newlabel);
+  }
 
-  // this is a convoluted way of doing things, but SetNumberOfTableValues() seems to
-  // corrupt the table (due to reallocation?) and all values must be copied again.
-  m_lookupTable->SetNumberOfTableValues(newlabel + 1);
-  double rgba[4];
-  for (int index = 0; index != temptable->GetNumberOfTableValues(); index++)
+  if (labels.size() < colors.size())
   {
-    temptable->GetTableValue(index, rgba);
-    m_lookupTable->SetTableValue(index, rgba);
+    qWarning() << "no free label or scalar values left, created" << labels.size() << "of" << colors.size() << "labels";
+    ResizeLookupTable(m_labelTable.size());
   }
-  m_lookupTable->SetTableValue(newlabel, color.redF(), color.greenF(), color.blueF(), DIM_ALPHA);
-  m_lookupTable->SetTableRange(0, newlabel);
   m_lookupTable->Modified();
 
-  return newlabel;
+  return labels;
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-void DataManager::CopyLookupTable(vtkSmartPointer<vtkLookupTable> from, vtkSmartPointer<vtkLookupTable> to) const
+void DataManager::ResizeLookupTable(const unsigned int values)
 {
-  // copyTo exists and i don't want to do just a DeepCopy that could release memory, i just want to copy the colors
-  double rgba[4];
-
-  to->Allocate();
-  to->SetNumberOfTableValues(from->GetNumberOfTableValues());
-
-  for (int index = 0; index != from->GetNumberOfTableValues(); index++)
+  // the capacity of the table grows geometrically so adding labels one by one takes amortized
+  // constant time. Resizing the table array keeps its values.
+  auto table = m_lookupTable->GetTable();
+  vtkIdType needed = values + vtkLookupTable::NUMBER_OF_SPECIAL_COLORS;
+  vtkIdType capacity = table->GetSize() / 4;
+  if (capacity < needed)
   {
-    from->GetTableValue(index, rgba);
-    to->SetTableValue(index, rgba);
+    table->Resize(std::max(needed, 2 * capacity));
   }
 
-  to->SetTableRange(0, from->GetNumberOfTableValues() - 1);
+  m_lookupTable->SetNumberOfTableValues(values);
+  m_lookupTable->SetTableRange(0, values - 1);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::SetTableValue(const LabelType label, const double r, const double g, const double b, const double a)
+{
+  double rgba[4];
+  m_lookupTable->GetTableValue(label, rgba);
+
+  m_actionsBuffer->storeColor(label, rgba);
+
+  m_lookupTable->SetTableValue(label, r, g, b, a);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
@@ -337,7 +1539,7 @@ void DataManager::GenerateLookupTable()
   // compute vtkLookupTable colors for labels, first color is black for background
   // rest are pre-calculated by Build() based on the number of labels
   double rgba[4]{ 0.05, 0.05, 0.05, HIGHLIGHT_ALPHA };
-  auto labels = m_labelMap->GetNumberOfLabelObjects();
+  auto labels = m_labelTable.size() - 1;
   Q_ASSERT(0 != labels);
 
   m_lookupTable->Allocate();
@@ -355,36 +1557,76 @@ void DataManager::GenerateLookupTable()
     temporal_table->GetTableValue(index, rgba);
     m_lookupTable->SetTableValue(index + 1, rgba[0], rgba[1], rgba[2], DIM_ALPHA);
   }
+
+  RebuildColorRegistry();
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-void DataManager::SwitchLookupTables(vtkSmartPointer<vtkLookupTable> table)
+void DataManager::SwitchLookupTables(unsigned int &values, ColorChanges &colors, std::set<LabelType> &labels)
 {
-  auto temptable = vtkSmartPointer<vtkLookupTable>::New();
+  // the current values of the changed colors and of the ones that will be removed revert the changes.
+  unsigned int current = m_lookupTable->GetNumberOfTableValues();
+  ColorChanges previous;
+
+  double rgba[4];
+  for (auto &color: colors)
+  {
+    if (color.first >= current) continue;
+
+    m_lookupTable->GetTableValue(color.first, rgba);
+    previous[color.first] = std::array<double, 4>{rgba[0], rgba[1], rgba[2], rgba[3]};
+  }
+
+  for (auto label = values; label < current; ++label)
+  {
+    m_lookupTable->GetTableValue(label, rgba);
+    previous[label] = std::array<double, 4>{rgba[0], rgba[1], rgba[2], rgba[3]};
+  }
+
+  if (values != current) ResizeLookupTable(values);
+
+  for (auto &color: colors)
+  {
+    if (color.first < values) m_lookupTable->SetTableValue(color.first, color.second.data());
+  }
 
-  CopyLookupTable(m_lookupTable, temptable);
-  CopyLookupTable(table, m_lookupTable);
-  CopyLookupTable(temptable, table);
+  // selection isn't stored in the changes, the alpha of the labels whose selection changes is set here.
+  auto selected = m_selectedLabels;
+  selected.insert(labels.begin(), labels.end());
+  for (auto label: selected)
+  {
+    if ((0 == label) || (label >= values)) continue;
+
+    m_lookupTable->GetTableValue(label, rgba);
+    rgba[3] = (labels.find(label) != labels.end()) ? HIGHLIGHT_ALPHA : DIM_ALPHA;
+    m_lookupTable->SetTableValue(label, rgba);
+  }
 
+  values = current;
+  colors.swap(previous);
+  m_selectedLabels.swap(labels);
+
+  RebuildColorRegistry();
   m_lookupTable->Modified();
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-void DataManager::StatisticsActionClear(void)
+void DataManager::FitVoxelWidth()
 {
-  for(auto it: ActionInformationVector)
-  {
-    it.second = nullptr;
-  }
+  if (!m_narrowVoxels && LabelVoxels::fitsNarrow(m_labelTable.size())) SetVoxelWidth(true);
+}
 
-  ActionInformationVector.clear();
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::StatisticsActionClear(void)
+{
+  m_actionStatistics.clear();
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
 void DataManager::OperationStart(const std::string &actionName)
 {
   StatisticsActionClear();
-  m_actionsBuffer->signalBeginAction(actionName, m_selectedLabels, m_lookupTable);
+  m_actionsBuffer->signalBeginAction(actionName, m_selectedLabels, m_lookupTable->GetNumberOfTableValues());
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
@@ -392,6 +1634,7 @@ void DataManager::OperationEnd()
 {
   m_actionsBuffer->signalEndAction();
   StatisticsActionUpdate();
+  CompactBricks();
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
@@ -412,6 +1655,30 @@ const std::string DataManager::GetRedoActionString() const
   return m_actionsBuffer->getActionString(UndoRedoSystem::Type::REDO);
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////////
+const std::string DataManager::GetUndoActionStorageString() const
+{
+  return m_actionsBuffer->getActionStorageString(UndoRedoSystem::Type::UNDO);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+const std::string DataManager::GetRedoActionStorageString() const
+{
+  return m_actionsBuffer->getActionStorageString(UndoRedoSystem::Type::REDO);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+std::vector<DataManager::ActionInformation> DataManager::GetUndoActionsInformation() const
+{
+  return m_actionsBuffer->getActionsInformation(UndoRedoSystem::Type::UNDO);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+std::vector<DataManager::ActionInformation> DataManager::GetRedoActionsInformation() const
+{
+  return m_actionsBuffer->getActionsInformation(UndoRedoSystem::Type::REDO);
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 const std::string DataManager::GetActualActionString() const
 {
@@ -436,6 +1703,7 @@ void DataManager::DoUndoOperation()
   StatisticsActionClear();
   m_actionsBuffer->doAction(UndoRedoSystem::Type::UNDO);
   StatisticsActionUpdate();
+  CompactBricks();
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
@@ -444,6 +1712,13 @@ void DataManager::DoRedoOperation()
   StatisticsActionClear();
   m_actionsBuffer->doAction(UndoRedoSystem::Type::REDO);
   StatisticsActionUpdate();
+  CompactBricks();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::CompactBricks()
+{
+  if (m_bricks) m_bricks->compact();
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
@@ -465,41 +1740,43 @@ const unsigned long int DataManager::GetUndoRedoBufferCapacity() const
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-void DataManager::SetFirstFreeValue(const unsigned short value)
+bool DataManager::SaveActionsJournal(const QString &fileName)
 {
-  m_firstFreeValue = value;
+  return m_actionsBuffer->writeJournal(fileName);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-const unsigned short DataManager::GetFirstFreeValue() const
+bool DataManager::LoadActionsJournal(const QString &fileName)
 {
-  return m_firstFreeValue;
+  return m_actionsBuffer->readJournal(fileName);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-const unsigned short DataManager::GetLastUsedValue() const
+void DataManager::SetFirstFreeValue(const LabelType value)
 {
-  unsigned short value = 0;
+  m_firstFreeValue = value;
+}
 
-  for (auto it: ObjectVector)
-  {
-    if (it.second->scalar > value) value = it.second->scalar;
-  }
+//////////////////////////////////////////////////////////////////////////////////////////////////
+const LabelType DataManager::GetFirstFreeValue() const
+{
+  return m_firstFreeValue;
+}
 
-  return value;
+//////////////////////////////////////////////////////////////////////////////////////////////////
+const LabelType DataManager::GetLastUsedValue() const
+{
+  return m_labelTable.lastUsedScalar();
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-const QColor DataManager::GetRGBAColorForScalar(const unsigned short scalar) const
+const QColor DataManager::GetRGBAColorForScalar(const LabelType scalar) const
 {
-  for (auto it: ObjectVector)
+  if (m_labelTable.isScalarUsed(scalar))
   {
-    if (it.second->scalar == scalar)
-    {
-      double rgba[4];
-      m_lookupTable->GetTableValue(it.first, rgba);
-      return QColor::fromRgbF(rgba[0],rgba[1],rgba[2],rgba[3]);
-    }
+    double rgba[4];
+    m_lookupTable->GetTableValue(m_labelTable.labelForScalar(scalar), rgba);
+    return QColor::fromRgbF(rgba[0],rgba[1],rgba[2],rgba[3]);
   }
 
   // not found
@@ -509,119 +1786,214 @@ const QColor DataManager::GetRGBAColorForScalar(const unsigned short scalar) con
 //////////////////////////////////////////////////////////////////////////////////////////////////
 void DataManager::StatisticsActionUpdate(void)
 {
-  for (auto it: ActionInformationVector)
+  for (auto label: m_actionStatistics.labels())
   {
     // the action information could refer to a deleted label (in undo/redo buffer)
-    if (ObjectVector.count(it.first) == 0) continue;
+    if (!m_labelTable.contains(label)) continue;
+
+    auto objectVoxels = m_labelTable.voxels(label);
+    auto actionVoxels = m_actionStatistics.voxels(label);
 
     // no need to recalculate centroid or bounding box for background label
-    if (it.first != 0)
+    if (label != 0)
     {
       // calculate new centroid based on modified voxels
-      if (0 == (ObjectVector[it.first]->size + it.second->size))
+      if (0 == (objectVoxels + actionVoxels))
       {
-        ObjectVector[it.first]->centroid = Vector3d{0, 0, 0};
+        m_labelTable.setCentroid(label, Vector3d{0, 0, 0});
       }
-      else
+      else if (0 != actionVoxels)
       {
-        auto x = (it.second->centroid[0] / static_cast<double>(it.second->size));
-        auto y = (it.second->centroid[1] / static_cast<double>(it.second->size));
-        auto z = (it.second->centroid[2] / static_cast<double>(it.second->size));
+        auto sum = m_actionStatistics.coordinatesSum(label);
+        auto x = (sum[0] / static_cast<double>(actionVoxels));
+        auto y = (sum[1] / static_cast<double>(actionVoxels));
+        auto z = (sum[2] / static_cast<double>(actionVoxels));
 
-        auto centroid = ObjectVector[it.first]->centroid;
-        auto objectVoxels = ObjectVector[it.first]->size;
+        auto centroid = m_labelTable.centroid(label);
 
         // if the object has a centroid
         if ((Vector3d{0, 0, 0} != centroid) && (0 != objectVoxels))
         {
-          auto coef_1 = objectVoxels / static_cast<double>(objectVoxels + it.second->size);
-          auto coef_2 = it.second->size / static_cast<double>(objectVoxels + it.second->size);
+          auto coef_1 = objectVoxels / static_cast<double>(objectVoxels + actionVoxels);
+          auto coef_2 = actionVoxels / static_cast<double>(objectVoxels + actionVoxels);
 
           x = (centroid[0] * coef_1) + (x * coef_2);
           y = (centroid[1] * coef_1) + (y * coef_2);
           z = (centroid[2] * coef_1) + (z * coef_2);
         }
-        ObjectVector[it.first]->centroid = Vector3d{x, y, z};
+        m_labelTable.setCentroid(label, Vector3d{x, y, z});
       }
 
-      // if the object doesn't have voxels means that the calculated bounding box is the object bounding box
-      if (0LL == ObjectVector[it.first]->size)
+      // update the slab counts, the bounding box is the extent of the non empty slabs so it shrinks
+      // when voxels are removed.
+      auto &dimensions = m_actionStatistics.dimensions();
+      for (unsigned int i = 0; i < 3; ++i)
       {
-        ObjectVector[it.first]->min = it.second->min;
-        ObjectVector[it.first]->max = it.second->max;
+        m_labelTable.updateSlabs(label, i, m_actionStatistics.slabs(label, i), dimensions[i]);
       }
-      // else calculate new bounding box based on modified voxels, but only if we've been adding voxels, not substracting them
-      else
+
+      Vector3ui min, max;
+      if (m_labelTable.slabsBoundingBox(label, min, max))
       {
-        if (0LL < it.second->size)
-        {
-          if (ObjectVector[it.first]->min[0] > it.second->min[0]) ObjectVector[it.first]->min[0] = it.second->min[0];
-          if (ObjectVector[it.first]->min[1] > it.second->min[1]) ObjectVector[it.first]->min[1] = it.second->min[1];
-          if (ObjectVector[it.first]->min[2] > it.second->min[2]) ObjectVector[it.first]->min[2] = it.second->min[2];
-          if (ObjectVector[it.first]->max[0] < it.second->max[0]) ObjectVector[it.first]->max[0] = it.second->max[0];
-          if (ObjectVector[it.first]->max[1] < it.second->max[1]) ObjectVector[it.first]->max[1] = it.second->max[1];
-          if (ObjectVector[it.first]->max[2] < it.second->max[2]) ObjectVector[it.first]->max[2] = it.second->max[2];
-        }
+        m_labelTable.setBoundingBox(label, min, max);
       }
     }
-    ObjectVector[it.first]->size += it.second->size;
+    m_labelTable.setVoxels(label, objectVoxels + actionVoxels);
   }
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-unsigned long long int DataManager::GetNumberOfVoxelsForLabel(unsigned short label)
+unsigned long long int DataManager::GetNumberOfVoxelsForLabel(LabelType label)
+{
+  Q_ASSERT(m_labelTable.contains(label));
+  return m_labelTable.voxels(label);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+LabelType DataManager::GetScalarForLabel(const LabelType label)
+{
+  Q_ASSERT(m_labelTable.contains(label));
+  return m_labelTable.scalar(label);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+LabelType DataManager::GetLabelForScalar(const LabelType scalar) const
 {
-  Q_ASSERT(label < ObjectVector.size());
-  return ObjectVector[label]->size;
+  return m_labelTable.labelForScalar(scalar);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-unsigned short DataManager::GetScalarForLabel(const unsigned short label)
+Vector3d DataManager::GetCentroidForObject(const LabelType label)
 {
-  Q_ASSERT(label < ObjectVector.size());
-  return ObjectVector[label]->scalar;
+  Q_ASSERT(m_labelTable.contains(label));
+  return m_labelTable.centroid(label);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-unsigned short DataManager::GetLabelForScalar(const unsigned short scalar) const
+std::vector<DataManager::VoxelRun> DataManager::GetLabelRuns(const LabelType label)
 {
-  for (auto it: ObjectVector)
+  std::vector<VoxelRun> runs;
+
+  if (0 == label)
+  {
+    // background isn't indexed, its bounding box rows are returned instead.
+    auto min = GetBoundingBoxMin(label);
+    auto max = GetBoundingBoxMax(label);
+    if ((min[0] > max[0]) || (min[1] > max[1]) || (min[2] > max[2])) return runs;
+
+    for (auto z = min[2]; z <= max[2]; ++z)
+    {
+      for (auto y = min[1]; y <= max[1]; ++y)
+      {
+        runs.emplace_back(GetVoxelOffset(Vector3ui{min[0], y, z}), max[0] - min[0] + 1);
+      }
+    }
+
+    return runs;
+  }
+
+  // the runs of the label are read the first time they are requested, after that only the rows
+  // modified since the last request are read again.
+  auto min = GetBoundingBoxMin(label);
+  auto max = GetBoundingBoxMax(label);
+  auto empty = (min[0] > max[0]) || (min[1] > max[1]) || (min[2] > max[2]);
+
+  if (!m_runIndex.contains(label))
+  {
+    std::vector<LabelRunIndex::Run> labelRuns;
+    if (!empty) ReadLabelRuns(label, min, max, labelRuns);
+
+    m_runIndex.set(label, std::move(labelRuns));
+  }
+  else
+  {
+    auto rows = m_runIndex.modifiedRows(label);
+    if (!rows.empty())
+    {
+      int extent[6];
+      m_structuredPoints->GetExtent(extent);
+      unsigned long long int dimX = extent[1] - extent[0] + 1;
+
+      std::vector<LabelRunIndex::Run> rowRuns;
+      for (auto row: rows)
+      {
+        auto point = GetVoxelCoordinates(row * dimX);
+        if (empty || (point[1] < min[1]) || (point[1] > max[1]) || (point[2] < min[2]) || (point[2] > max[2])) continue;
+
+        ReadLabelRuns(label, Vector3ui{min[0], point[1], point[2]}, Vector3ui{max[0], point[1], point[2]}, rowRuns);
+      }
+
+      m_runIndex.update(label, rowRuns);
+    }
+  }
+
+  auto &labelRuns = m_runIndex.runs(label);
+  runs.reserve(labelRuns.size());
+  for (auto &run: labelRuns)
   {
-    if (it.second->scalar == scalar) return it.first;
+    runs.emplace_back(run.offset, run.length);
   }
 
-  return 0;
+  return runs;
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-Vector3d DataManager::GetCentroidForObject(const unsigned short int label)
+void DataManager::ReadLabelRuns(const LabelType label, const Vector3ui &min, const Vector3ui &max, std::vector<LabelRunIndex::Run> &runs) const
 {
-  Q_ASSERT(label < ObjectVector.size());
-  return ObjectVector[label]->centroid;
+  unsigned int rowLength = max[0] - min[0] + 1;
+  std::vector<LabelType> slice(static_cast<unsigned long long int>(rowLength) * (max[1] - min[1] + 1));
+
+  for (auto z = min[2]; z <= max[2]; ++z)
+  {
+    CopyRegion(Vector3ui{min[0], min[1], z}, Vector3ui{max[0], max[1], z}, slice.data());
+
+    auto values = slice.data();
+    for (auto y = min[1]; y <= max[1]; ++y)
+    {
+      auto offset = GetVoxelOffset(Vector3ui{min[0], y, z});
+
+      unsigned int x = 0;
+      while (x < rowLength)
+      {
+        if (values[x] != label)
+        {
+          ++x;
+          continue;
+        }
+
+        auto begin = x;
+        while ((x < rowLength) && (values[x] == label)) ++x;
+
+        runs.emplace_back(offset + begin, x - begin);
+      }
+
+      values += rowLength;
+    }
+  }
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-Vector3ui DataManager::GetBoundingBoxMin(unsigned short label)
+Vector3ui DataManager::GetBoundingBoxMin(LabelType label)
 {
-  Q_ASSERT(label < ObjectVector.size());
-  return ObjectVector[label]->min;
+  Q_ASSERT(m_labelTable.contains(label));
+  return m_labelTable.min(label);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-Vector3ui DataManager::GetBoundingBoxMax(unsigned short label)
+Vector3ui DataManager::GetBoundingBoxMax(LabelType label)
 {
-  Q_ASSERT(label < ObjectVector.size());
-  return ObjectVector[label]->max;
+  Q_ASSERT(m_labelTable.contains(label));
+  return m_labelTable.max(label);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
 const unsigned int DataManager::GetNumberOfLabels(void) const
 {
-  return ObjectVector.size();
+  return m_labelTable.size();
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-void DataManager::ColorHighlight(const unsigned short label)
+void DataManager::ColorHighlight(const LabelType label)
 {
   if (0 == label) return;
 
@@ -630,7 +2002,7 @@ void DataManager::ColorHighlight(const unsigned short label)
     double rgba[4];
 
     m_lookupTable->GetTableValue(label, rgba);
-    m_lookupTable->SetTableValue(label, rgba[0], rgba[1], rgba[2], HIGHLIGHT_ALPHA);
+    SetTableValue(label, rgba[0], rgba[1], rgba[2], HIGHLIGHT_ALPHA);
 
     m_selectedLabels.insert(label);
     m_lookupTable->Modified();
@@ -638,14 +2010,14 @@ void DataManager::ColorHighlight(const unsigned short label)
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-void DataManager::ColorDim(const unsigned short label)
+void DataManager::ColorDim(const LabelType label)
 {
   if (m_selectedLabels.find(label) != m_selectedLabels.end())
   {
     double rgba[4];
 
     m_lookupTable->GetTableValue(label, rgba);
-    m_lookupTable->SetTableValue(label, rgba[0], rgba[1], rgba[2], DIM_ALPHA);
+    SetTableValue(label, rgba[0], rgba[1], rgba[2], DIM_ALPHA);
 
     m_selectedLabels.erase(label);
     m_lookupTable->Modified();
@@ -653,7 +2025,7 @@ void DataManager::ColorDim(const unsigned short label)
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-void DataManager::ColorHighlightExclusive(const unsigned short label)
+void DataManager::ColorHighlightExclusive(const LabelType label)
 {
   auto labels = m_selectedLabels;
   for (auto it: labels)
@@ -663,7 +2035,7 @@ void DataManager::ColorHighlightExclusive(const unsigned short label)
     double rgba[4];
 
     m_lookupTable->GetTableValue(it, rgba);
-    m_lookupTable->SetTableValue(it, rgba[0], rgba[1], rgba[2], DIM_ALPHA);
+    SetTableValue(it, rgba[0], rgba[1], rgba[2], DIM_ALPHA);
     m_selectedLabels.erase(it);
   }
 
@@ -683,7 +2055,7 @@ void DataManager::ColorDimAll()
     double rgba[4];
 
     m_lookupTable->GetTableValue(it, rgba);
-    m_lookupTable->SetTableValue(it, rgba[0], rgba[1], rgba[2], DIM_ALPHA);
+    SetTableValue(it, rgba[0], rgba[1], rgba[2], DIM_ALPHA);
 
     m_selectedLabels.erase(it);
   }
@@ -693,15 +2065,26 @@ void DataManager::ColorDimAll()
 //////////////////////////////////////////////////////////////////////////////////////////////////
 const bool DataManager::ColorIsInUse(const QColor &color) const
 {
-  double rgba[4];
+  return m_colors.contains(color);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+std::vector<QColor> DataManager::GetDistinctColors(const unsigned int count)
+{
+  return m_colors.distinctColors(count);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+void DataManager::RebuildColorRegistry()
+{
+  m_colors.clear();
 
+  double rgba[4];
   for (int i = 0; i < m_lookupTable->GetNumberOfTableValues(); ++i)
   {
     m_lookupTable->GetTableValue(i, rgba);
-    if ((rgba[0] == color.redF()) && (rgba[1] == color.greenF()) && (rgba[2] == color.blueF())) return true;
+    m_colors.insert(QColor::fromRgbF(rgba[0], rgba[1], rgba[2]));
   }
-
-  return false;
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
@@ -711,7 +2094,7 @@ const unsigned int DataManager::GetNumberOfColors() const
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-const QColor DataManager::GetColorComponents(const unsigned short label) const
+const QColor DataManager::GetColorComponents(const LabelType label) const
 {
   double rgba[4];
   m_lookupTable->GetTableValue(label, rgba);
@@ -720,9 +2103,12 @@ const QColor DataManager::GetColorComponents(const unsigned short label) const
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-void DataManager::SetColorComponents(unsigned short label, const QColor &color)
+void DataManager::SetColorComponents(LabelType label, const QColor &color)
 {
-  m_lookupTable->SetTableValue(label, color.redF(), color.greenF(), color.blueF(), color.alphaF());
+  m_colors.remove(GetColorComponents(label));
+  m_colors.insert(color);
+
+  SetTableValue(label, color.redF(), color.greenF(), color.blueF(), color.alphaF());
   m_lookupTable->Modified();
 }
 
@@ -733,19 +2119,19 @@ vtkSmartPointer<vtkLookupTable> DataManager::GetLookupTable() const
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-const std::set<unsigned short> DataManager::GetSelectedLabelsSet(void) const
+const std::set<LabelType> DataManager::GetSelectedLabelsSet(void) const
 {
   return m_selectedLabels;
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-const bool DataManager::IsColorSelected(unsigned short color) const
+const bool DataManager::IsColorSelected(LabelType color) const
 {
   return (m_selectedLabels.find(color) != m_selectedLabels.end());
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
-void DataManager::SetSelectedLabelsSet(const std::set<unsigned short> &labelSet)
+void DataManager::SetSelectedLabelsSet(const std::set<LabelType> &labelSet)
 {
   m_selectedLabels = labelSet;
 }
@@ -761,5 +2147,9 @@ void DataManager::SignalDataAsModified(void)
 {
   m_structuredPoints->Modified();
 
-  emit modified();
+  // the region is reset before emitting, the slots can modify the data.
+  auto region = m_dirty;
+  m_dirty = DirtyRegion();
+
+  emit modified(region);
 }
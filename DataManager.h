@@ -12,30 +12,87 @@
 #define _DATAMANAGER_H_
 
 // vtk includes
+#include <vtkImageData.h>
 #include <vtkStructuredPoints.h>
 #include <vtkLookupTable.h>
 #include <vtkSmartPointer.h>
 
 // itk includes
+#include <itkImage.h>
+#include <itkImageFileReader.h>
 #include <itkLabelMap.h>
 #include <itkSmartPointer.h>
 #include <itkShapeLabelObject.h>
 
 // c++ includes
+#include <array>
+#include <atomic>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <vector>
 
 // project includes
+#include "ActionStatistics.h"
+#include "BrickedVolume.h"
+#include "ColorRegistry.h"
 #include "Coordinates.h"
+#include "LabelRunIndex.h"
+#include "LabelTable.h"
+#include "LabelType.h"
+#include "LabelVoxels.h"
 #include "Metadata.h"
 #include "VectorSpaceAlgebra.h"
+#include "VolumeSnapshot.h"
+#include "VoxelDeltas.h"
 
 // Qt
 #include <QObject>
+#include <QTemporaryFile>
 
 // defines & typedefs
-using LabelObjectType = itk::ShapeLabelObject<unsigned short, 3>;
+using LabelObjectType = itk::ShapeLabelObject<LabelType, 3>;
 using LabelMapType = itk::LabelMap<LabelObjectType>;
+using ImageType = itk::Image<LabelType, 3>;
+using ImageReaderType = itk::ImageFileReader<ImageType>;
+
+/** \brief Region of the image and labels modified since the last modification signal.
+ *
+ */
+struct DirtyRegion
+{
+    Vector3ui                min;    /** minimum coordinates of the modified voxels.          */
+    Vector3ui                max;    /** maximum coordinates of the modified voxels.          */
+    std::set<LabelType>      labels; /** values that were replaced or written in the voxels. */
+
+    DirtyRegion()
+    : min{Vector3ui{0, 0, 0}}, max{Vector3ui{0, 0, 0}} {};
+
+    /** \brief Returns true if no voxel has been modified.
+     *
+     */
+    const bool isEmpty() const
+    { return labels.empty(); }
+
+    /** \brief Returns true if the region intersects the given one.
+     * \param[in] regionMin region minimum coordinates.
+     * \param[in] regionMax region maximum coordinates.
+     *
+     */
+    const bool intersects(const Vector3ui &regionMin, const Vector3ui &regionMax) const
+    {
+      if (isEmpty()) return false;
+
+      for (unsigned int i = 0; i < 3; ++i)
+      {
+        if ((max[i] < regionMin[i]) || (min[i] > regionMax[i])) return false;
+      }
+
+      return true;
+    }
+};
 
 // UndoRedoSystem forward declaration
 class UndoRedoSystem;
@@ -60,15 +117,24 @@ class DataManager
      */
     ~DataManager(void);
 
-    /** \brief Initializes the data manager.
-     * \param[in] labelMap label map image.
+    /** \brief Initializes the data manager reading the image of the given reader in slabs of
+     * BrickedVolume::BRICK_SIZE slices, the whole image is never held in memory besides its storage.
+     * If the voxels hold scalars a first pass counts the voxels of each scalar to build the label
+     * table, with the labels consecutive from 1 in scalar order, and a second pass writes the labels
+     * to the storage. If the voxels already hold labels the label table must have been set and only
+     * the second pass is done. Throws the exceptions of the reader.
+     * \param[in] reader image reader with its output information updated.
      * \param[in] coordinates image coordinates.
-     * \param[in] metadata image metadata.
+     * \param[in] metadata image metadata, the scalars of the image are marked as used.
+     * \param[in] scalars true if the voxels hold scalars and false if they hold labels.
+     * \param[in] progress called with the progress of the reading in [0, 100], can be null.
      *
      */
-    void Initialize(itk::SmartPointer<LabelMapType> labelMap,
-                    std::shared_ptr<Coordinates>    coordinates,
-                    std::shared_ptr<Metadata>       metadata);
+    void Initialize(itk::SmartPointer<ImageReaderType>  reader,
+                    std::shared_ptr<Coordinates>        coordinates,
+                    std::shared_ptr<Metadata>           metadata,
+                    const bool                          scalars = true,
+                    std::function<void(const int)>      progress = nullptr);
 
     /** \brief Undo/Redo system start operation signaling.
      * \param[in] operationName name of the starting operation.
@@ -96,6 +162,38 @@ class DataManager
      */
     const std::string GetRedoActionString() const;
 
+    /** \brief Returns the description of how the current undo action stores the voxels.
+     *
+     */
+    const std::string GetUndoActionStorageString() const;
+
+    /** \brief Returns the description of how the current redo action stores the voxels.
+     *
+     */
+    const std::string GetRedoActionStorageString() const;
+
+    /** \brief Memory information of an undo/redo action.
+     *
+     */
+    struct ActionInformation
+    {
+        std::string            description; /** description of the action.                                  */
+        bool                   region;      /** true if stored as a region snapshot, false if as points.   */
+        unsigned long long int voxels;      /** number of voxels modified by the action.                    */
+        unsigned long long int memory;      /** bytes of memory used by the action.                         */
+        unsigned long long int spilled;     /** bytes of the undo scratch file used by the action.          */
+    };
+
+    /** \brief Returns the information of the undo actions, from the next one to be undone.
+     *
+     */
+    std::vector<ActionInformation> GetUndoActionsInformation() const;
+
+    /** \brief Returns the information of the redo actions, from the next one to be redone.
+     *
+     */
+    std::vector<ActionInformation> GetRedoActionsInformation() const;
+
     /** \brief Returns the current operation name.
      *
      */
@@ -137,22 +235,36 @@ class DataManager
      */
     const unsigned long int GetUndoRedoBufferCapacity() const;
 
+    /** \brief Writes the undo actions added since the last call to the journal file saved with the
+     * session. Returns true on success.
+     * \param[in] fileName journal file name.
+     *
+     */
+    bool SaveActionsJournal(const QString &fileName);
+
+    /** \brief Restores the undo actions of the journal file saved with the session. Returns true on
+     * success.
+     * \param[in] fileName journal file name.
+     *
+     */
+    bool LoadActionsJournal(const QString &fileName);
+
     /** \brief Highlights the color of the given scalar value.
      * \param[in] value value of the color to highlight.
      *
      */
-    void ColorHighlight(const unsigned short value);
+    void ColorHighlight(const LabelType value);
 
     /** \brief Dims the color of the given scalar.
      * \param[in] value value of the color to dim.
      *
      */
-    void ColorDim(const unsigned short value);
+    void ColorDim(const LabelType value);
 
     /** \brief Highlights the color of the given value exclusively.
      *
      */
-    void ColorHighlightExclusive(const unsigned short value);
+    void ColorHighlightExclusive(const LabelType value);
 
     /** \brief Dims all the colors.
      *
@@ -164,6 +276,13 @@ class DataManager
      */
     const bool ColorIsInUse(const QColor &color) const;
 
+    /** \brief Returns the given number of well separated colors that aren't in use and are different
+     * between them.
+     * \param[in] count number of colors.
+     *
+     */
+    std::vector<QColor> GetDistinctColors(const unsigned int count);
+
     /** \brief Returns the number of used colors.
      *
      *
@@ -174,19 +293,106 @@ class DataManager
      * \param[in] value color scalar value.
      *
      */
-    const QColor GetColorComponents(const unsigned short value) const;
+    const QColor GetColorComponents(const LabelType value) const;
 
     /** \brief Changes the color assigned to the given scalar value.
      *
      */
-    void SetColorComponents(const unsigned short value, const QColor &color);
+    void SetColorComponents(const LabelType value, const QColor &color);
 
     /** \brief Changes the scalar value of the given point.
      * \param[in] point point coordinates.
      * \param[in] value new scalar value.
      *
      */
-    void SetVoxelScalar(const Vector3ui &point, const unsigned short value);
+    void SetVoxelScalar(const Vector3ui &point, const LabelType value);
+
+    struct VoxelRun
+    {
+        unsigned long long int offset; /** linear offset of the first voxel of the run in the image buffer. */
+        unsigned int           length; /** number of voxels of the run, all in the same image row.        */
+
+        VoxelRun(const unsigned long long int runOffset = 0, const unsigned int runLength = 0)
+        : offset{runOffset}, length{runLength} {};
+    };
+
+    /** \brief Changes the scalar value of the voxels in the given linear offsets of the image buffer.
+     * Buffer, statistics and undo/redo system are updated in one pass, big writes are split between
+     * threads so the offsets must not be repeated.
+     * \param[in] offsets voxel linear offsets.
+     * \param[in] value new scalar value.
+     * \param[in] labels if not empty only the voxels with these values are modified.
+     *
+     */
+    void SetVoxelScalars(const std::vector<unsigned long long int> &offsets, const LabelType value, const std::set<LabelType> &labels = std::set<LabelType>());
+
+    /** \brief Changes the scalar value of the voxels in the given runs.
+     * Buffer, statistics and undo/redo system are updated in one pass, big writes are split between
+     * threads so the runs must not overlap.
+     * \param[in] runs voxel runs.
+     * \param[in] value new scalar value.
+     * \param[in] labels if not empty only the voxels with these values are modified.
+     *
+     */
+    void SetVoxelScalars(const std::vector<VoxelRun> &runs, const LabelType value, const std::set<LabelType> &labels = std::set<LabelType>());
+
+    /** \brief Changes the scalar value of the voxels of the given region.
+     * Buffer, statistics and undo/redo system are updated in one pass, big regions are split between threads.
+     * \param[in] min region minimum coordinates.
+     * \param[in] max region maximum coordinates.
+     * \param[in] mask one value per voxel of the region, x varying fastest, only voxels with a non-zero
+     *                 value are modified. If empty all the voxels of the region are modified.
+     * \param[in] value new scalar value.
+     * \param[in] labels if not empty only the voxels with these values are modified.
+     *
+     */
+    void SetVoxelScalars(const Vector3ui &min, const Vector3ui &max, const std::vector<unsigned char> &mask, const LabelType value, const std::set<LabelType> &labels = std::set<LabelType>());
+
+    /** \brief Restores the values of the given points in reverse order, used by the undo/redo system.
+     * Buffer and undo/redo system are updated in one pass, the statistics aren't modified, the
+     * undo/redo system applies the ones stored with the action using ApplyActionStatistics().
+     * \param[in] points points offsets and values.
+     *
+     */
+    void RestoreVoxelScalars(const VoxelDeltas &points);
+
+    /** \brief Swaps the voxels of a region with the given ones, used by the undo/redo system to restore
+     * the region snapshots. Only the buffer is updated, the changes aren't stored in the undo/redo
+     * system and the statistics aren't modified.
+     * \param[in] min region minimum coordinates.
+     * \param[in] max region maximum coordinates.
+     * \param[in,out] values values of the region voxels, x varying fastest. On return holds the previous ones.
+     *
+     */
+    void SwapVoxelScalars(const Vector3ui &min, const Vector3ui &max, std::vector<LabelType> &values);
+
+    /** \brief Returns the statistics of the current action packed, used by the undo/redo system to
+     * store them with the action.
+     *
+     */
+    std::vector<long long int> GetActionStatistics() const
+    { return m_actionStatistics.pack(); }
+
+    /** \brief Adds the given packed statistics to the ones of the current action, used by the undo/redo
+     * system to update the statistics without recomputing them from the restored voxels.
+     * \param[in] statistics packed statistics.
+     * \param[in] inverse true to subtract them.
+     *
+     */
+    void ApplyActionStatistics(const std::vector<long long int> &statistics, const bool inverse)
+    { m_actionStatistics.merge(statistics, inverse); }
+
+    /** \brief Returns the linear offset of the given point in the image buffer.
+     * \param[in] point point coordinates.
+     *
+     */
+    const unsigned long long int GetVoxelOffset(const Vector3ui &point) const;
+
+    /** \brief Returns the coordinates of the voxel with the given linear offset in the image buffer.
+     * \param[in] offset linear offset.
+     *
+     */
+    const Vector3ui GetVoxelCoordinates(const unsigned long long int offset) const;
 
     /** \brief Changes the scalar value of the given point bypassing the undo/redo system.
      * Used inside exception treatment code.
@@ -194,14 +400,23 @@ class DataManager
      * \param[in] value new scalar value.
      *
      */
-    void SetVoxelScalarRaw(const Vector3ui &point, const unsigned short value);
+    void SetVoxelScalarRaw(const Vector3ui &point, const LabelType value);
 
     /** \brief Creates a new label and assigns a new scalar to that label, starting from an initial
-     * optional value. Modifies color table and returns new label position (not scalar used for that label).
+     * optional value. Modifies color table and returns new label position (not scalar used for that label)
+     * or 0 if there are no free label or scalar values left.
      * \param[in] color color of the new label value.
      *
      */
-    const unsigned short SetLabel(const QColor &color);
+    const LabelType SetLabel(const QColor &color);
+
+    /** \brief Creates a new label for each of the given colors in one step, the color table is
+     * resized once. Returns the new labels in the order of the colors. If the label values or the free
+     * scalar values run out no more labels are created and fewer labels than colors are returned.
+     * \param[in] colors colors of the new labels.
+     *
+     */
+    std::vector<LabelType> CreateLabels(const std::vector<QColor> &colors);
 
     /** \brief Sets the image to be managed.
      * \param[in] image image data.
@@ -209,32 +424,113 @@ class DataManager
      */
     void SetStructuredPoints(vtkSmartPointer<vtkStructuredPoints> image);
 
+    /** \brief Enables or disables the storage of the image in bricks, must be set before the image.
+     * In bricked storage the bricks with the same value in all their voxels don't use memory.
+     * \param[in] enabled true to use bricked storage and false to use a dense image.
+     *
+     */
+    void SetBrickedStorage(const bool enabled);
+
+    /** \brief Returns true if bricked storage is enabled.
+     *
+     */
+    const bool IsBrickedStorageEnabled() const;
+
+    /** \brief Returns true if the image is stored in bricks.
+     *
+     */
+    const bool IsBrickedStorage() const;
+
+    /** \brief Enables or disables the storage of the dense image in a memory mapped temporary file
+     * instead of heap memory, must be set before the image. Ignored with bricked storage.
+     * \param[in] enabled true to map the image to a file and false to use heap memory.
+     *
+     */
+    void SetMappedStorage(const bool enabled);
+
+    /** \brief Returns true if memory mapped storage is enabled.
+     *
+     */
+    const bool IsMappedStorage() const;
+
     /** \brief Set the first scalar value that is free to assign a label (it's NOT the label number).
      * \param[in] value scalar value.
      *
      */
-    void SetFirstFreeValue(const unsigned short value);
+    void SetFirstFreeValue(const LabelType value);
 
     /** \brief Sets the group of selected labels.
      * \param[in] labels group of selected labels.
      *
      */
-    void SetSelectedLabelsSet(const std::set<unsigned short> &labels);
+    void SetSelectedLabelsSet(const std::set<LabelType> &labels);
 
     /** \brief Returns the lookuptable used for coloring.
      *
      */
     vtkSmartPointer<vtkLookupTable> GetLookupTable() const;
 
-    /** \brief Returns a pointer to the image data object.
+    /** \brief Returns a pointer to the image data object. With bricked storage the image only has
+     * the image geometry and no scalars, use GetImageData() to get the voxels. The scalars are
+     * unsigned short if the voxels use 16 bits and LabelType otherwise.
      *
      */
     vtkSmartPointer<vtkStructuredPoints> GetStructuredPoints() const;
 
-    /** \brief Returns the original labelmap used to generate the image data.
+    /** \brief Returns a dense image of the whole volume. Doesn't copy the data unless the image
+     * is stored in bricks, see GetStructuredPoints() for the scalar type.
+     *
+     */
+    vtkSmartPointer<vtkImageData> GetImageData() const;
+
+    /** \brief Returns a dense copy of the given region of the image, clipped to the image extent.
+     * \param[in] min region minimum coordinates.
+     * \param[in] max region maximum coordinates.
+     *
+     */
+    vtkSmartPointer<vtkImageData> GetImageData(const Vector3ui &min, const Vector3ui &max) const;
+
+    /** \brief Returns an itk image of the given region, clipped to the image extent. Regions of
+     * complete slices of a dense image are contiguous and the image wraps the voxels without copying
+     * them, so it must not be modified and must be released before the voxels are written. Other
+     * regions, bricked storage, voxels narrower than LabelType or a requested copy are copied once to
+     * the image buffer.
+     * \param[in] min region minimum coordinates.
+     * \param[in] max region maximum coordinates.
+     * \param[in] copy true to copy the voxels, for filters that run in place.
      *
      */
-    itk::SmartPointer<LabelMapType> GetLabelMap() const;
+    itk::SmartPointer<ImageType> GetItkImage(const Vector3ui &min, const Vector3ui &max, const bool copy = false) const;
+
+    /** \brief Returns an itk image of the whole volume, see GetItkImage(min, max, copy).
+     * \param[in] copy true to copy the voxels, for filters that run in place.
+     *
+     */
+    itk::SmartPointer<ImageType> GetItkImage(const bool copy = false) const;
+
+    /** \brief Returns a consistent read only view of the current image that can be read from other
+     * threads while the image is being modified. The bricks are copied to the snapshot only before
+     * they are written. Must be called while no voxels are being written.
+     *
+     */
+    std::shared_ptr<VolumeSnapshot> CreateSnapshot();
+
+    /** \brief Returns the bricks of the image that intersect the given region. Uniform bricks can be
+     * skipped or processed as a whole, with dense storage all bricks are non-uniform views of the image.
+     * \param[in] min region minimum coordinates.
+     * \param[in] max region maximum coordinates.
+     *
+     */
+    std::vector<BrickedVolume::Brick> GetBricks(const Vector3ui &min, const Vector3ui &max) const;
+
+    /** \brief Copies the voxels of a region of the image to a buffer, x varying fastest, with the
+     * scalars of their labels. Used to write the image slab by slab.
+     * \param[in] min region minimum coordinates.
+     * \param[in] max region maximum coordinates.
+     * \param[out] buffer region scalars.
+     *
+     */
+    void GetRegionScalars(const Vector3ui &min, const Vector3ui &max, LabelType *buffer) const;
 
     /** \brief Returns the orientation data.
      *
@@ -245,58 +541,72 @@ class DataManager
      * \param[in] label label value.
      *
      */
-    unsigned short GetScalarForLabel(const unsigned short label);
+    LabelType GetScalarForLabel(const LabelType label);
 
     /** \brief Returns the label used for the given scalar.
      * \param[in] value scalar value.
      *
      */
-    unsigned short GetLabelForScalar(const unsigned short value) const;
+    LabelType GetLabelForScalar(const LabelType value) const;
 
     /** \brief Returns the centroid of the object with the given label.
      * \param[in] label label value.
      */
-    Vector3d GetCentroidForObject(const unsigned short int label);
+    Vector3d GetCentroidForObject(const LabelType label);
 
     /** \brief Returns the scalar value of the given position.
      * \param[in] point point coordinates.
      *
      */
-    const unsigned short GetVoxelScalar(const Vector3ui &point) const;
+    const LabelType GetVoxelScalar(const Vector3ui &point) const;
 
     /** \brief Returns the first scalar value that is free to assign to a label (NOT the label number).
      *
      */
-    const unsigned short GetFirstFreeValue() const;
+    const LabelType GetFirstFreeValue() const;
 
     /** \brief Returns the last used scalar in _labelValues.
      *
      */
-    const unsigned short GetLastUsedValue() const;
+    const LabelType GetLastUsedValue() const;
 
     /** \brief Returns the color of the given scalar value.
      * \param[in] value scalar value.
      *
      */
-    const QColor GetRGBAColorForScalar(const unsigned short value) const;
+    const QColor GetRGBAColorForScalar(const LabelType value) const;
 
     /** \brief Returns the number of voxels assigned to a given label.
      * \param[in] label label value.
      *
      */
-    unsigned long long int GetNumberOfVoxelsForLabel(unsigned short label);
+    unsigned long long int GetNumberOfVoxelsForLabel(LabelType label);
+
+    /** \brief Returns the runs of voxels of the given label, ordered by offset. The runs are read from
+     * the bounding box of the label the first time, after that only the rows modified since the last
+     * call are read again. For the background label returns the rows of its bounding box.
+     * \param[in] label label value.
+     *
+     */
+    std::vector<VoxelRun> GetLabelRuns(const LabelType label);
+
+    /** \brief Computes the exact statistics of the labels from the image, in parallel, and replaces
+     * the incremental ones. Returns the number of labels whose statistics were different.
+     *
+     */
+    const unsigned int VerifyStatistics();
 
     /** \brief Returns the bounding box minimum values for the givel label.
      * \param[in] label label value.
      *
      */
-    Vector3ui GetBoundingBoxMin(unsigned short label);
+    Vector3ui GetBoundingBoxMin(LabelType label);
 
     /** \brief Returns the bounding box maximum values for the givel label.
      * \param[in] label label value.
      *
      */
-    Vector3ui GetBoundingBoxMax(unsigned short label);
+    Vector3ui GetBoundingBoxMax(LabelType label);
 
     /** \brief Returns the number of labels used including the background label.
      *
@@ -306,7 +616,7 @@ class DataManager
     /** \brief Returns the set of selected labels.
      *
      */
-    const std::set<unsigned short> GetSelectedLabelsSet(void) const;
+    const std::set<LabelType> GetSelectedLabelsSet(void) const;
 
     /** \brief Returns the selected label set size.
      *
@@ -316,32 +626,36 @@ class DataManager
     /** \brief Returns true if the givel label is selected.
      *
      */
-    const bool IsColorSelected(unsigned short label) const;
+    const bool IsColorSelected(LabelType label) const;
 
-    struct ObjectInformation
-    {
-        unsigned short         scalar;   /** original scalar value in the image loaded */
-        Vector3d               centroid; /** centroid of the object */
-        unsigned long long int size;     /** size of the object in voxels */
-        Vector3ui              min;      /** Bounding Box: min values */
-        Vector3ui              max;      /** Bounding Box: max values */
-
-        ObjectInformation()
-        : scalar{0}, centroid{Vector3d{0, 0, 0}}, size{0}, min{Vector3ui{0, 0, 0}}, max{Vector3ui{0, 0, 0}} {};
-    };
+    using ObjectInformation = LabelTable::ObjectInformation;
+
+    /** \brief Colors of the lookuptable modified by an action, <label, rgba>.
+     *
+     */
+    using ColorChanges = std::map<LabelType, std::array<double, 4>>;
 
     /** \brief Returns the table of objects.
      *
      */
-    std::map<unsigned short, std::shared_ptr<DataManager::ObjectInformation>>* GetObjectTablePointer();
+    LabelTable* GetObjectTablePointer();
 
-    /** \brief Replaces the lookuptable with the given one.
-     * \param[inout] lookuptable color table to switch.
+    /** \brief Applies the colors changes of an undo/redo action to the lookuptable and selects the
+     * given labels. On return the parameters hold the changes that revert it.
+     * \param[in,out] values number of values of the lookuptable.
+     * \param[in,out] colors colors of the lookuptable.
+     * \param[in,out] labels group of selected labels.
      *
      */
-    void SwitchLookupTables(vtkSmartPointer<vtkLookupTable> lookuptable);
+    void SwitchLookupTables(unsigned int &values, ColorChanges &colors, std::set<LabelType> &labels);
 
-    /** \brief Signals the data as modified.
+    /** \brief Stores the voxels in 16 bits again if the labels of the table fit, used by the
+     * undo/redo system when the labels that needed wider voxels are removed.
+     *
+     */
+    void FitVoxelWidth();
+
+    /** \brief Signals the data as modified, with the region and labels modified since the last signal.
      *
      */
     void SignalDataAsModified();
@@ -353,7 +667,7 @@ class DataManager
     friend class EspinaVolumeEditor;
 
   signals:
-    void modified();
+    void modified(const DirtyRegion &region);
 
   private:
     /** \brief Helper method to reset the lookuptable to initial state based on original labelmap, used during init too
@@ -361,43 +675,197 @@ class DataManager
      */
     void GenerateLookupTable();
 
-    /** \brief Helper method to copy the values of one lookuptable to another, does not change pointers (important).
+    /** \brief Sets the color of a label in the lookuptable, storing the previous one in the undo/redo
+     * system if an action is in progress.
+     * \param[in] label label value.
+     * \param[in] r red component.
+     * \param[in] g green component.
+     * \param[in] b blue component.
+     * \param[in] a alpha component.
+     *
+     */
+    void SetTableValue(const LabelType label, const double r, const double g, const double b, const double a);
+
+    /** \brief Changes the number of values of the lookuptable keeping the existing ones, growing its
+     * capacity geometrically.
+     * \param[in] values number of values.
      *
      */
-    void CopyLookupTable(vtkSmartPointer<vtkLookupTable> from, vtkSmartPointer<vtkLookupTable> to) const;
+    void ResizeLookupTable(const unsigned int values);
 
-    /** \brief Updates the values of the action information vector.
+    /** \brief Fills the color registry with the colors of the lookuptable.
+     *
+     */
+    void RebuildColorRegistry();
+
+    /** \brief Updates the label table with the statistics of the last action.
      *
      */
     void StatisticsActionUpdate(void);
 
-    /** \brief Clears the action information vector.
+    /** \brief Computes the exact statistics of the labels from the image data and stores them in the
+     * label table. Returns the number of labels whose previous statistics were different.
+     * \param[in] report true to log the labels with different statistics.
+     *
+     */
+    const unsigned int UpdateStatistics(const bool report);
+
+    /** \brief Clears the statistics of the last action.
      *
      */
     void StatisticsActionClear(void);
 
-    itk::SmartPointer<LabelMapType>      m_labelMap;         /** original labelmap object.        */
-    vtkSmartPointer<vtkStructuredPoints> m_structuredPoints; /** image data object.               */
-    vtkSmartPointer<vtkLookupTable>      m_lookupTable;      /** color table.                     */
-    std::shared_ptr<Coordinates>         m_orientationData;  /** image orientation data.          */
-    std::shared_ptr<UndoRedoSystem>      m_actionsBuffer;    /** undo/redo system.                */
-    unsigned short                       m_firstFreeValue;   /** first free value for new labels. */
-    std::set<unsigned short>             m_selectedLabels;   /** set of selected labels.          */
+    struct WritePartial
+    {
+        ActionStatistics statistics; /** statistics of the modified voxels.         */
+        VoxelDeltas      changed;    /** modified voxels and their previous values. */
+    };
 
-    std::map<unsigned short, std::shared_ptr<ObjectInformation>> ObjectVector; /** object information vector. */
+    /** \brief Writes the value in a run of voxels of the same row, accumulating the statistics and
+     * the modified voxels and their previous values in the given partial. Helper of the bulk write methods,
+     * can be called concurrently for runs that don't overlap.
+     * \param[in] offset linear offset of the first voxel.
+     * \param[in] length number of voxels.
+     * \param[in] value new scalar value.
+     * \param[in] replaceable values that can be modified, indexed by value. All if empty.
+     * \param[inout] partial write results.
+     *
+     */
+    void WriteRun(const unsigned long long int offset, const unsigned int length, const LabelType value,
+                  const std::vector<bool> &replaceable, WritePartial &partial);
 
-    struct ActionInformation
-    {
-        long long int size;     /** size of the action in voxels.                                         */
-        Vector3ll     centroid; /** sum of the x,y,z coords of the points added/substraced in the action. */
-        Vector3ui     min;      /** Bounding Box: min values.                                             */
-        Vector3ui     max;      /** Bounding Box: max values.                                             */
+    /** \brief Returns a vector indexed by value with the given values marked, or an empty one if
+     * the set is empty.
+     * \param[in] labels set of values.
+     *
+     */
+    std::vector<bool> ReplaceableValues(const std::set<LabelType> &labels) const;
 
-        ActionInformation()
-        : size{0}, centroid{Vector3ll{0, 0, 0}}, min{Vector3ui{0, 0, 0}}, max{Vector3ui{0, 0, 0}} {};
-    };
+    /** \brief Returns the given number of empty partials for the bulk write methods.
+     * \param[in] count number of partials.
+     *
+     */
+    std::vector<WritePartial> WritePartials(const unsigned int count) const;
+
+    /** \brief Returns a writable pointer to the given voxel, allocating its brick if the image is
+     * stored in bricks. The brick is copied to the snapshots first.
+     * \param[in] point voxel coordinates.
+     *
+     */
+    LabelVoxels VoxelPointer(const Vector3ui &point);
+
+    /** \brief Replaces the scalars of the image with new uninitialized ones and returns them. With
+     * mapped storage they are kept in a memory mapped temporary file, in memory if the file couldn't
+     * be created or mapped.
+     * \param[in] voxels number of voxels of the image.
+     * \param[in] narrow true to store the voxels as NarrowLabelType and false as LabelType.
+     *
+     */
+    LabelVoxels SetScalars(const unsigned long long int voxels, const bool narrow);
+
+    /** \brief Converts the voxels to NarrowLabelType or to LabelType, needed when the labels no
+     * longer fit in 16 bits or fit again. The values must fit in the new type.
+     * \param[in] narrow true to store the voxels as NarrowLabelType and false as LabelType.
+     *
+     */
+    void SetVoxelWidth(const bool narrow);
+
+    /** \brief Copies the voxels of a region of the image to a buffer, x varying fastest.
+     * \param[in] min region minimum coordinates.
+     * \param[in] max region maximum coordinates.
+     * \param[out] buffer region voxels.
+     *
+     */
+    void CopyRegion(const Vector3ui &min, const Vector3ui &max, LabelType *buffer) const;
+
+    /** \brief Copies the bricks of a row of voxels to the snapshots that still read them from the
+     * image. Must be called before writing the voxels, can be called from several threads.
+     * \param[in] point coordinates of the first voxel.
+     * \param[in] length number of voxels.
+     *
+     */
+    void PreserveSnapshots(const Vector3ui &point, const unsigned int length);
+
+    /** \brief Makes the snapshots independent of the image, must be called before the image is released.
+     *
+     */
+    void DetachSnapshots();
+
+    /** \brief Releases the image data and closes the memory mapped file, if any.
+     *
+     */
+    void ReleaseMappedFile();
 
-    std::map<unsigned short, std::shared_ptr<ActionInformation>> ActionInformationVector; /** action information vector. */
+    /** \brief Releases the bricks that have become uniform after an operation, if the image is stored in bricks.
+     *
+     */
+    void CompactBricks();
+
+    /** \brief Computes the slab counts of the labels of the label table and the exact statistics of
+     * the labels from the image data. Clears the run index and resets the statistics of the current action.
+     *
+     */
+    void ComputeLabelIndices();
+
+    /** \brief Updates the run index and the dirty region with the given modified voxels and their
+     * previous values, all of them changed to the given value.
+     * \param[in] changed modified voxels and their previous values.
+     * \param[in] value new scalar value.
+     *
+     */
+    void TrackChanges(const VoxelDeltas &changed, const LabelType value);
+
+    /** \brief Marks the row as modified in the run index and updates the dirty region with a run of
+     * modified voxels of the same row that had the same value.
+     * \param[in] point coordinates of the first voxel.
+     * \param[in] length number of voxels.
+     * \param[in] previous previous value of the voxels.
+     * \param[in] value new value of the voxels.
+     *
+     */
+    void TrackChange(const Vector3ui &point, const unsigned int length, const LabelType previous, const LabelType value);
+
+    /** \brief Appends to the given vector the runs of voxels of the given label in the given region,
+     * ordered by offset.
+     * \param[in] label label value.
+     * \param[in] min region minimum coordinates.
+     * \param[in] max region maximum coordinates.
+     * \param[out] runs runs of the label.
+     *
+     */
+    void ReadLabelRuns(const LabelType label, const Vector3ui &min, const Vector3ui &max, std::vector<LabelRunIndex::Run> &runs) const;
+
+    /** \brief Merges the statistics of the given partials into the action statistics and stores the
+     * modified points in the undo/redo system, in the partials order. Helper of the bulk write methods.
+     * \param[in] partials write results.
+     * \param[in] value written scalar value.
+     *
+     */
+    void StorePartials(std::vector<WritePartial> &partials, const LabelType value);
+
+    vtkSmartPointer<vtkStructuredPoints> m_structuredPoints; /** image data object.               */
+    vtkSmartPointer<vtkLookupTable>      m_lookupTable;      /** color table.                     */
+    std::shared_ptr<Coordinates>         m_orientationData;  /** image orientation data.          */
+    std::shared_ptr<UndoRedoSystem>      m_actionsBuffer;    /** undo/redo system.                */
+    LabelType                            m_firstFreeValue;   /** first free value for new labels. */
+    std::set<LabelType>                  m_selectedLabels;   /** set of selected labels.          */
+
+    bool                                 m_brickedStorage;   /** true to store the image in bricks. */
+    std::unique_ptr<BrickedVolume>       m_bricks;           /** image bricks, if bricked storage. */
+    bool                                 m_mappedStorage;    /** true to map the image to a file.   */
+    std::unique_ptr<QTemporaryFile>      m_mappedFile;       /** image file, if mapped storage.     */
+    bool                                 m_narrowVoxels;     /** true if the voxels use 16 bits.    */
+
+    std::vector<std::weak_ptr<VolumeSnapshot>>   m_snapshots;       /** snapshots of the image.                                */
+    std::mutex                                   m_snapshotsMutex;  /** serializes the copy of bricks to the snapshots.         */
+    unsigned int                                 m_snapshotVersion; /** number of snapshots taken of the image.                 */
+    std::unique_ptr<std::atomic<unsigned int>[]> m_brickVersions;   /** snapshot version each brick has been copied to.        */
+
+    LabelTable       m_labelTable;       /** object information table.          */
+    ActionStatistics m_actionStatistics; /** statistics of the current action.   */
+    LabelRunIndex    m_runIndex;         /** voxel runs of each label.           */
+    DirtyRegion      m_dirty;            /** modifications since the last signal. */
+    ColorRegistry    m_colors;           /** colors of the lookuptable.           */
 };
 
 #endif // _DATAMANAGER_H_
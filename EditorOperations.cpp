@@ -8,11 +8,15 @@
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
 // c++ includes
-#include <ctime>
 #include <cstdlib>
 #include <cassert>
 #include <cstddef>
 #include <cstdio>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 // itk includes
 #include <itkSize.h>
@@ -30,13 +34,7 @@
 #include <itkLabelImageToLabelMapFilter.h>
 #include <itkVTKImageImport.h>
 #include <itkImageDuplicator.h>
-#include <itkImageRegionConstIteratorWithIndex.h>
 #include <itkCastImageFilter.h>
-#include <itkImageFileWriter.h>
-#include <itkMetaImageIO.h>
-#include <itkChangeInformationImageFilter.h>
-#include <itkChangeLabelLabelMapFilter.h>
-#include <itkLabelMapToLabelImageFilter.h>
 #include <itkConnectedThresholdImageFilter.h>
 
 // vtk includes
@@ -63,15 +61,17 @@
 #include "QtRelabel.h"
 #include "QtColorPicker.h"
 #include "itkvtkpipeline.h"
+#include "EqualValues.h"
+#include "MetaImageWriter.h"
+#include "TouchedVoxels.h"
 
 // qt includes
 #include <QMessageBox>
 #include <QFileDialog>
 #include <QObject>
 
-using LabelObjectType = itk::ShapeLabelObject<unsigned short, 3>;
+using LabelObjectType = itk::ShapeLabelObject<LabelType, 3>;
 using LabelMapType = itk::LabelMap<LabelObjectType>;
-using ConstIteratorType = itk::ImageRegionConstIteratorWithIndex<ImageType>;
 
 using StructuringElementType = itk::BinaryBallStructuringElement<ImageType::PixelType, 3>;
 using BinaryErodeImageFilterType = itk::ErodeObjectMorphologyImageFilter<ImageType, ImageType, StructuringElementType>;
@@ -84,10 +84,92 @@ using WatershedFilterType = itk::MorphologicalWatershedImageFilter<FloatImageTyp
 using DanielssonFilterType = itk::SignedDanielssonDistanceMapImageFilter<ImageType, FloatImageType>;
 using ConverterType = itk::LabelImageToLabelMapFilter<ImageType, LabelMapType>;
 
-using ChangeInfoType = itk::ChangeInformationImageFilter<ImageType>;
-using ChangeType = itk::ChangeLabelLabelMapFilter<LabelMapType>;
-using LabelMapToImageFilterType = itk::LabelMapToLabelImageFilter<LabelMapType, ImageType>;
-using WriterType = itk::ImageFileWriter<ImageType>;
+namespace
+{
+  /** \brief Run of voxels of an image row changed by a morphological filter.
+   *
+   */
+  struct MorphologyChange
+  {
+      DataManager::VoxelRun run;   /** changed voxels.           */
+      LabelType             value; /** new value of the voxels. */
+  };
+
+  /** \brief Input and result of the morphological filter of one label.
+   *
+   */
+  struct MorphologyTask
+  {
+      LabelType                              label;   /** object label.                                     */
+      itk::SmartPointer<ImageType>           image;   /** region of the volume filtered for the label.      */
+      unsigned long long int                 offset;  /** linear offset of the first voxel of the region.   */
+      std::vector<MorphologyChange>          changes; /** voxels changed by the filter, in row order.       */
+      std::shared_ptr<itk::ExceptionObject>  error;   /** error of the filter, null if it didn't fail.      */
+
+      explicit MorphologyTask(const LabelType taskLabel)
+      : label{taskLabel}, image{nullptr}, offset{0} {};
+  };
+
+  /** \brief Runs the given morphological filter with a ball of the given radius and returns its output.
+   * \param[in] filter morphological filter with its object or foreground value already set.
+   * \param[in] image input image.
+   * \param[in] radius structuring element radius.
+   * \param[in] threads number of threads of the filter.
+   *
+   */
+  template<class Filter> itk::SmartPointer<ImageType> RunMorphologyFilter(typename Filter::Pointer filter, itk::SmartPointer<ImageType> image,
+                                                                           const unsigned int radius, const unsigned int threads)
+  {
+    StructuringElementType structuringElement;
+    structuringElement.SetRadius(radius);
+    structuringElement.CreateStructuringElement();
+
+    filter->SetInput(image);
+    filter->SetKernel(structuringElement);
+    filter->SetNumberOfThreads(threads);
+    filter->Update();
+
+    return filter->GetOutput();
+  }
+
+  /** \brief Stores in the task the runs of voxels of the result that differ from the task image.
+   * \param[in] task morphological task.
+   * \param[in] result filtered image, with the same region as the task image.
+   * \param[in] dimX voxels of a row of the volume.
+   * \param[in] dimXY voxels of a slice of the volume.
+   *
+   */
+  void CollectChanges(MorphologyTask &task, itk::SmartPointer<ImageType> result, const unsigned long long int dimX, const unsigned long long int dimXY)
+  {
+    auto size   = task.image->GetLargestPossibleRegion().GetSize();
+    auto before = task.image->GetBufferPointer();
+    auto after  = result->GetBufferPointer();
+    unsigned int rowLength = size[0];
+
+    for (unsigned long long int z = 0; z < size[2]; ++z)
+    {
+      for (unsigned long long int y = 0; y < size[1]; ++y)
+      {
+        auto rowOffset = task.offset + y * dimX + z * dimXY;
+
+        unsigned int x = equalValues(after, before, rowLength);
+        while (x < rowLength)
+        {
+          auto begin = x;
+          auto value = after[x];
+          while ((x < rowLength) && (before[x] != after[x]) && (after[x] == value)) ++x;
+
+          task.changes.push_back(MorphologyChange{DataManager::VoxelRun(rowOffset + begin, x - begin), value});
+
+          x += equalValues(after + x, before + x, rowLength - x);
+        }
+
+        before += rowLength;
+        after  += rowLength;
+      }
+    }
+  }
+}
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // EditorOperations class
@@ -126,35 +208,15 @@ void EditorOperations::AddContourPoint(const Vector3ui &point, std::shared_ptr<S
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void EditorOperations::ItkImageToPoints(itk::SmartPointer<ImageType> image)
-{
-  // iterate over the itk image as fast as possible and just hope that the
-  // vtk image has the scallars allocated in the same axis order than the
-  // itk one
-  ConstIteratorType it(image, image->GetLargestPossibleRegion());
-
-  // copy itk image to structuredpoints
-  ImageType::IndexType index;
-  for (it.GoToBegin(); !it.IsAtEnd(); ++it)
-  {
-    index = it.GetIndex();
-    m_dataManager->SetVoxelScalar(Vector3ui{index[0], index[1], index[2]}, it.Get());
-  }
-  m_dataManager->SignalDataAsModified();
-
-  return;
-}
-
-///////////////////////////////////////////////////////////////////////////////////////////////////
-void EditorOperations::Cut(std::set<unsigned short> labels)
+void EditorOperations::Cut(std::set<LabelType> labels)
 {
   if (labels.empty()) return;
 
   m_progress->ManualSet("Cut");
   m_dataManager->OperationStart("Cut");
 
-  Vector3ui min;
-  Vector3ui max;
+  auto min = m_selection->minimumBouds();
+  auto max = m_selection->maximumBouds();
 
   switch (m_selection->type())
   {
@@ -162,67 +224,17 @@ void EditorOperations::Cut(std::set<unsigned short> labels)
     case Selection::Type::EMPTY:
       for (auto it: labels)
       {
-        min = m_dataManager->GetBoundingBoxMin(it);
-        max = m_dataManager->GetBoundingBoxMax(it);
-        for (unsigned int x = min[0]; x <= max[0]; x++)
-          for (unsigned int y = min[1]; y <= max[1]; y++)
-            for (unsigned int z = min[2]; z <= max[2]; z++)
-            {
-              Vector3ui point{x,y,z};
-              if (it == m_dataManager->GetVoxelScalar(point)) m_dataManager->SetVoxelScalar(point, 0);
-            }
+        m_dataManager->SetVoxelScalars(m_dataManager->GetLabelRuns(it), 0, std::set<LabelType>{it});
       }
       break;
     case Selection::Type::VOLUME:
-      min = m_selection->minimumBouds();
-      max = m_selection->maximumBouds();
-      for (unsigned int x = min[0]; x <= max[0]; x++)
-        for (unsigned int y = min[1]; y <= max[1]; y++)
-          for (unsigned int z = min[2]; z <= max[2]; z++)
-          {
-            Vector3ui point{x,y,z};
-            if (m_selection->isInsideSelection(point)) m_dataManager->SetVoxelScalar(point, 0);
-          }
+      m_dataManager->SetVoxelScalars(min, max, m_selection->selectionMask(min, max), 0);
       break;
     case Selection::Type::CONTOUR:
-      for (auto it: labels)
-      {
-        min = m_selection->minimumBouds();
-        max = m_selection->maximumBouds();
-        for (unsigned int x = min[0]; x <= max[0]; x++)
-        {
-          for (unsigned int y = min[1]; y <= max[1]; y++)
-          {
-            for (unsigned int z = min[2]; z <= max[2]; z++)
-            {
-              Vector3ui point{x,y,z};
-              if (m_selection->isInsideSelection(point))
-              {
-                Vector3ui point{x,y,z};
-                if (labels.find(m_dataManager->GetVoxelScalar(point)) != labels.end()) m_dataManager->SetVoxelScalar(point, 0);
-              }
-            }
-          }
-        }
-      }
+      m_dataManager->SetVoxelScalars(min, max, m_selection->selectionMask(min, max), 0, labels);
       break;
     case Selection::Type::CUBE:
-      for (auto it: labels)
-      {
-        min = m_selection->minimumBouds();
-        max = m_selection->maximumBouds();
-        for (unsigned int x = min[0]; x <= max[0]; x++)
-        {
-          for (unsigned int y = min[1]; y <= max[1]; y++)
-          {
-            for (unsigned int z = min[2]; z <= max[2]; z++)
-            {
-              Vector3ui point{x,y,z};
-              if (labels.find(m_dataManager->GetVoxelScalar(point)) != labels.end()) m_dataManager->SetVoxelScalar(point, 0);
-            }
-          }
-        }
-      }
+      m_dataManager->SetVoxelScalars(min, max, std::vector<unsigned char>(), 0, labels);
       break;
     default:
       break;
@@ -235,7 +247,7 @@ void EditorOperations::Cut(std::set<unsigned short> labels)
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-bool EditorOperations::Relabel(QWidget *parent, std::shared_ptr<Metadata> data, std::set<unsigned short> *labels, bool *isANewColor)
+bool EditorOperations::Relabel(QWidget *parent, std::shared_ptr<Metadata> data, std::set<LabelType> *labels, bool *isANewColor)
 {
   QtRelabel configdialog(parent);
   configdialog.setInitialOptions(*labels, data, m_dataManager);
@@ -245,7 +257,7 @@ bool EditorOperations::Relabel(QWidget *parent, std::shared_ptr<Metadata> data,
 
   m_dataManager->OperationStart("Relabel");
 
-  unsigned short newlabel;
+  LabelType newlabel;
 
   if (!configdialog.isNewLabel())
   {
@@ -262,88 +274,42 @@ bool EditorOperations::Relabel(QWidget *parent, std::shared_ptr<Metadata> data,
     auto color = colorpicker.GetColor();
 
     newlabel = m_dataManager->SetLabel(color);
+    if (0 == newlabel)
+    {
+      itk::ExceptionObject excp(__FILE__, __LINE__, "There are no free label values left for a new label.", ITK_LOCATION);
+      EditorError(excp);
+      return false;
+    }
+
     *isANewColor = true;
   }
 
   m_progress->ManualSet("Relabel");
 
-  Vector3ui min;
-  Vector3ui max;
+  auto min = m_selection->minimumBouds();
+  auto max = m_selection->maximumBouds();
 
   switch (m_selection->type())
   {
     case Selection::Type::DISC:
     case Selection::Type::EMPTY:
-    {
       for (auto it: *labels)
       {
-        min = m_dataManager->GetBoundingBoxMin(it);
-        max = m_dataManager->GetBoundingBoxMax(it);
-        for (unsigned int x = min[0]; x <= max[0]; x++)
-        {
-          for (unsigned int y = min[1]; y <= max[1]; y++)
-          {
-            for (unsigned int z = min[2]; z <= max[2]; z++)
-            {
-              Vector3ui point{x,y,z};
-              if (it == m_dataManager->GetVoxelScalar(point)) m_dataManager->SetVoxelScalar(point, newlabel);
-            }
-          }
-        }
+        m_dataManager->SetVoxelScalars(m_dataManager->GetLabelRuns(it), newlabel, std::set<LabelType>{it});
       }
-    }
       break;
     case Selection::Type::VOLUME:
-      min = m_selection->minimumBouds();
-      max = m_selection->maximumBouds();
-      for (unsigned int x = min[0]; x <= max[0]; x++)
-      {
-        for (unsigned int y = min[1]; y <= max[1]; y++)
-        {
-          for (unsigned int z = min[2]; z <= max[2]; z++)
-          {
-            Vector3ui point{x,y,z};
-            if (m_selection->isInsideSelection(point)) m_dataManager->SetVoxelScalar(point, newlabel);
-          }
-        }
-      }
+      m_dataManager->SetVoxelScalars(min, max, m_selection->selectionMask(min, max), newlabel);
       break;
     case Selection::Type::CONTOUR:
       if (labels->empty()) labels->insert(0);
 
-      min = m_selection->minimumBouds();
-      max = m_selection->maximumBouds();
-      for (unsigned int x = min[0]; x <= max[0]; x++)
-      {
-        for (unsigned int y = min[1]; y <= max[1]; y++)
-        {
-          for (unsigned int z = min[2]; z <= max[2]; z++)
-          {
-            Vector3ui point{x,y,z};
-            if (m_selection->isInsideSelection(point))
-            {
-              if (labels->find(m_dataManager->GetVoxelScalar(point)) != labels->end()) m_dataManager->SetVoxelScalar(point, newlabel);
-            }
-          }
-        }
-      }
+      m_dataManager->SetVoxelScalars(min, max, m_selection->selectionMask(min, max), newlabel, *labels);
       break;
     case Selection::Type::CUBE:
       if (labels->empty()) labels->insert(0);
 
-      min = m_selection->minimumBouds();
-      max = m_selection->maximumBouds();
-      for (unsigned int x = min[0]; x <= max[0]; x++)
-      {
-        for (unsigned int y = min[1]; y <= max[1]; y++)
-        {
-          for (unsigned int z = min[2]; z <= max[2]; z++)
-          {
-            Vector3ui point{x,y,z};
-            if (labels->find(m_dataManager->GetVoxelScalar(point)) != labels->end()) m_dataManager->SetVoxelScalar(point, newlabel);
-          }
-        }
-      }
+      m_dataManager->SetVoxelScalars(min, max, std::vector<unsigned char>(), newlabel, *labels);
       break;
     default:
       break;
@@ -358,176 +324,197 @@ bool EditorOperations::Relabel(QWidget *parent, std::shared_ptr<Metadata> data,
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void EditorOperations::Erode(const unsigned short label)
+void EditorOperations::Erode(const std::set<LabelType> &labels)
 {
-  if (0 == label) return;
-
-  m_dataManager->OperationStart("Erode");
-
-  auto erodeFilter = BinaryErodeImageFilterType::New();
-
-  m_progress->Observe(erodeFilter, "Erode", 1.0);
-
-  auto image = ImageType::New();
-  image = m_selection->itkImage(label, m_radius);
-
-  // BEWARE: radius on erode is _filtersRadius-1 because erode seems to be too strong. it seems to work fine with that value.
-  //		   the less it can be is 0 as _filterRadius >= 1 always. It erodes the volume with a value of 0, although using 0
-  //         with dilate produces no dilate effect.
-  StructuringElementType structuringElement;
-  structuringElement.SetRadius(m_radius - 1);
-  structuringElement.CreateStructuringElement();
-
-  erodeFilter->SetInput(image);
-  erodeFilter->SetKernel(structuringElement);
-  erodeFilter->SetObjectValue(label);
-  erodeFilter->ReleaseDataFlagOn();
+  ApplyMorphology(Morphology::ERODE, labels);
+}
 
-  try
-  {
-    erodeFilter->Update();
-  }
-  catch (itk::ExceptionObject & excp)
-  {
-    m_progress->Ignore(erodeFilter);
-    EditorError(excp);
-    return;
-  }
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void EditorOperations::Dilate(const std::set<LabelType> &labels)
+{
+  ApplyMorphology(Morphology::DILATE, labels);
+}
 
-  ItkImageToPoints(erodeFilter->GetOutput());
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void EditorOperations::Open(const std::set<LabelType> &labels)
+{
+  ApplyMorphology(Morphology::OPEN, labels);
+}
 
-  m_progress->Ignore(erodeFilter);
-  m_progress->Reset();
-  m_dataManager->OperationEnd();
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void EditorOperations::Close(const std::set<LabelType> &labels)
+{
+  ApplyMorphology(Morphology::CLOSE, labels);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void EditorOperations::Dilate(const unsigned short label)
+void EditorOperations::ApplyMorphology(const Morphology operation, const std::set<LabelType> &labels)
 {
-  if (0 == label) return;
+  std::vector<MorphologyTask> tasks;
+  for (auto label: labels)
+  {
+    if (0 != label) tasks.emplace_back(label);
+  }
 
-  m_dataManager->OperationStart("Dilate");
+  if (tasks.empty()) return;
 
-  auto dilateFilter = BinaryDilateImageFilterType::New();
+  const std::string names[] = { "Erode", "Dilate", "Open", "Close" };
+  auto name = names[static_cast<int>(operation)];
 
-  m_progress->Observe(dilateFilter, "Dilate", 1.0);
+  m_progress->ManualSet(name);
+  m_dataManager->OperationStart(name);
 
-  itk::SmartPointer<ImageType> image = ImageType::New();
-  image = m_selection->itkImage(label, m_radius);
+  auto size = m_orientation->GetTransformedSize();
+  unsigned long long int dimX = size[0];
+  unsigned long long int dimXY = dimX * size[1];
 
-  StructuringElementType structuringElement;
-  structuringElement.SetRadius(m_radius);
-  structuringElement.CreateStructuringElement();
+  // each thread takes the next label until there are none left, the cores are split between the filters.
+  auto cores = std::max(1u, std::thread::hardware_concurrency());
+  auto workers = std::min(cores, static_cast<unsigned int>(tasks.size()));
+  auto filterThreads = std::max(1u, cores / workers);
 
-  dilateFilter->SetInput(image);
-  dilateFilter->SetKernel(structuringElement);
-  dilateFilter->SetObjectValue(label);
-  dilateFilter->ReleaseDataFlagOn();
+  std::atomic<unsigned int> next{0};
+  std::atomic<unsigned int> finished{0};
+  std::mutex readMutex;
 
-  try
-  {
-    dilateFilter->Update();
-  }
-  catch (itk::ExceptionObject & excp)
+  auto worker = [&](const bool mainThread)
   {
-    m_progress->Ignore(dilateFilter);
-    EditorError(excp);
-    return;
-  }
+    for (unsigned int i = next++; i < tasks.size(); i = next++)
+    {
+      auto &task = tasks[i];
 
-  ItkImageToPoints(dilateFilter->GetOutput());
+      // each worker reads the region when it takes the label so there is only one region per worker in
+      // memory. The volume isn't modified until all the workers end, the reads only need to be serialized.
+      {
+        std::lock_guard<std::mutex> lock(readMutex);
+        task.image = m_selection->itkImage(task.label, m_radius);
+        if (task.image != nullptr)
+        {
+          auto index = task.image->GetLargestPossibleRegion().GetIndex();
+          task.offset = m_dataManager->GetVoxelOffset(Vector3ui(index[0], index[1], index[2]));
+        }
+      }
 
-  m_progress->Ignore(dilateFilter);
-  m_progress->Reset();
-  m_dataManager->OperationEnd();
-}
+      if (task.image != nullptr)
+      {
+        try
+        {
+          itk::SmartPointer<ImageType> result = nullptr;
 
-///////////////////////////////////////////////////////////////////////////////////////////////////
-void EditorOperations::Open(const unsigned short label)
-{
-  if (0 == label) return;
+          switch (operation)
+          {
+            case Morphology::ERODE:
+              {
+                auto filter = BinaryErodeImageFilterType::New();
+                filter->SetObjectValue(task.label);
+                // BEWARE: radius on erode is _filtersRadius-1 because erode seems to be too strong. it seems to work fine with that value.
+                //		   the less it can be is 0 as _filterRadius >= 1 always. It erodes the volume with a value of 0, although using 0
+                //         with dilate produces no dilate effect.
+                result = RunMorphologyFilter<BinaryErodeImageFilterType>(filter, task.image, m_radius - 1, filterThreads);
+              }
+              break;
+            case Morphology::DILATE:
+              {
+                auto filter = BinaryDilateImageFilterType::New();
+                filter->SetObjectValue(task.label);
+                result = RunMorphologyFilter<BinaryDilateImageFilterType>(filter, task.image, m_radius, filterThreads);
+              }
+              break;
+            case Morphology::OPEN:
+              {
+                auto filter = BinaryOpenImageFilterType::New();
+                filter->SetForegroundValue(task.label);
+                result = RunMorphologyFilter<BinaryOpenImageFilterType>(filter, task.image, m_radius, filterThreads);
+              }
+              break;
+            case Morphology::CLOSE:
+              {
+                auto filter = BinaryCloseImageFilterType::New();
+                filter->SetForegroundValue(task.label);
+                result = RunMorphologyFilter<BinaryCloseImageFilterType>(filter, task.image, m_radius, filterThreads);
+              }
+              break;
+          }
 
-  m_dataManager->OperationStart("Open");
+          CollectChanges(task, result, dimX, dimXY);
+        }
+        catch (itk::ExceptionObject &excp)
+        {
+          task.error = std::make_shared<itk::ExceptionObject>(excp);
+        }
 
-  auto openFilter = BinaryOpenImageFilterType::New();
+        task.image = nullptr;
+      }
 
-  m_progress->Observe(openFilter, "Open", 1.0);
+      ++finished;
 
-  itk::SmartPointer<ImageType> image = ImageType::New();
-  image = m_selection->itkImage(label, m_radius);
+      // the progress bar can only be updated from the main thread, the events processed by the update
+      // can use the data manager so no region is read meanwhile.
+      if (mainThread)
+      {
+        std::lock_guard<std::mutex> lock(readMutex);
+        m_progress->ManualUpdate((100 * finished) / tasks.size());
+      }
+    }
+  };
 
-  StructuringElementType structuringElement;
-  structuringElement.SetRadius(m_radius);
-  structuringElement.CreateStructuringElement();
+  std::vector<std::thread> threads;
+  for (unsigned int i = 1; i < workers; ++i)
+  {
+    threads.emplace_back(worker, false);
+  }
 
-  openFilter->SetInput(image);
-  openFilter->SetKernel(structuringElement);
-  openFilter->SetForegroundValue(label);
-  openFilter->ReleaseDataFlagOn();
+  worker(true);
 
-  try
+  for (auto &thread: threads)
   {
-    openFilter->Update();
+    thread.join();
   }
-  catch (itk::ExceptionObject & excp)
+
+  for (auto &task: tasks)
   {
-    m_progress->Ignore(openFilter);
-    EditorError(excp);
-    return;
+    if (task.error)
+    {
+      m_progress->ManualReset();
+      EditorError(*task.error);
+      return;
+    }
   }
 
-  ItkImageToPoints(openFilter->GetOutput());
-
-  m_progress->Ignore(openFilter);
-  m_progress->Reset();
-  m_dataManager->OperationEnd();
-}
-
-///////////////////////////////////////////////////////////////////////////////////////////////////
-void EditorOperations::Close(const unsigned short label)
-{
-  if (0 == label) return;
-
-  m_dataManager->OperationStart("Close");
-
-  auto closeFilter = BinaryCloseImageFilterType::New();
-
-  m_progress->Observe(closeFilter, "Close", 1.0);
-
-  itk::SmartPointer<ImageType> image = ImageType::New();
-  image = m_selection->itkImage(label, m_radius);
-
-  StructuringElementType structuringElement;
-  structuringElement.SetRadius(m_radius);
-  structuringElement.CreateStructuringElement();
-
-  closeFilter->SetInput(image);
-  closeFilter->SetKernel(structuringElement);
-  closeFilter->SetForegroundValue(label);
-  closeFilter->ReleaseDataFlagOn();
-
-  try
+  // the changes were computed against the volume before the operation, so a voxel changed by
+  // several labels keeps the value of the lowest one, whatever the order the threads finished.
+  TouchedVoxels claimed;
+  std::map<LabelType, std::vector<DataManager::VoxelRun>> runs;
+  for (auto &task: tasks)
   {
-    closeFilter->Update();
+    for (auto &change: task.changes)
+    {
+      unsigned int begin = 0;
+      for (unsigned int i = 0; i <= change.run.length; ++i)
+      {
+        if ((i < change.run.length) && claimed.insert(change.run.offset + i)) continue;
+
+        if (i > begin) runs[change.value].emplace_back(change.run.offset + begin, i - begin);
+        begin = i + 1;
+      }
+    }
   }
-  catch (itk::ExceptionObject & excp)
+
+  for (auto &it: runs)
   {
-    m_progress->Ignore(closeFilter);
-    EditorError(excp);
-    return;
+    m_dataManager->SetVoxelScalars(it.second, it.first);
   }
 
-  ItkImageToPoints(closeFilter->GetOutput());
+  m_dataManager->SignalDataAsModified();
 
-  m_progress->Ignore(closeFilter);
-  m_progress->Reset();
+  m_progress->ManualReset();
   m_dataManager->OperationEnd();
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-std::set<unsigned short> EditorOperations::Watershed(const unsigned short label)
+std::set<LabelType> EditorOperations::Watershed(const LabelType label)
 {
-  std::set<unsigned short> createdLabels;
+  std::set<LabelType> createdLabels;
   if (0 == label) return createdLabels;
 
   m_dataManager->OperationStart("Watershed");
@@ -603,39 +590,35 @@ std::set<unsigned short> EditorOperations::Watershed(const unsigned short label)
   auto outputLabelMap = converter->GetOutput();
   outputLabelMap->Optimize();
 
-  std::srand(static_cast<unsigned int>(std::time(nullptr)));
+  // all the labels are created at once, with new colors different from the ones in use.
+  auto newLabels = m_dataManager->CreateLabels(m_dataManager->GetDistinctColors(outputLabelMap->GetNumberOfLabelObjects()));
+  if (newLabels.size() < outputLabelMap->GetNumberOfLabelObjects())
+  {
+    // cancelling the operation removes the labels that could be created.
+    itk::ExceptionObject excp(__FILE__, __LINE__, "There are no free label values left for all the objects of the watershed.", ITK_LOCATION);
+    EditorError(excp);
+    return createdLabels;
+  }
+  createdLabels.insert(newLabels.cbegin(), newLabels.cend());
+
   for (int i = 0; i < outputLabelMap->GetNumberOfLabelObjects(); ++i)
   {
     auto labelObject = outputLabelMap->GetNthLabelObject(i);
+    auto newlabel = newLabels[i];
 
-    unsigned short newlabel = 0;
-    bool found = false;
-
-    // create a random color and make sure it's a new one (very small probability but we have to check anyways...)
-    while (found == false)
-    {
-      auto color = QColor::fromRgbF(((double) rand() / (double) RAND_MAX), ((double) rand() / (double) RAND_MAX), ((double) rand() / (double) RAND_MAX));
-
-      if (false == m_dataManager->ColorIsInUse(color))
-      {
-        newlabel = m_dataManager->SetLabel(color);
-        createdLabels.insert(newlabel);
-        found = true;
-      }
-    }
+    std::vector<DataManager::VoxelRun> runs;
+    runs.reserve(labelObject->GetNumberOfLines());
 
     for (int j = 0; j < labelObject->GetNumberOfLines(); ++j)
     {
       auto line = labelObject->GetLine(j);
       auto firstIdx = line.GetIndex();
-      auto length = line.GetLength();
-      auto endIdx0 = firstIdx[0] + length;
-      for (LabelMapType::IndexType idx = firstIdx; idx[0] < endIdx0; idx[0]++)
-      {
-        assert((idx[0] >= 0) && (idx[1] >= 0) && (idx[2] >= 0));
-        m_dataManager->SetVoxelScalar(Vector3ui{idx[0], idx[1], idx[2]}, newlabel);
-      }
+      assert((firstIdx[0] >= 0) && (firstIdx[1] >= 0) && (firstIdx[2] >= 0));
+
+      runs.push_back(DataManager::VoxelRun{m_dataManager->GetVoxelOffset(Vector3ui{firstIdx[0], firstIdx[1], firstIdx[2]}), static_cast<unsigned int>(line.GetLength())});
     }
+
+    m_dataManager->SetVoxelScalars(runs, newlabel);
   }
   m_dataManager->SignalDataAsModified();
 
@@ -645,24 +628,33 @@ std::set<unsigned short> EditorOperations::Watershed(const unsigned short label)
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void EditorOperations::CleanImage(itk::SmartPointer<ImageType> image, const unsigned short label) const
+void EditorOperations::CleanImage(itk::SmartPointer<ImageType> image, const LabelType label) const
 {
-  ConstIteratorType it(image, image->GetLargestPossibleRegion());
+  auto region = image->GetLargestPossibleRegion();
+  auto index  = region.GetIndex();
+  auto size   = region.GetSize();
+  auto buffer = image->GetBufferPointer();
+
+  // the voxels to erase are the ones of the background if label is 0, or of other labels otherwise.
+  auto erase = [label](const LabelType value) { return (0 == label) ? (0 == value) : (value != label); };
 
-  ImageType::IndexType index;
-  for (it.GoToBegin(); !it.IsAtEnd(); ++it)
+  // image index is the voxel coordinates, uniform bricks are erased or kept as a whole.
+  auto min = Vector3ui(index[0], index[1], index[2]);
+  auto max = Vector3ui(index[0] + size[0] - 1, index[1] + size[1] - 1, index[2] + size[2] - 1);
+  for (auto &brick: m_dataManager->GetBricks(min, max))
   {
-    index = it.GetIndex();
-    unsigned short pointScalar = m_dataManager->GetVoxelScalar(Vector3ui{index[0], index[1], index[2]});
+    if (brick.uniform && !erase(brick.value)) continue;
 
-    switch (label)
+    for (auto z = brick.min[2]; z <= brick.max[2]; ++z)
     {
-      case 0:
-        if (0 == pointScalar) image->SetPixel(index, 0);
-        break;
-      default:
-        if (pointScalar != label) image->SetPixel(index, 0);
-        break;
+      for (auto y = brick.min[1]; y <= brick.max[1]; ++y)
+      {
+        auto pixel = buffer + (brick.min[0] - min[0]) + (y - min[1]) * size[0] + (z - min[2]) * size[0] * size[1];
+        for (auto x = brick.min[0]; x <= brick.max[0]; ++x, ++pixel)
+        {
+          if (brick.uniform || erase(brick.voxel(x, y, z))) *pixel = 0;
+        }
+      }
     }
   }
 }
@@ -691,36 +683,13 @@ void EditorOperations::SaveImage(const std::string &filename) const
 {
   m_progress->ManualSet("Save Image");
 
-  auto image = ImageType::New();
-  image = m_selection->itkImage();
-
-  // must restore the image origin before writing
-  auto point = m_orientation->GetImageOrigin();
-
-  auto infoChanger = ChangeInfoType::New();
-  infoChanger->SetInput(image);
-  infoChanger->ChangeOriginOn();
-  infoChanger->ReleaseDataFlagOn();
-
-  ImageType::PointType newOrigin;
-  newOrigin[0] = point[0];
-  newOrigin[1] = point[1];
-  newOrigin[2] = point[2];
-  infoChanger->SetOutputOrigin(newOrigin);
-  m_progress->Observe(infoChanger, "Fix Image", 0.2);
-  infoChanger->Update();
-  m_progress->Ignore(infoChanger);
-
-  // convert to labelmap and restore original scalars for labels
-  auto converter = ConverterType::New();
-  converter->SetInput(infoChanger->GetOutput());
-  converter->ReleaseDataFlagOn();
-  m_progress->Observe(converter, "Label Map", 0.2);
-  converter->Update();
-  m_progress->Ignore(converter);
-  converter->GetOutput()->Optimize();
+  auto empty = true;
+  for (LabelType i = 1; empty && (i < m_dataManager->GetNumberOfLabels()); ++i)
+  {
+    empty = (0 == m_dataManager->GetNumberOfVoxelsForLabel(i));
+  }
 
-  if (0 == converter->GetOutput()->GetNumberOfLabelObjects())
+  if (empty)
   {
     QMessageBox msgBox;
     msgBox.setWindowTitle("Error trying to save image");
@@ -731,58 +700,33 @@ void EditorOperations::SaveImage(const std::string &filename) const
     return;
   }
 
-  auto labelChanger = ChangeType::New();
-  labelChanger->SetInput(converter->GetOutput());
-  labelChanger->ReleaseDataFlagOn();
-
-  if (labelChanger->CanRunInPlace() == true)
-  {
-    labelChanger->SetInPlace(true);
-  }
+  // the image is written slab by slab with the original scalars of the labels and origin.
+  auto image = m_dataManager->GetStructuredPoints();
+  int extent[6];
+  image->GetExtent(extent);
+  auto spacing = image->GetSpacing();
+  auto offset = Vector3ui(extent[0], extent[2], extent[4]);
 
-  for (unsigned short i = 1; i < m_dataManager->GetNumberOfLabels(); i++)
+  auto source = [this, offset](const Vector3ui &min, const Vector3ui &max, LabelType *buffer)
   {
-    labelChanger->SetChange(i, m_dataManager->GetScalarForLabel(i));
-  }
-
-  m_progress->Observe(labelChanger, "Fix Labels", 0.2);
-  labelChanger->Update();
-  m_progress->Ignore(labelChanger);
-
-  auto labelConverter = LabelMapToImageFilterType::New();
-  labelConverter->SetInput(labelChanger->GetOutput());
-  labelConverter->SetNumberOfThreads(1);
-  labelConverter->ReleaseDataFlagOn();
+    m_dataManager->GetRegionScalars(min + offset, max + offset, buffer);
+  };
 
-  m_progress->Observe(labelConverter, "Convert Image", 0.2);
-  labelConverter->Update();
-  m_progress->Ignore(labelConverter);
+  MetaImageWriter writer(Vector3ui(extent[1] - extent[0] + 1, extent[3] - extent[2] + 1, extent[5] - extent[4] + 1),
+                         Vector3d(spacing[0], spacing[1], spacing[2]), m_orientation->GetImageOrigin(), source);
 
   // save as an mha and rename
   auto tempfilename = filename + std::string(".mha");
-  auto io = itk::MetaImageIO::New();
-  io->SetFileName(tempfilename.c_str());
-  auto writer = WriterType::New();
-  writer->SetImageIO(io);
-  writer->SetFileName(tempfilename.c_str());
-  writer->SetInput(labelConverter->GetOutput());
-  writer->UseCompressionOn();
-  m_progress->Observe(writer, "Write", 0.2);
-
-  try
-  {
-    writer->Write();
-  }
-  catch (itk::ExceptionObject &excp)
+  if (!writer.write(QString::fromStdString(tempfilename), [this](const int value) { m_progress->ManualUpdate(value); }))
   {
     QMessageBox msgBox;
     msgBox.setWindowTitle("Error trying to save image");
     msgBox.setIcon(QMessageBox::Critical);
     auto text = std::string("An error occurred saving the segmentation file.\nThe operation has been aborted.");
     msgBox.setText(text.c_str());
-    msgBox.setDetailedText(excp.what());
+    msgBox.setDetailedText(writer.errorString());
     msgBox.exec();
-    m_progress->Ignore(writer);
+    remove(tempfilename.c_str());
     m_progress->ManualReset();
     return;
   }
@@ -809,7 +753,6 @@ void EditorOperations::SaveImage(const std::string &filename) const
     }
   }
 
-  m_progress->Ignore(writer);
   m_progress->ManualReset();
 }
 
@@ -842,7 +785,7 @@ itk::SmartPointer<LabelMapType> EditorOperations::GetImageLabelMap() const
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void EditorOperations::SetFirstFreeValue(const unsigned short value)
+void EditorOperations::SetFirstFreeValue(const LabelType value)
 {
   m_dataManager->SetFirstFreeValue(value);
 }
@@ -935,50 +878,29 @@ void EditorOperations::UpdateContourSlice(const Vector3ui &point)
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void EditorOperations::Paint(const unsigned short label)
+void EditorOperations::Paint(const LabelType label)
 {
   if (Selection::Type::DISC == m_selection->type())
   {
-    Vector3ui min = m_selection->minimumBouds();
-    Vector3ui max = m_selection->maximumBouds();
-    for (unsigned int x = min[0]; x <= max[0]; x++)
-    {
-      for (unsigned int y = min[1]; y <= max[1]; y++)
-      {
-        for (unsigned int z = min[2]; z <= max[2]; z++)
-        {
-          Vector3ui point{x,y,z};
-          if (m_selection->isInsideSelection(point)) m_dataManager->SetVoxelScalar(point, label);
-        }
-      }
-    }
+    auto min = m_selection->minimumBouds();
+    auto max = m_selection->maximumBouds();
 
+    m_dataManager->SetVoxelScalars(min, max, m_selection->selectionMask(min, max), label);
     m_dataManager->SignalDataAsModified();
   }
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void EditorOperations::Erase(const std::set<unsigned short> labels)
+void EditorOperations::Erase(const std::set<LabelType> labels)
 {
+  if (labels.empty()) return;
+
   if (Selection::Type::DISC == m_selection->type())
   {
-    Vector3ui min = m_selection->minimumBouds();
-    Vector3ui max = m_selection->maximumBouds();
-    for (unsigned int x = min[0]; x <= max[0]; x++)
-    {
-      for (unsigned int y = min[1]; y <= max[1]; y++)
-      {
-        for (unsigned int z = min[2]; z <= max[2]; z++)
-        {
-          Vector3ui point{x,y,z};
-          if (m_selection->isInsideSelection(point))
-          {
-            if (labels.find(m_dataManager->GetVoxelScalar(point)) != labels.end()) m_dataManager->SetVoxelScalar(point, 0);
-          }
-        }
-      }
-    }
+    auto min = m_selection->minimumBouds();
+    auto max = m_selection->maximumBouds();
 
+    m_dataManager->SetVoxelScalars(min, max, m_selection->selectionMask(min, max), 0, labels);
     m_dataManager->SignalDataAsModified();
   }
 }
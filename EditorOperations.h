@@ -34,7 +34,7 @@
 // forward declarations
 class SliceVisualization;
 
-using ImageType = itk::Image<unsigned short, 3>;
+using ImageType = itk::Image<LabelType, 3>;
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // EditorOperations class
@@ -65,7 +65,7 @@ class EditorOperations
      * \param[in] labelsGroup selected objects labels.
      *
      */
-    void Cut(std::set<unsigned short> labelsGroup);
+    void Cut(std::set<LabelType> labelsGroup);
 
     /** \brief Changes label of selected voxels to a different one
      * \param[in] parent QWidget parent pointer.
@@ -74,9 +74,10 @@ class EditorOperations
      * \param[out] newColor true if is a new label and false otherwise.
      *
      */
-    bool Relabel(QWidget *parent, std::shared_ptr<Metadata> metadata, std::set<unsigned short> *labelsGroup, bool *newColor);
+    bool Relabel(QWidget *parent, std::shared_ptr<Metadata> metadata, std::set<LabelType> *labelsGroup, bool *newColor);
 
-    /** \brief Saves the volume to disk in MHD format.
+    /** \brief Saves the volume to disk in MHD format. The volume is written slab by slab, without
+     * a copy of the whole image.
      * \param[in] filename file name.
      *
      */
@@ -86,13 +87,13 @@ class EditorOperations
      * \param[in] label label to chenge the voxels to.
      *
      */
-    void Paint(const unsigned short label);
+    void Paint(const LabelType label);
 
     /** \brief Erases the voxels in the current selection of the given labels.
      * \param[in] labelsGroup labels of the voxels to erase.
      *
      */
-    void Erase(const std::set<unsigned short> labelsGroup);
+    void Erase(const std::set<LabelType> labelsGroup);
 
     /** \brief Returns the labelmap representation of the volume.
      *
@@ -102,7 +103,7 @@ class EditorOperations
     /** \brief Sets the first scalar value that is free to assign a label (it's NOT the label number).
      * \param[in] value scalar value.
      */
-    void SetFirstFreeValue(const unsigned short value);
+    void SetFirstFreeValue(const LabelType value);
 
     /** \brief Returns the radius used in the morphological operations.
      *
@@ -125,40 +126,40 @@ class EditorOperations
      */
     void SetWatershedLevel(const double levelValue);
 
-    /** \brief Applies an erode filter in the selected area for the voxels of the given label.
-     * If there is not a selection the filter operates on all the voxels of the given label in the image.
-     * \param[in] label object label.
+    /** \brief Applies an erode filter in the selected area for the voxels of each of the given labels,
+     * as one undo/redo action. If there is not a selection the filter operates on all the voxels of each label.
+     * \param[in] labels object labels.
      *
      */
-    void Erode(const unsigned short label);
+    void Erode(const std::set<LabelType> &labels);
 
-    /** \brief Applies a dilate filter in the selected area for the voxels of the given label.
-     * If there is not a selection the filter operates on all the voxels of the given label in the image.
-     * \param[in] label object label.
+    /** \brief Applies a dilate filter in the selected area for the voxels of each of the given labels,
+     * as one undo/redo action. If there is not a selection the filter operates on all the voxels of each label.
+     * \param[in] labels object labels.
      *
      */
-    void Dilate(const unsigned short label);
+    void Dilate(const std::set<LabelType> &labels);
 
-    /** \brief Applies a close filter in the selected area for the voxels of the given label.
-     * If there is not a selection the filter operates on all the voxels of the given label in the image.
-     * \param[in] label object label.
+    /** \brief Applies a close filter in the selected area for the voxels of each of the given labels,
+     * as one undo/redo action. If there is not a selection the filter operates on all the voxels of each label.
+     * \param[in] labels object labels.
      *
      */
-    void Close(const unsigned short label);
+    void Close(const std::set<LabelType> &labels);
 
-    /** \brief Applies an open filter in the selected area for the voxels of the given label.
-     * If there is not a selection the filter operates on all the voxels of the given label in the image.
-     * \param[in] label object label.
+    /** \brief Applies an open filter in the selected area for the voxels of each of the given labels,
+     * as one undo/redo action. If there is not a selection the filter operates on all the voxels of each label.
+     * \param[in] labels object labels.
      *
      */
-    void Open(const unsigned short label);
+    void Open(const std::set<LabelType> &labels);
 
     /** \brief Applies a watershed filter in the selected area for the voxels of the given label.
      * If there is not a selection the filter operates on all the voxels of the given label in the image.
      * \param[in] label object label.
      *
      */
-    std::set<unsigned short> Watershed(const unsigned short label);
+    std::set<LabelType> Watershed(const LabelType label);
 
     /** \brief Adds a point to the selection area.
      * \param[in] point point coordinates.
@@ -238,12 +239,22 @@ class EditorOperations
      * \param[in] label object label value.
      *
      */
-    void CleanImage(itk::SmartPointer<ImageType> image, const unsigned short label) const;
+    void CleanImage(itk::SmartPointer<ImageType> image, const LabelType label) const;
+
+    /** \brief Morphological operations.
+     *
+     */
+    enum class Morphology: char { ERODE = 0, DILATE, OPEN, CLOSE };
 
-    /** \brief Dumps the values of the image to the vtkstructuredpoints structure.
+    /** \brief Applies the morphological operation to each of the given labels. The labels are filtered
+     * in parallel by worker threads created for the call, one per core at most, each one reading the
+     * region of the label it takes. The changes are merged in one undo/redo action, if several labels
+     * change the same voxel the lowest label wins.
+     * \param[in] operation morphological operation.
+     * \param[in] labels object labels.
      *
      */
-    void ItkImageToPoints(itk::SmartPointer<ImageType> image);
+    void ApplyMorphology(const Morphology operation, const std::set<LabelType> &labels);
 
     std::shared_ptr<Coordinates>         m_orientation;    /** image orientation data. */
     std::shared_ptr<DataManager>         m_dataManager;    /** image data. */
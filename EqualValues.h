@@ -0,0 +1,42 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: EqualValues.h
+// Purpose: Compares rows of voxel values to find the runs of changed voxels
+// Notes: Compares 16 bytes at a time when SSE2 is available.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _EQUALVALUES_H_
+#define _EQUALVALUES_H_
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/** \brief Returns the number of equal values at the start of the given buffers.
+ * \param[in] a first buffer.
+ * \param[in] b second buffer.
+ * \param[in] count number of values of the buffers.
+ *
+ */
+template<class T> inline unsigned int equalValues(const T *a, const T *b, const unsigned int count)
+{
+  unsigned int i = 0;
+
+#ifdef __SSE2__
+  const unsigned int step = sizeof(__m128i) / sizeof(T);
+  for (; i + step <= count; i += step)
+  {
+    auto va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+    auto vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+    if (0xFFFF != _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb))) break;
+  }
+#endif
+
+  while ((i < count) && (a[i] == b[i])) ++i;
+
+  return i;
+}
+
+#endif // _EQUALVALUES_H_
@@ -21,13 +21,9 @@
 #include <itkImageFileReader.h>
 #include <itkLabelMap.h>
 #include <itkLabelObject.h>
-#include <itkLabelImageToLabelMapFilter.h>
-#include <itkLabelMapToLabelImageFilter.h>
 #include <itkSmartPointer.h>
-#include <itkVTKImageExport.h>
 #include <itkMetaImageIO.h>
 #include <itkCastImageFilter.h>
-#include <itkChangeInformationImageFilter.h>
 #include <itkLabelGeometryImageFilter.h>
 
 // vtk includes 
@@ -41,7 +37,6 @@
 #include <vtkImageFlip.h>
 #include <vtkImageCast.h>
 #include <vtkImageToStructuredPoints.h>
-#include <vtkImageImport.h>
 #include <vtkInformation.h>
 #include <vtkAxesActor.h>
 #include <vtkImageChangeInformation.h>
@@ -56,16 +51,15 @@
 #include "QtAbout.h"
 #include "QtPreferences.h"
 #include "QtSessionInfo.h"
+#include "QtUndoHistory.h"
 #include "QtKeyboardHelp.h"
-#include "itkvtkpipeline.h"
 #include "Selection.h"
 
-using ImageType                 = itk::Image<unsigned short, 3>;
-using ReaderType                = itk::ImageFileReader<ImageType>;
-using ChangeInfoType            = itk::ChangeInformationImageFilter<ImageType>;
-using ConverterType             = itk::LabelImageToLabelMapFilter<ImageType, LabelMapType>;
-using LabelMapToImageFilterType = itk::LabelMapToLabelImageFilter<LabelMapType, ImageType>;
-using ITKExport                 = itk::VTKImageExport<ImageType>;
+// c++ includes
+#include <limits>
+
+using ImageType  = itk::Image<LabelType, 3>;
+using ReaderType = itk::ImageFileReader<ImageType>;
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 EspinaVolumeEditor::EspinaVolumeEditor(QApplication *app, QWidget *parent)
@@ -376,11 +370,8 @@ void EspinaVolumeEditor::open()
   reader->SetFileName(filename.toStdString().c_str());
   reader->ReleaseDataFlagOn();
 
-  try
-  {
-    reader->Update();
-  }
-  catch (itk::ExceptionObject & excp)
+  // only the image information is read here, the voxels are read slab by slab later.
+  auto readError = [this](itk::ExceptionObject &excp)
   {
     m_progress->ManualReset();
 
@@ -398,6 +389,15 @@ void EspinaVolumeEditor::open()
     msgBox.move(QPoint( rect.width()/2 - msgSize.width()/2, rect.height()/2 - msgSize.height()/2 ) );
 
     msgBox.exec();
+  };
+
+  try
+  {
+    reader->UpdateOutputInformation();
+  }
+  catch (itk::ExceptionObject & excp)
+  {
+    readError(excp);
     return;
   }
 
@@ -424,6 +424,29 @@ void EspinaVolumeEditor::open()
     return;
   }
 
+  // values that don't fit in the label type have been truncated by the reader.
+  if (m_fileMetadata->maximumScalar() > std::numeric_limits<LabelType>::max())
+  {
+    m_progress->ManualReset();
+
+    QMessageBox msgBox(this);
+    msgBox.setWindowIcon(QIcon(":/newPrefix/icons/brain.png"));
+    msgBox.setWindowTitle("Error loading segmentation file");
+    msgBox.setIcon(QMessageBox::Critical);
+
+    auto text = QString("The segmentation file \"%1\" has label values up to %2 but this build of the editor supports values up to %3.\n"
+                        "The editor must be built with the ESPINA_32BIT_LABELS option to edit it.\nThe operation has been aborted.")
+                        .arg(filename).arg(m_fileMetadata->maximumScalar()).arg(std::numeric_limits<LabelType>::max());
+    msgBox.setText(text);
+
+    auto msgSize = msgBox.sizeHint();
+    auto rect = this->rect();
+    msgBox.move(QPoint( rect.width()/2 - msgSize.width()/2, rect.height()/2 - msgSize.height()/2 ) );
+
+    msgBox.exec();
+    return;
+  }
+
   // clean all viewports
   m_volumeRenderer  ->RemoveAllViewProps();
   m_axialRenderer   ->RemoveAllViewProps();
@@ -479,8 +502,12 @@ void EspinaVolumeEditor::open()
   if (m_dataManager)
   {
     auto size = m_dataManager->GetUndoRedoBufferSize();
+    auto bricked = m_dataManager->IsBrickedStorageEnabled();
+    auto mapped = m_dataManager->IsMappedStorage();
     m_dataManager = std::make_shared<DataManager>();
     m_dataManager->SetUndoRedoBufferSize(size);
+    m_dataManager->SetBrickedStorage(bricked);
+    m_dataManager->SetMappedStorage(mapped);
     updateUndoRedoMenu();
   }
 
@@ -493,39 +520,21 @@ void EspinaVolumeEditor::open()
     m_editorOperations->SetWatershedLevel(level);
   }
 
-  // here we go after file read:
-  // itkimage(unsigned short,3) -> itklabelmap -> itkimage-> vtkimage -> vtkstructuredpoints
+  // the image is read slab by slab to the data manager storage, replacing the scalars with labels.
   m_progress->ManualSet("Load");
 
   // get image orientation data
   m_orientationData = std::make_shared<Coordinates>(reader->GetOutput());
 
-  auto infoChanger = ChangeInfoType::New();
-  infoChanger->SetInput(reader->GetOutput());
-  infoChanger->ReleaseDataFlagOn();
-  infoChanger->ChangeOriginOn();
-  infoChanger->ReleaseDataFlagOn();
-  ImageType::PointType newOrigin;
-  newOrigin[0] = 0.0;
-  newOrigin[1] = 0.0;
-  newOrigin[2] = 0.0;
-  infoChanger->SetOutputOrigin(newOrigin);
-  m_progress->Observe(infoChanger, "Fix Image", 0.14);
-  infoChanger->Update();
-  m_progress->Ignore(infoChanger);
-
-  // itkimage->itklabelmap
-  auto converter = ConverterType::New();
-  converter->SetInput(infoChanger->GetOutput());
-  converter->ReleaseDataFlagOn();
-  m_progress->Observe(converter, "Label Map", 0.14);
-  converter->Update();
-  m_progress->Ignore(converter);
-  converter->GetOutput()->Optimize();
-  assert(0 != converter->GetOutput()->GetNumberOfLabelObjects());
-
-  // flatten labelmap, modify origin and store scalar label values
-  m_dataManager->Initialize(converter->GetOutput(), m_orientationData, m_fileMetadata);
+  try
+  {
+    m_dataManager->Initialize(reader, m_orientationData, m_fileMetadata, true, [this](const int value) { m_progress->ManualUpdate(value); });
+  }
+  catch (itk::ExceptionObject & excp)
+  {
+    readError(excp);
+    return;
+  }
 
   // check if there are unused objects
   m_fileMetadata->compact();
@@ -558,38 +567,6 @@ void EspinaVolumeEditor::open()
     QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
   }
 
-  // itklabelmap->itkimage
-  auto labelconverter = LabelMapToImageFilterType::New();
-  labelconverter->SetInput(m_dataManager->GetLabelMap());
-  labelconverter->SetNumberOfThreads(1); // if number of threads > 1 filter crashes (¿¿??)
-  labelconverter->ReleaseDataFlagOn();
-
-  m_progress->Observe(labelconverter, "Convert Image", 0.14);
-  labelconverter->Update();
-  m_progress->Ignore(labelconverter);
-
-  // itkimage->vtkimage
-  auto itkExporter = ITKExport::New();
-  auto vtkImporter = vtkSmartPointer<vtkImageImport>::New();
-  itkExporter->SetInput(labelconverter->GetOutput());
-  ConnectPipelines(itkExporter, vtkImporter);
-  m_progress->Observe(vtkImporter, "Import", 0.14);
-  m_progress->Observe(itkExporter, "Export", 0.14);
-  vtkImporter->Update();
-  m_progress->Ignore(itkExporter);
-  m_progress->Ignore(vtkImporter);
-
-  // get the vtkStructuredPoints out of the vtkImage
-  auto convert = vtkSmartPointer<vtkImageToStructuredPoints>::New();
-  convert->SetInputData(vtkImporter->GetOutput());
-  convert->ReleaseDataFlagOn();
-  m_progress->Observe(convert, "Convert Points", 0.14);
-  convert->Update();
-  m_progress->Ignore(convert);
-
-  // now we have our structuredpoints
-  m_dataManager->SetStructuredPoints(convert->GetStructuredPointsOutput());
-
   // gui setup
   initializeGUI();
 
@@ -619,13 +596,13 @@ void EspinaVolumeEditor::open()
   {
     auto labelList = editorSettings.value(filename).toList();
 
-    std::set<unsigned short> labelScalars;
+    std::set<LabelType> labelScalars;
     for (auto label: labelList)
     {
-      labelScalars.insert(static_cast<unsigned short>(label.toUInt()));
+      labelScalars.insert(static_cast<LabelType>(label.toUInt()));
     }
 
-    std::set<unsigned short> labelIndexes;
+    std::set<LabelType> labelIndexes;
     for (auto index: labelIndexes)
     {
       labelIndexes.insert(m_dataManager->GetLabelForScalar(index));
@@ -921,7 +898,7 @@ void EspinaVolumeEditor::save()
   editorSettings.beginGroup("UserData");
 
   auto labelIndexes = m_dataManager->GetSelectedLabelsSet();
-  std::set<unsigned short> labelScalars;
+  std::set<LabelType> labelScalars;
 
   for (auto index: labelIndexes)
   {
@@ -1194,7 +1171,7 @@ void EspinaVolumeEditor::onSelectionChanged()
   labelselector->blockSignals(true);
 
   // get the selected items group in the labelselector widget and get their indexes
-  std::set<unsigned short> labelsList;
+  std::set<LabelType> labelsList;
   auto selectedItems = labelselector->selectedItems();
 
   for (auto item: selectedItems)
@@ -1207,7 +1184,7 @@ void EspinaVolumeEditor::onSelectionChanged()
       continue;
     }
 
-    labelsList.insert(static_cast<unsigned short>(labelselector->row(item)));
+    labelsList.insert(static_cast<LabelType>(labelselector->row(item)));
   }
 
   // modify views according to selected group of labels
@@ -1289,7 +1266,7 @@ void EspinaVolumeEditor::onSelectionChanged()
   // but only if the user is not picking colours, selecting a box, erasing or painting.
   if ((m_dataManager->GetSelectedLabelSetSize() == 1) && viewbutton->isChecked())
   {
-    std::set<unsigned short>::iterator it = m_dataManager->GetSelectedLabelsSet().begin();
+    std::set<LabelType>::iterator it = m_dataManager->GetSelectedLabelsSet().begin();
     if (0LL != m_dataManager->GetNumberOfVoxelsForLabel(*it))
     {
       // center slice views in the centroid of the object
@@ -1354,7 +1331,8 @@ void EspinaVolumeEditor::preferences()
                                  m_axialView->segmentationOpacity()*100,
                                  m_saveSessionTime,
                                  m_saveSessionEnabled,
-                                 m_brushRadius);
+                                 m_brushRadius,
+                                 m_dataManager->IsMappedStorage());
 
   if (m_hasReferenceImage)
   {
@@ -1375,12 +1353,14 @@ void EspinaVolumeEditor::preferences()
   editorSettings.setValue("Paint-Erase Radius", configdialog.brushRadius());
   editorSettings.setValue("Autosave Session Data", configdialog.isAutoSaveEnabled());
   editorSettings.setValue("Autosave Session Time", configdialog.autoSaveInterval());
+  editorSettings.setValue("Mapped Storage", configdialog.isMappedStorageEnabled());
   editorSettings.sync();
 
   // configure editor
   m_editorOperations->SetFiltersRadius(configdialog.radius());
   m_editorOperations->SetWatershedLevel(configdialog.level());
   m_dataManager->SetUndoRedoBufferSize(configdialog.size());
+  m_dataManager->SetMappedStorage(configdialog.isMappedStorageEnabled());
   m_brushRadius = configdialog.brushRadius();
 
   if (m_saveSessionTime != (configdialog.autoSaveInterval() * 60 * 1000))
@@ -1536,7 +1516,7 @@ void EspinaVolumeEditor::relabel()
 {
   QMutexLocker locker(&m_mutex);
 
-  std::set<unsigned short> labels = m_dataManager->GetSelectedLabelsSet();
+  std::set<LabelType> labels = m_dataManager->GetSelectedLabelsSet();
   bool isANewColor{false};
 
   if (m_editorOperations->Relabel(this, m_fileMetadata, &labels, &isANewColor))
@@ -1621,20 +1601,30 @@ void EspinaVolumeEditor::keyboardHelp()
 void EspinaVolumeEditor::erodeVolumes()
 {
   QMutexLocker locker(&m_mutex);
-  auto label = m_dataManager->GetSelectedLabelsSet().begin().operator *();
+  auto labels = m_dataManager->GetSelectedLabelsSet();
 
-  m_editorOperations->Erode(label);
+  m_editorOperations->Erode(labels);
 
-  // the label could be empty right now
-  if (0LL == m_dataManager->GetNumberOfVoxelsForLabel(label))
+  // some labels could be empty right now
+  auto emptied = false;
+  labelselector->blockSignals(true);
+  for (auto label: labels)
+  {
+    if (0LL == m_dataManager->GetNumberOfVoxelsForLabel(label))
+    {
+      labelselector->item(label)->setHidden(true);
+      labelselector->item(label)->setSelected(false);
+      emptied = true;
+    }
+  }
+
+  if (emptied && labelselector->selectedItems().isEmpty())
   {
-    labelselector->blockSignals(true);
-    labelselector->item(label)->setHidden(true);
-    labelselector->item(label)->setSelected(false);
     labelselector->item(0)->setSelected(true);
-    labelselector->blockSignals(false);
-    onSelectionChanged();
   }
+  labelselector->blockSignals(false);
+
+  if (emptied) onSelectionChanged();
 
   updatePointLabel();
   updateUndoRedoMenu();
@@ -1645,9 +1635,7 @@ void EspinaVolumeEditor::erodeVolumes()
 void EspinaVolumeEditor::dilateVolumes()
 {
   QMutexLocker locker(&m_mutex);
-  auto label = m_dataManager->GetSelectedLabelsSet().begin().operator *();
-
-  m_editorOperations->Dilate(label);
+  m_editorOperations->Dilate(m_dataManager->GetSelectedLabelsSet());
 
   updatePointLabel();
   updateUndoRedoMenu();
@@ -1659,9 +1647,7 @@ void EspinaVolumeEditor::dilateVolumes()
 void EspinaVolumeEditor::openVolumes()
 {
   QMutexLocker locker(&m_mutex);
-  auto label = m_dataManager->GetSelectedLabelsSet().begin().operator *();
-
-  m_editorOperations->Open(label);
+  m_editorOperations->Open(m_dataManager->GetSelectedLabelsSet());
 
   updatePointLabel();
   updateUndoRedoMenu();
@@ -1673,9 +1659,7 @@ void EspinaVolumeEditor::openVolumes()
 void EspinaVolumeEditor::closeVolumes()
 {
   QMutexLocker locker(&m_mutex);
-  auto label = m_dataManager->GetSelectedLabelsSet().begin().operator *();
-
-  m_editorOperations->Close(label);
+  m_editorOperations->Close(m_dataManager->GetSelectedLabelsSet());
 
   updatePointLabel();
   updateUndoRedoMenu();
@@ -1709,6 +1693,7 @@ void EspinaVolumeEditor::updateUndoRedoMenu()
     text = std::string("Undo ") + m_dataManager->GetUndoActionString();
 
   a_undo->setText(text.c_str());
+  a_undo->setToolTip(QString("%1\n%2").arg(text.c_str()).arg(m_dataManager->GetUndoActionStorageString().c_str()).trimmed());
   a_undo->setEnabled(!(m_dataManager->IsUndoBufferEmpty()));
 
   if (m_dataManager->IsRedoBufferEmpty())
@@ -1717,6 +1702,7 @@ void EspinaVolumeEditor::updateUndoRedoMenu()
     text = std::string("Redo ") + m_dataManager->GetRedoActionString();
 
   a_redo->setText(text.c_str());
+  a_redo->setToolTip(QString("%1\n%2").arg(text.c_str()).arg(m_dataManager->GetRedoActionStorageString().c_str()).trimmed());
   a_redo->setEnabled(!(m_dataManager->IsRedoBufferEmpty()));
 }
 
@@ -1738,7 +1724,7 @@ void EspinaVolumeEditor::undo()
   // scroll to last selected label
   if (!m_dataManager->GetSelectedLabelsSet().empty())
   {
-    std::set<unsigned short>::reverse_iterator rit = m_dataManager->GetSelectedLabelsSet().rbegin();
+    std::set<LabelType>::reverse_iterator rit = m_dataManager->GetSelectedLabelsSet().rbegin();
     labelselector->scrollToItem(labelselector->item(*rit), QAbstractItemView::PositionAtBottom);
   }
 
@@ -1779,7 +1765,7 @@ void EspinaVolumeEditor::redo()
   // scroll to last selected label
   if (!m_dataManager->GetSelectedLabelsSet().empty())
   {
-    std::set<unsigned short>::reverse_iterator rit = m_dataManager->GetSelectedLabelsSet().rbegin();
+    std::set<LabelType>::reverse_iterator rit = m_dataManager->GetSelectedLabelsSet().rbegin();
     labelselector->scrollToItem(labelselector->item(*rit), QAbstractItemView::PositionAtBottom);
   }
 
@@ -2085,7 +2071,7 @@ void EspinaVolumeEditor::sliceXYPick(const unsigned long event, std::shared_ptr<
 
       // some labels could be empty after a paint or a erase operation
       labelselector->blockSignals(true);
-      for (unsigned short i = 1; i < m_dataManager->GetNumberOfLabels(); i++)
+      for (LabelType i = 1; i < m_dataManager->GetNumberOfLabels(); i++)
         if (0LL == m_dataManager->GetNumberOfVoxelsForLabel(i))
         {
           labelselector->item(i)->setHidden(true);
@@ -2511,11 +2497,8 @@ void EspinaVolumeEditor::restoreSavedSession(void)
   reader->SetFileName(temporalFilenameMHA.toStdString().c_str());
   reader->ReleaseDataFlagOn();
 
-  try
-  {
-    reader->Update();
-  }
-  catch (itk::ExceptionObject & excp)
+  // only the image information is read here, the voxels are read in slabs by the data manager.
+  auto readError = [this](itk::ExceptionObject &excp)
   {
     m_progress->ManualReset();
     QMessageBox msgBox(this);
@@ -2529,6 +2512,15 @@ void EspinaVolumeEditor::restoreSavedSession(void)
     msgBox.move(QPoint( rect.width()/2 - msgSize.width()/2, rect.height()/2 - msgSize.height()/2 ) );
 
     msgBox.exec();
+  };
+
+  try
+  {
+    reader->UpdateOutputInformation();
+  }
+  catch (itk::ExceptionObject & excp)
+  {
+    readError(excp);
     return;
   }
 
@@ -2590,62 +2582,43 @@ void EspinaVolumeEditor::restoreSavedSession(void)
   infile.read(reinterpret_cast<char*>(&m_fileMetadata->unassignedTagPosition), sizeof(int));
 
   m_orientationData = std::make_shared<Coordinates>(reader->GetOutput());
-  auto imageSize = m_orientationData->GetTransformedSize();
-
-  // itkimage->itklabelmap
-  auto converter = ConverterType::New();
-  converter->SetInput(reader->GetOutput());
-  converter->ReleaseDataFlagOn();
-  converter->Update();
-  converter->GetOutput()->Optimize();
-  assert(0 != converter->GetOutput()->GetNumberOfLabelObjects());
 
-  // flatten labelmap, modify origin and store scalar label values
-  m_dataManager->Initialize(converter->GetOutput(), m_orientationData, m_fileMetadata);
-
-  // overwrite _dataManager object vector
-  infile.read(reinterpret_cast<char*>(&size), sizeof(unsigned short int));
-  for (unsigned int i = 0; i < size; i++)
-  {
-    unsigned short int position;
-    infile.read(reinterpret_cast<char*>(&position), sizeof(unsigned short int));
-    auto object = m_dataManager->ObjectVector[position];
-    infile.read(reinterpret_cast<char*>(&object->scalar), sizeof(unsigned short));
-    infile.read(reinterpret_cast<char*>(&object->size), sizeof(unsigned long long int));
-    infile.read(reinterpret_cast<char*>(&object->centroid[0]), sizeof(double));
-    infile.read(reinterpret_cast<char*>(&object->centroid[1]), sizeof(double));
-    infile.read(reinterpret_cast<char*>(&object->centroid[2]), sizeof(double));
-    infile.read(reinterpret_cast<char*>(&object->min[0]), sizeof(unsigned int));
-    infile.read(reinterpret_cast<char*>(&object->min[1]), sizeof(unsigned int));
-    infile.read(reinterpret_cast<char*>(&object->min[2]), sizeof(unsigned int));
-    infile.read(reinterpret_cast<char*>(&object->max[0]), sizeof(unsigned int));
-    infile.read(reinterpret_cast<char*>(&object->max[1]), sizeof(unsigned int));
-    infile.read(reinterpret_cast<char*>(&object->max[2]), sizeof(unsigned int));
+  // the label table is read from the session, the image already stores the labels.
+  m_dataManager->m_labelTable.clear();
+  LabelType labelsNum;
+  infile.read(reinterpret_cast<char*>(&labelsNum), sizeof(LabelType));
+  for (unsigned int i = 0; i < labelsNum; i++)
+  {
+    LabelType position;
+    DataManager::ObjectInformation object;
+    infile.read(reinterpret_cast<char*>(&position), sizeof(LabelType));
+    infile.read(reinterpret_cast<char*>(&object.scalar), sizeof(LabelType));
+    infile.read(reinterpret_cast<char*>(&object.size), sizeof(unsigned long long int));
+    infile.read(reinterpret_cast<char*>(&object.centroid[0]), sizeof(double));
+    infile.read(reinterpret_cast<char*>(&object.centroid[1]), sizeof(double));
+    infile.read(reinterpret_cast<char*>(&object.centroid[2]), sizeof(double));
+    infile.read(reinterpret_cast<char*>(&object.min[0]), sizeof(unsigned int));
+    infile.read(reinterpret_cast<char*>(&object.min[1]), sizeof(unsigned int));
+    infile.read(reinterpret_cast<char*>(&object.min[2]), sizeof(unsigned int));
+    infile.read(reinterpret_cast<char*>(&object.max[0]), sizeof(unsigned int));
+    infile.read(reinterpret_cast<char*>(&object.max[1]), sizeof(unsigned int));
+    infile.read(reinterpret_cast<char*>(&object.max[2]), sizeof(unsigned int));
+    m_dataManager->m_labelTable.insert(position, object);
   }
   infile.close();
 
-  // itklabelmap->itkimage
-  auto labelconverter = LabelMapToImageFilterType::New();
-  labelconverter->SetInput(m_dataManager->GetLabelMap());
-  labelconverter->SetNumberOfThreads(1);						// if number of threads > 1 filter crashes (¿¿??)
-  labelconverter->ReleaseDataFlagOn();
-  labelconverter->Update();
-
-  // itkimage->vtkimage
-  auto itkExporter = ITKExport::New();
-  auto vtkImporter = vtkSmartPointer<vtkImageImport>::New();
-  itkExporter->SetInput(reader->GetOutput());
-  ConnectPipelines(itkExporter, vtkImporter);
-  vtkImporter->Update();
-
-  // get the vtkStructuredPoints out of the vtkImage
-  auto convert = vtkSmartPointer<vtkImageToStructuredPoints>::New();
-  convert->SetInputData(vtkImporter->GetOutput());
-  convert->ReleaseDataFlagOn();
-  convert->Update();
+  try
+  {
+    m_dataManager->Initialize(reader, m_orientationData, m_fileMetadata, false, [this](const int value) { m_progress->ManualUpdate(value); });
+  }
+  catch (itk::ExceptionObject & excp)
+  {
+    readError(excp);
+    return;
+  }
 
-  // now we have our structuredpoints
-  m_dataManager->SetStructuredPoints(convert->GetStructuredPointsOutput());
+  // the undo actions saved with the session, their voxels are read from the journal when undone.
+  m_dataManager->LoadActionsJournal(baseFilename + QString(".undo"));
 
   // initialize the GUI
   initializeGUI();
@@ -2668,13 +2641,13 @@ void EspinaVolumeEditor::restoreSavedSession(void)
   {
     auto labelList = editorSettings.value(filename).toList();
 
-    std::set<unsigned short> labelScalars;
+    std::set<LabelType> labelScalars;
     for (auto label: labelList)
     {
-      labelScalars.insert(static_cast<unsigned short>(label.toUInt()));
+      labelScalars.insert(static_cast<LabelType>(label.toUInt()));
     }
 
-    std::set<unsigned short> labelIndexes;
+    std::set<LabelType> labelIndexes;
     for (auto index: labelIndexes)
     {
       labelIndexes.insert(m_dataManager->GetLabelForScalar(index));
@@ -2747,6 +2720,9 @@ void EspinaVolumeEditor::removeSessionFiles(void)
     msgBox.exec();
   }
 
+  // the undo journal is useless without the session files.
+  QFile::remove(baseFilename + QString(".undo"));
+
   // remove stored metadata
   QSettings editorSettings("UPM", "Espina Volume Editor");
   editorSettings.beginGroup("Editor");
@@ -2833,6 +2809,7 @@ void EspinaVolumeEditor::initializeGUI(void)
   a_fileSave->setEnabled(true);
   a_fileReferenceOpen->setEnabled(true);
   a_fileInfo->setEnabled(true);
+  a_undoHistory->setEnabled(true);
   axialsizebutton->setEnabled(true);
   coronalsizebutton->setEnabled(true);
   sagittalsizebutton->setEnabled(true);
@@ -2906,7 +2883,7 @@ void EspinaVolumeEditor::eraseOrPaintButtonToggle(bool value)
     if ((m_dataManager->GetSelectedLabelSetSize() > 1) && paintbutton->isChecked())
     {
       auto labels = m_dataManager->GetSelectedLabelsSet();
-      std::set<unsigned short>::reverse_iterator rit = labels.rbegin();
+      std::set<LabelType>::reverse_iterator rit = labels.rbegin();
       if (rit != labels.rend())
       {
         labelselector->blockSignals(true);
@@ -3006,7 +2983,7 @@ void EspinaVolumeEditor::restartVoxelRender(void)
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void EspinaVolumeEditor::selectLabels(std::set<unsigned short> labels)
+void EspinaVolumeEditor::selectLabels(std::set<LabelType> labels)
 {
   // can't select a group of labels if it contains the background label
   if ((labels.find(0) != labels.end()) || labels.empty())
@@ -3028,7 +3005,7 @@ void EspinaVolumeEditor::selectLabels(std::set<unsigned short> labels)
   labelselector->blockSignals(false);
 
   // scroll to the last one created label
-  std::set<unsigned short>::reverse_iterator rit = labels.rbegin();
+  std::set<LabelType>::reverse_iterator rit = labels.rbegin();
   if(rit != labels.rend())
   {
     labelselector->scrollToItem(labelselector->item(*rit), QAbstractItemView::PositionAtCenter);
@@ -3161,6 +3138,17 @@ void EspinaVolumeEditor::sessionInfo()
   infodialog.exec();
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void EspinaVolumeEditor::undoHistory()
+{
+  QtUndoHistory historyDialog(this);
+
+  historyDialog.SetActions(m_dataManager->GetUndoActionsInformation(), m_dataManager->GetRedoActionsInformation());
+  historyDialog.SetBufferUsage(m_dataManager->GetUndoRedoBufferCapacity(), m_dataManager->GetUndoRedoBufferSize());
+
+  historyDialog.exec();
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 bool EspinaVolumeEditor::eventFilter(QObject *object, QEvent *event)
 {
@@ -3193,6 +3181,7 @@ void EspinaVolumeEditor::connectSignals()
 
   connect(a_undo, SIGNAL(triggered()), this, SLOT(undo()));
   connect(a_redo, SIGNAL(triggered()), this, SLOT(redo()));
+  connect(a_undoHistory, SIGNAL(triggered()), this, SLOT(undoHistory()));
   connect(a_hide_segmentations, SIGNAL(triggered()), this, SLOT(segmentationViewToggle()));
 
   connect(a_fulltoggle, SIGNAL(triggered()), this, SLOT(fullscreenToggle()));
@@ -3339,6 +3328,20 @@ void EspinaVolumeEditor::loadSettings()
     }
   }
 
+  // bricked storage of the segmentation, used for the files loaded after the change.
+  if (!editorSettings.contains("Bricked Storage"))
+  {
+    editorSettings.setValue("Bricked Storage", false);
+  }
+  m_dataManager->SetBrickedStorage(editorSettings.value("Bricked Storage").toBool());
+
+  // memory mapped storage of the segmentation in a temporary file, for images bigger than the memory.
+  if (!editorSettings.contains("Mapped Storage"))
+  {
+    editorSettings.setValue("Mapped Storage", false);
+  }
+  m_dataManager->SetMappedStorage(editorSettings.value("Mapped Storage").toBool());
+
   editorSettings.sync();
 }
 
@@ -48,7 +48,7 @@
 #include "SaveSession.h"
 
 // defines and typedefs
-using LabelObjectType = itk::ShapeLabelObject<unsigned short, 3>;
+using LabelObjectType = itk::ShapeLabelObject<LabelType, 3>;
 using LabelMapType    = itk::LabelMap<LabelObjectType>;
 
 class EspinaVolumeEditor
@@ -99,6 +99,11 @@ class EspinaVolumeEditor
      */
     virtual void sessionInfo();
 
+    /** \brief Shows a dialog with the actions of the undo/redo buffers and their memory.
+     *
+     */
+    virtual void undoHistory();
+
     /** \brief Shows the keyboard help dialog.
      *
      */
@@ -366,7 +371,7 @@ class EspinaVolumeEditor
     /** \brief Selects the given labels group.
      *
      */
-    void selectLabels(const std::set<unsigned short> labels);
+    void selectLabels(const std::set<LabelType> labels);
 
     /** \brief Applies the currently selected operation.
      * \param[in] view view to apply the action if needed.
@@ -430,7 +435,7 @@ class EspinaVolumeEditor
 
     // point of interest and its label
     Vector3ui      m_POI;         /** point of interest, crosshair point. */
-    unsigned short m_pointScalar; /** label of the POI point.             */
+    LabelType m_pointScalar; /** label of the POI point.             */
 
     vtkSmartPointer<vtkEventQtSlotConnect> m_connections; /** converts between vtk events and qt slots. */
 
@@ -0,0 +1,143 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: LabelRunIndex.cpp
+// Purpose: Keeps the voxels of each label as runs of voxels of the same image row
+// Notes: The runs of a label are stored the first time they are requested and only the rows
+//        modified after that are read again from the image. The background value isn't indexed
+//        as it fills most of the image.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// project includes
+#include "LabelRunIndex.h"
+
+// c++ includes
+#include <algorithm>
+
+// Qt
+#include <QtGlobal>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+LabelRunIndex::LabelRunIndex()
+: m_rowLength{1}
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void LabelRunIndex::setRowLength(const unsigned long long int length)
+{
+  Q_ASSERT(length > 0);
+
+  clear();
+  m_rowLength = length;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void LabelRunIndex::clear()
+{
+  m_entries.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool LabelRunIndex::contains(const LabelType value) const
+{
+  return (m_entries.find(value) != m_entries.end());
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void LabelRunIndex::set(const LabelType value, std::vector<Run> &&runs)
+{
+  if (0 == value) return;
+
+  auto &entry = m_entries[value];
+  entry.runs = std::move(runs);
+  entry.runs.shrink_to_fit();
+  entry.modified.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void LabelRunIndex::touch(const LabelType value, const unsigned long long int offset)
+{
+  auto it = m_entries.find(value);
+  if (it == m_entries.end()) return;
+
+  auto &modified = (*it).second.modified;
+  auto row = offset / m_rowLength;
+
+  // writes usually come in row order, repeated rows are removed when the index is updated.
+  if (!modified.empty() && (modified.back() == row)) return;
+
+  modified.push_back(row);
+
+  if (modified.size() > std::max<std::size_t>(1024, (*it).second.runs.size()))
+  {
+    std::sort(modified.begin(), modified.end());
+    modified.erase(std::unique(modified.begin(), modified.end()), modified.end());
+
+    if (modified.size() > std::max<std::size_t>(1024, (*it).second.runs.size())) m_entries.erase(it);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+std::vector<unsigned long long int> LabelRunIndex::modifiedRows(const LabelType value)
+{
+  std::vector<unsigned long long int> rows;
+
+  auto it = m_entries.find(value);
+  if (it == m_entries.end()) return rows;
+
+  auto &modified = (*it).second.modified;
+  std::sort(modified.begin(), modified.end());
+  modified.erase(std::unique(modified.begin(), modified.end()), modified.end());
+
+  rows = modified;
+  return rows;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void LabelRunIndex::update(const LabelType value, const std::vector<Run> &runs)
+{
+  auto it = m_entries.find(value);
+  if (it == m_entries.end()) return;
+
+  auto &entry = (*it).second;
+  if (entry.modified.empty()) return;
+
+  // the runs of the modified rows are replaced merging both ordered lists in one pass.
+  std::vector<Run> merged;
+  merged.reserve(entry.runs.size() + runs.size());
+
+  auto modifiedIt = entry.modified.cbegin();
+  auto newIt = runs.cbegin();
+  for (auto &run: entry.runs)
+  {
+    auto row = run.offset / m_rowLength;
+
+    while ((newIt != runs.cend()) && ((*newIt).offset < run.offset))
+    {
+      merged.push_back(*newIt++);
+    }
+
+    while ((modifiedIt != entry.modified.cend()) && (*modifiedIt < row)) ++modifiedIt;
+    if ((modifiedIt != entry.modified.cend()) && (*modifiedIt == row)) continue;
+
+    merged.push_back(run);
+  }
+
+  merged.insert(merged.end(), newIt, runs.cend());
+
+  entry.runs = std::move(merged);
+  entry.modified.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const std::vector<LabelRunIndex::Run> &LabelRunIndex::runs(const LabelType value) const
+{
+  Q_ASSERT(contains(value));
+
+  auto &entry = (*m_entries.find(value)).second;
+  Q_ASSERT(entry.modified.empty());
+
+  return entry.runs;
+}
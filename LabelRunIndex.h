@@ -0,0 +1,114 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: LabelRunIndex.h
+// Purpose: Keeps the voxels of each label as runs of voxels of the same image row
+// Notes: The runs of a label are stored the first time they are requested and only the rows
+//        modified after that are read again from the image. The background value isn't indexed
+//        as it fills most of the image.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _LABELRUNINDEX_H_
+#define _LABELRUNINDEX_H_
+
+// c++ includes
+#include <unordered_map>
+#include <vector>
+
+// project includes
+#include "LabelType.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// LabelRunIndex class
+//
+class LabelRunIndex
+{
+  public:
+    /** \brief Run of voxels of the same image row.
+     *
+     */
+    struct Run
+    {
+        unsigned long long int offset; /** linear offset of the first voxel of the run in the image buffer. */
+        unsigned int           length; /** number of voxels of the run.                                    */
+
+        Run(const unsigned long long int runOffset = 0, const unsigned int runLength = 0)
+        : offset{runOffset}, length{runLength} {};
+    };
+
+    /** \brief LabelRunIndex class constructor.
+     *
+     */
+    LabelRunIndex();
+
+    /** \brief Sets the number of voxels of an image row, needed to convert the linear offsets.
+     * Clears the index.
+     * \param[in] length row length.
+     *
+     */
+    void setRowLength(const unsigned long long int length);
+
+    /** \brief Removes the runs of all the values.
+     *
+     */
+    void clear();
+
+    /** \brief Returns true if the runs of the given value are stored.
+     * \param[in] value scalar value.
+     *
+     */
+    bool contains(const LabelType value) const;
+
+    /** \brief Stores the runs of the given value.
+     * \param[in] value scalar value.
+     * \param[in] runs runs of the value ordered by offset, adjacent runs of the same row merged.
+     *
+     */
+    void set(const LabelType value, std::vector<Run> &&runs);
+
+    /** \brief Marks the row of the given voxel as modified for the given value. Does nothing if the
+     * value isn't stored. If the modified rows outnumber the runs the value is removed from the index
+     * as reading the rows again would cost more than reading the value again.
+     * \param[in] value scalar value.
+     * \param[in] offset linear offset of a voxel of the row in the image buffer.
+     *
+     */
+    void touch(const LabelType value, const unsigned long long int offset);
+
+    /** \brief Returns the rows modified since the runs of the given value were stored or updated,
+     * in increasing order.
+     * \param[in] value scalar value.
+     *
+     */
+    std::vector<unsigned long long int> modifiedRows(const LabelType value);
+
+    /** \brief Replaces the runs of the modified rows of the given value with the given ones.
+     * \param[in] value scalar value.
+     * \param[in] runs current runs of the modified rows ordered by offset.
+     *
+     */
+    void update(const LabelType value, const std::vector<Run> &runs);
+
+    /** \brief Returns the runs of the given value ordered by offset. The value must be stored and
+     * without modified rows.
+     * \param[in] value scalar value.
+     *
+     */
+    const std::vector<Run> &runs(const LabelType value) const;
+
+  private:
+    /** \brief Runs of a value and the rows modified after they were read.
+     *
+     */
+    struct Entry
+    {
+        std::vector<Run>                    runs;     /** runs of the value ordered by offset. */
+        std::vector<unsigned long long int> modified; /** modified rows, unordered.            */
+    };
+
+    unsigned long long int               m_rowLength; /** number of voxels of an image row. */
+    std::unordered_map<LabelType, Entry> m_entries;   /** runs of the requested values.     */
+};
+
+#endif // _LABELRUNINDEX_H_
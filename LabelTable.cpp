@@ -0,0 +1,369 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: LabelTable.cpp
+// Purpose: Contiguous table of label objects information (scalar, size, centroid, bounding box)
+// Notes: Labels are consecutive positions starting from 0 (background). Information is stored
+//        as parallel arrays indexed by label, with a reverse index from scalar to label and a
+//        bitmap of the used scalar values, or a hash map and an ordered set with 32 bit labels as
+//        the scalars can be very large and sparse. Each label keeps the number of voxels in each slab
+//        (plane perpendicular to an axis) of its bounding box so it can be shrunk exactly when
+//        voxels are removed.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// project includes
+#include "LabelTable.h"
+
+// c++ includes
+#include <algorithm>
+#include <limits>
+
+// Qt
+#include <QtGlobal>
+
+namespace
+{
+  const unsigned long long int SCALAR_VALUES = static_cast<unsigned long long int>(std::numeric_limits<LabelType>::max()) + 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+LabelTable::LabelTable()
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void LabelTable::clear()
+{
+  m_scalars.clear();
+  m_sizes.clear();
+  m_centroids.clear();
+  m_min.clear();
+  m_max.clear();
+  m_slabs.clear();
+
+  m_labelForScalar.clear();
+  m_usedScalars.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const unsigned int LabelTable::size() const
+{
+  return m_scalars.size();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const bool LabelTable::contains(const LabelType label) const
+{
+  return label < m_scalars.size();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void LabelTable::insert(const LabelType label, const ObjectInformation &object)
+{
+  if (label >= m_scalars.size())
+  {
+    auto labels = label + 1;
+    m_scalars.resize(labels, 0);
+    m_sizes.resize(labels, 0);
+    m_centroids.resize(3 * labels, 0);
+    m_min.resize(3 * labels, 0);
+    m_max.resize(3 * labels, 0);
+    m_slabs.resize(labels);
+  }
+  else
+  {
+    releaseScalar(m_scalars[label], label);
+    m_slabs[label] = Slabs();
+  }
+
+  m_scalars[label] = object.scalar;
+  m_sizes[label]   = object.size;
+  setCentroid(label, object.centroid);
+  setBoundingBox(label, object.min, object.max);
+
+  useScalar(object.scalar, label);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void LabelTable::erase(const LabelType label)
+{
+  Q_ASSERT(label + 1 == m_scalars.size());
+  if (label + 1 != m_scalars.size()) return;
+
+  releaseScalar(m_scalars[label], label);
+
+  m_scalars.pop_back();
+  m_sizes.pop_back();
+  m_centroids.resize(3 * label);
+  m_min.resize(3 * label);
+  m_max.resize(3 * label);
+  m_slabs.pop_back();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+LabelTable::ObjectInformation LabelTable::object(const LabelType label) const
+{
+  ObjectInformation object;
+  object.scalar   = m_scalars[label];
+  object.size     = m_sizes[label];
+  object.centroid = centroid(label);
+  object.min      = min(label);
+  object.max      = max(label);
+
+  return object;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+Vector3d LabelTable::centroid(const LabelType label) const
+{
+  auto index = 3 * label;
+  return Vector3d{m_centroids[index], m_centroids[index + 1], m_centroids[index + 2]};
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void LabelTable::setCentroid(const LabelType label, const Vector3d &centroid)
+{
+  auto index = 3 * label;
+  m_centroids[index]     = centroid[0];
+  m_centroids[index + 1] = centroid[1];
+  m_centroids[index + 2] = centroid[2];
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+Vector3ui LabelTable::min(const LabelType label) const
+{
+  auto index = 3 * label;
+  return Vector3ui{m_min[index], m_min[index + 1], m_min[index + 2]};
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+Vector3ui LabelTable::max(const LabelType label) const
+{
+  auto index = 3 * label;
+  return Vector3ui{m_max[index], m_max[index + 1], m_max[index + 2]};
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void LabelTable::setBoundingBox(const LabelType label, const Vector3ui &min, const Vector3ui &max)
+{
+  auto index = 3 * label;
+  for(unsigned int i = 0; i < 3; ++i)
+  {
+    m_min[index + i] = min[i];
+    m_max[index + i] = max[i];
+  }
+}
+
+#ifdef ESPINA_32BIT_LABELS
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const LabelType LabelTable::firstFreeScalar(const LabelType scalar) const
+{
+  // the used scalars after the given one are walked while they are consecutive.
+  unsigned long long int candidate = scalar;
+  for (auto it = m_usedScalars.lower_bound(scalar); (it != m_usedScalars.end()) && (*it == candidate); ++it)
+  {
+    ++candidate;
+  }
+
+  return (candidate < SCALAR_VALUES) ? static_cast<LabelType>(candidate) : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const LabelType LabelTable::lastUsedScalar() const
+{
+  return m_usedScalars.empty() ? 0 : *m_usedScalars.rbegin();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void LabelTable::useScalar(const LabelType scalar, const LabelType label)
+{
+  m_usedScalars.insert(scalar);
+  m_labelForScalar[scalar] = label;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void LabelTable::releaseScalar(const LabelType scalar, const LabelType label)
+{
+  // the scalar could have been reassigned to another label.
+  auto it = m_labelForScalar.find(scalar);
+  if ((it == m_labelForScalar.end()) || ((*it).second != label)) return;
+
+  m_usedScalars.erase(scalar);
+  m_labelForScalar.erase(it);
+}
+
+#else
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const LabelType LabelTable::firstFreeScalar(const LabelType scalar) const
+{
+  // scalars past the end of the bitmap have never been used.
+  unsigned long long int word = scalar >> 6;
+  if(word >= m_usedScalars.size()) return scalar;
+
+  auto bits = m_usedScalars[word] | ((1ULL << (scalar & 63)) - 1); // ignore values below the given scalar
+
+  while(bits == ~0ULL)
+  {
+    if(++word == m_usedScalars.size())
+    {
+      return ((word << 6) < SCALAR_VALUES) ? static_cast<LabelType>(word << 6) : 0;
+    }
+
+    bits = m_usedScalars[word];
+  }
+
+  unsigned int bit = 0;
+  while(bits & (1ULL << bit)) ++bit;
+
+  return static_cast<LabelType>((word << 6) + bit);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const LabelType LabelTable::lastUsedScalar() const
+{
+  for(auto word = m_usedScalars.size(); word > 0; --word)
+  {
+    auto bits = m_usedScalars[word - 1];
+    if(bits == 0) continue;
+
+    unsigned int bit = 63;
+    while(0 == (bits & (1ULL << bit))) --bit;
+
+    return static_cast<LabelType>(((word - 1) << 6) + bit);
+  }
+
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void LabelTable::useScalar(const LabelType scalar, const LabelType label)
+{
+  // the reverse index and the bitmap grow in words of 64 scalars as higher values are used.
+  auto word = scalar >> 6;
+  if (word >= m_usedScalars.size())
+  {
+    m_usedScalars.resize(word + 1, 0);
+    m_labelForScalar.resize(m_usedScalars.size() << 6, 0);
+  }
+
+  m_usedScalars[word] |= (1ULL << (scalar & 63));
+  m_labelForScalar[scalar] = label;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void LabelTable::releaseScalar(const LabelType scalar, const LabelType label)
+{
+  // the scalar could have been reassigned to another label.
+  if ((scalar >= m_labelForScalar.size()) || (m_labelForScalar[scalar] != label)) return;
+
+  m_usedScalars[scalar >> 6] &= ~(1ULL << (scalar & 63));
+  m_labelForScalar[scalar] = 0;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void LabelTable::clearSlabs()
+{
+  for (auto &slabs: m_slabs)
+  {
+    slabs = Slabs();
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void LabelTable::growSlabs(const LabelType label, const unsigned int axis, const unsigned int from, const unsigned int to)
+{
+  auto &slabs  = m_slabs[label];
+  auto &counts = slabs.counts[axis];
+
+  if (counts.empty())
+  {
+    slabs.origin[axis] = from;
+    counts.resize(to - from + 1, 0);
+    return;
+  }
+
+  if (from < slabs.origin[axis])
+  {
+    counts.insert(counts.begin(), slabs.origin[axis] - from, 0);
+    slabs.origin[axis] = from;
+  }
+
+  if (to >= slabs.origin[axis] + counts.size())
+  {
+    counts.resize(to - slabs.origin[axis] + 1, 0);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void LabelTable::addSlabsRun(const LabelType label, const unsigned int x, const unsigned int y, const unsigned int z, const unsigned int length)
+{
+  if (0 == length) return;
+
+  growSlabs(label, 0, x, x + length - 1);
+  growSlabs(label, 1, y, y);
+  growSlabs(label, 2, z, z);
+
+  auto &slabs = m_slabs[label];
+  auto xSlabs = slabs.counts[0].data() + (x - slabs.origin[0]);
+  for (unsigned int i = 0; i < length; ++i)
+  {
+    ++xSlabs[i];
+  }
+  slabs.counts[1][y - slabs.origin[1]] += length;
+  slabs.counts[2][z - slabs.origin[2]] += length;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void LabelTable::updateSlabs(const LabelType label, const unsigned int axis, const long long int *deltas, const unsigned int size)
+{
+  unsigned int first = 0;
+  while ((first < size) && (0 == deltas[first])) ++first;
+  if (first == size) return;
+
+  unsigned int last = size - 1;
+  while (0 == deltas[last]) --last;
+
+  growSlabs(label, axis, first, last);
+
+  auto &slabs  = m_slabs[label];
+  auto &counts = slabs.counts[axis];
+  for (auto i = first; i <= last; ++i)
+  {
+    Q_ASSERT(static_cast<long long int>(counts[i - slabs.origin[axis]]) + deltas[i] >= 0);
+    counts[i - slabs.origin[axis]] += deltas[i];
+  }
+
+  // trim the empty slabs at both ends, the remaining ones define the bounding box.
+  auto begin = std::find_if(counts.begin(), counts.end(), [](const unsigned long long int count) { return count != 0; });
+  if (begin == counts.end())
+  {
+    counts.clear();
+    return;
+  }
+
+  auto end = std::find_if(counts.rbegin(), counts.rend(), [](const unsigned long long int count) { return count != 0; }).base();
+  counts.erase(end, counts.end());
+  slabs.origin[axis] += std::distance(counts.begin(), begin);
+  counts.erase(counts.begin(), begin);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const bool LabelTable::slabsBoundingBox(const LabelType label, Vector3ui &min, Vector3ui &max) const
+{
+  auto &slabs = m_slabs[label];
+
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    if (slabs.counts[i].empty()) return false;
+
+    min[i] = slabs.origin[i];
+    max[i] = slabs.origin[i] + slabs.counts[i].size() - 1;
+  }
+
+  return true;
+}
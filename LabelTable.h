@@ -0,0 +1,260 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: LabelTable.h
+// Purpose: Contiguous table of label objects information (scalar, size, centroid, bounding box)
+// Notes: Labels are consecutive positions starting from 0 (background). Information is stored
+//        as parallel arrays indexed by label, with a reverse index from scalar to label and a
+//        bitmap of the used scalar values, or a hash map and an ordered set with 32 bit labels as
+//        the scalars can be very large and sparse. Each label keeps the number of voxels in each slab
+//        (plane perpendicular to an axis) of its bounding box so it can be shrunk exactly when
+//        voxels are removed.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _LABELTABLE_H_
+#define _LABELTABLE_H_
+
+// project includes
+#include "LabelType.h"
+#include "VectorSpaceAlgebra.h"
+
+// c++ includes
+#include <vector>
+
+#ifdef ESPINA_32BIT_LABELS
+#include <set>
+#include <unordered_map>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// LabelTable class
+//
+class LabelTable
+{
+  public:
+    struct ObjectInformation
+    {
+        LabelType              scalar;   /** original scalar value in the image loaded */
+        Vector3d               centroid; /** centroid of the object */
+        unsigned long long int size;     /** size of the object in voxels */
+        Vector3ui              min;      /** Bounding Box: min values */
+        Vector3ui              max;      /** Bounding Box: max values */
+
+        ObjectInformation()
+        : scalar{0}, centroid{Vector3d{0, 0, 0}}, size{0}, min{Vector3ui{0, 0, 0}}, max{Vector3ui{0, 0, 0}} {};
+    };
+
+    /** \brief LabelTable class constructor.
+     *
+     */
+    LabelTable();
+
+    /** \brief Removes all the labels of the table.
+     *
+     */
+    void clear();
+
+    /** \brief Returns the number of labels in the table, including the background label.
+     *
+     */
+    const unsigned int size() const;
+
+    /** \brief Returns true if the given label is in the table.
+     * \param[in] label label value.
+     *
+     */
+    const bool contains(const LabelType label) const;
+
+    /** \brief Sets the information of the given label. If the label is beyond the end of the
+     * table the table grows to hold it. The slab counts of the label are reset.
+     * \param[in] label label value.
+     * \param[in] object object information.
+     *
+     */
+    void insert(const LabelType label, const ObjectInformation &object);
+
+    /** \brief Removes the given label from the table. Only the last label of the table can be removed
+     * as labels are positions in the table.
+     * \param[in] label label value.
+     *
+     */
+    void erase(const LabelType label);
+
+    /** \brief Returns the information of the given label.
+     * \param[in] label label value.
+     *
+     */
+    ObjectInformation object(const LabelType label) const;
+
+    /** \brief Returns the scalar assigned to the given label.
+     * \param[in] label label value.
+     *
+     */
+    const LabelType scalar(const LabelType label) const
+    { return m_scalars[label]; }
+
+    /** \brief Returns the number of voxels of the given label.
+     * \param[in] label label value.
+     *
+     */
+    const unsigned long long int voxels(const LabelType label) const
+    { return m_sizes[label]; }
+
+    /** \brief Sets the number of voxels of the given label.
+     * \param[in] label label value.
+     * \param[in] voxels number of voxels.
+     *
+     */
+    void setVoxels(const LabelType label, const unsigned long long int voxels)
+    { m_sizes[label] = voxels; }
+
+    /** \brief Returns the centroid of the given label.
+     * \param[in] label label value.
+     *
+     */
+    Vector3d centroid(const LabelType label) const;
+
+    /** \brief Sets the centroid of the given label.
+     * \param[in] label label value.
+     * \param[in] centroid centroid coordinates.
+     *
+     */
+    void setCentroid(const LabelType label, const Vector3d &centroid);
+
+    /** \brief Returns the bounding box minimum values of the given label.
+     * \param[in] label label value.
+     *
+     */
+    Vector3ui min(const LabelType label) const;
+
+    /** \brief Returns the bounding box maximum values of the given label.
+     * \param[in] label label value.
+     *
+     */
+    Vector3ui max(const LabelType label) const;
+
+    /** \brief Sets the bounding box of the given label.
+     * \param[in] label label value.
+     * \param[in] min bounding box minimum values.
+     * \param[in] max bounding box maximum values.
+     *
+     */
+    void setBoundingBox(const LabelType label, const Vector3ui &min, const Vector3ui &max);
+
+    /** \brief Returns the label that has been assigned the given scalar or 0 if the scalar is not in use.
+     * \param[in] scalar scalar value.
+     *
+     */
+    const LabelType labelForScalar(const LabelType scalar) const
+#ifdef ESPINA_32BIT_LABELS
+    { auto it = m_labelForScalar.find(scalar); return (it != m_labelForScalar.end()) ? (*it).second : 0; }
+#else
+    { return (scalar < m_labelForScalar.size()) ? m_labelForScalar[scalar] : 0; }
+#endif
+
+    /** \brief Returns true if the scalar has been assigned to a label.
+     * \param[in] scalar scalar value.
+     *
+     */
+    const bool isScalarUsed(const LabelType scalar) const
+#ifdef ESPINA_32BIT_LABELS
+    { return (m_labelForScalar.find(scalar) != m_labelForScalar.end()); }
+#else
+    { return (scalar < m_labelForScalar.size()) && (0 != (m_usedScalars[scalar >> 6] & (1ULL << (scalar & 63)))); }
+#endif
+
+    /** \brief Returns the first unused scalar value equal or greater than the given one, or 0 if all
+     * the scalars in that range are in use (the background scalar is always in use).
+     * \param[in] scalar starting scalar value.
+     *
+     */
+    const LabelType firstFreeScalar(const LabelType scalar) const;
+
+    /** \brief Returns the greatest scalar value in use.
+     *
+     */
+    const LabelType lastUsedScalar() const;
+
+    /** \brief Removes the slab counts of all the labels.
+     *
+     */
+    void clearSlabs();
+
+    /** \brief Adds a run of voxels along the x axis to the slab counts of the given label.
+     * \param[in] label label value.
+     * \param[in] x x coordinate of the first voxel.
+     * \param[in] y y coordinate.
+     * \param[in] z z coordinate.
+     * \param[in] length number of voxels.
+     *
+     */
+    void addSlabsRun(const LabelType label, const unsigned int x, const unsigned int y, const unsigned int z, const unsigned int length);
+
+    /** \brief Adds the given variations to the slab counts of an axis of the given label.
+     * \param[in] label label value.
+     * \param[in] axis axis index.
+     * \param[in] deltas variation of the voxels of each slab, one value per coordinate of the axis.
+     * \param[in] size number of coordinates of the axis.
+     *
+     */
+    void updateSlabs(const LabelType label, const unsigned int axis, const long long int *deltas, const unsigned int size);
+
+    /** \brief Computes the exact bounding box of the given label from its slab counts. Returns false
+     * if the label doesn't have voxels.
+     * \param[in] label label value.
+     * \param[out] min bounding box minimum values.
+     * \param[out] max bounding box maximum values.
+     *
+     */
+    const bool slabsBoundingBox(const LabelType label, Vector3ui &min, Vector3ui &max) const;
+
+  private:
+    /** \brief Marks the scalar as used by the given label.
+     * \param[in] scalar scalar value.
+     * \param[in] label label value.
+     *
+     */
+    void useScalar(const LabelType scalar, const LabelType label);
+
+    /** \brief Marks the scalar as unused if it's assigned to the given label.
+     * \param[in] scalar scalar value.
+     * \param[in] label label value.
+     *
+     */
+    void releaseScalar(const LabelType scalar, const LabelType label);
+
+    /** \brief Grows the slabs of the given axis of the label to include the given coordinates.
+     * \param[in] label label value.
+     * \param[in] axis axis index.
+     * \param[in] from first coordinate.
+     * \param[in] to last coordinate.
+     *
+     */
+    void growSlabs(const LabelType label, const unsigned int axis, const unsigned int from, const unsigned int to);
+
+    struct Slabs
+    {
+        unsigned int                        origin[3]; /** coordinate of the first slab of each axis.       */
+        std::vector<unsigned long long int> counts[3]; /** number of voxels of each slab of each axis.      */
+
+        Slabs()
+        : origin{0, 0, 0} {};
+    };
+
+    std::vector<LabelType>              m_scalars;        /** scalar of each label.                               */
+    std::vector<unsigned long long int> m_sizes;          /** number of voxels of each label.                     */
+    std::vector<double>                 m_centroids;      /** centroid of each label, three values per label.     */
+    std::vector<unsigned int>           m_min;            /** bounding box min of each label, three per label.    */
+    std::vector<unsigned int>           m_max;            /** bounding box max of each label, three per label.    */
+    std::vector<Slabs>                  m_slabs;          /** slab counts of each label.                          */
+#ifdef ESPINA_32BIT_LABELS
+    std::unordered_map<LabelType, LabelType> m_labelForScalar; /** reverse index, label of each used scalar value. */
+    std::set<LabelType>                      m_usedScalars;    /** used scalar values, ordered.                   */
+#else
+    std::vector<LabelType>              m_labelForScalar; /** reverse index, label of each scalar value.          */
+    std::vector<unsigned long long int> m_usedScalars;    /** bitmap of used scalar values.                       */
+#endif
+};
+
+#endif // _LABELTABLE_H_
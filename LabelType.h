@@ -0,0 +1,20 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: LabelType.h
+// Purpose: Type of the label values of the segmentation volume
+// Notes: 16 bits by default, the ESPINA_32BIT_LABELS build option selects 32 bits for
+//        segmentations with more than 65535 objects at twice the memory per voxel.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _LABELTYPE_H_
+#define _LABELTYPE_H_
+
+#ifdef ESPINA_32BIT_LABELS
+  using LabelType = unsigned int;
+#else
+  using LabelType = unsigned short;
+#endif
+
+#endif // _LABELTYPE_H_
@@ -0,0 +1,165 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: LabelVoxels.h
+// Purpose: Access to voxels stored in 16 bits or in LabelType, chosen when the volume is loaded
+// Notes: With 32 bit labels the volumes with less than 65536 labels store their voxels in 16 bits
+//        and use half the memory. In the default build both types are the same.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _LABELVOXELS_H_
+#define _LABELVOXELS_H_
+
+// project includes
+#include "LabelType.h"
+
+// c++ includes
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+/** \brief Type of the voxels of the volumes whose labels fit in 16 bits.
+ *
+ */
+using NarrowLabelType = unsigned short;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// LabelVoxels class
+//
+class LabelVoxels
+{
+  public:
+    /** \brief LabelVoxels class constructor.
+     * \param[in] data first voxel.
+     * \param[in] narrow true if the voxels are stored as NarrowLabelType and false if as LabelType.
+     *
+     */
+    LabelVoxels(const void *data = nullptr, const bool narrow = true)
+    : m_data{const_cast<void *>(data)}, m_narrow{narrow} {};
+
+    /** \brief Returns true if the voxels of a volume with the given number of labels, including the
+     * background, can be stored as NarrowLabelType.
+     * \param[in] labels number of labels.
+     *
+     */
+    static const bool fitsNarrow(const unsigned long long int labels)
+    { return labels <= static_cast<unsigned long long int>(std::numeric_limits<NarrowLabelType>::max()) + 1; }
+
+    /** \brief Returns the size in bytes of a voxel.
+     * \param[in] narrow true if the voxels are stored as NarrowLabelType and false if as LabelType.
+     *
+     */
+    static const unsigned int voxelSize(const bool narrow)
+    { return narrow ? sizeof(NarrowLabelType) : sizeof(LabelType); }
+
+    /** \brief Returns true if the voxels are stored as NarrowLabelType.
+     *
+     */
+    const bool isNarrow() const
+    { return m_narrow; }
+
+    /** \brief Returns true if the pointer is null.
+     *
+     */
+    const bool isNull() const
+    { return m_data == nullptr; }
+
+    /** \brief Returns the pointer to the first voxel.
+     *
+     */
+    void *data() const
+    { return m_data; }
+
+    /** \brief Returns the voxels starting at the given one.
+     * \param[in] i voxel position.
+     *
+     */
+    LabelVoxels operator+(const unsigned long long int i) const
+    { return LabelVoxels(static_cast<char *>(m_data) + i * voxelSize(m_narrow), m_narrow); }
+
+    /** \brief Returns the value of the given voxel.
+     * \param[in] i voxel position.
+     *
+     */
+    LabelType operator[](const unsigned long long int i) const
+    { return m_narrow ? static_cast<const NarrowLabelType *>(m_data)[i] : static_cast<const LabelType *>(m_data)[i]; }
+
+    /** \brief Changes the value of the given voxel.
+     * \param[in] i voxel position.
+     * \param[in] value new value.
+     *
+     */
+    void set(const unsigned long long int i, const LabelType value) const
+    {
+      if (m_narrow)
+      {
+        static_cast<NarrowLabelType *>(m_data)[i] = static_cast<NarrowLabelType>(value);
+      }
+      else
+      {
+        static_cast<LabelType *>(m_data)[i] = value;
+      }
+    }
+
+    /** \brief Sets the given value to a number of voxels.
+     * \param[in] count number of voxels.
+     * \param[in] value new value.
+     *
+     */
+    void fill(const unsigned long long int count, const LabelType value) const
+    {
+      if (m_narrow)
+      {
+        std::fill(static_cast<NarrowLabelType *>(m_data), static_cast<NarrowLabelType *>(m_data) + count, static_cast<NarrowLabelType>(value));
+      }
+      else
+      {
+        std::fill(static_cast<LabelType *>(m_data), static_cast<LabelType *>(m_data) + count, value);
+      }
+    }
+
+    /** \brief Copies a number of voxels to the given buffer.
+     * \param[in] count number of voxels.
+     * \param[out] buffer destination buffer.
+     *
+     */
+    void read(const unsigned long long int count, LabelType *buffer) const
+    {
+      if (!m_narrow || (sizeof(NarrowLabelType) == sizeof(LabelType)))
+      {
+        std::memcpy(buffer, m_data, count * sizeof(LabelType));
+      }
+      else
+      {
+        std::copy(static_cast<const NarrowLabelType *>(m_data), static_cast<const NarrowLabelType *>(m_data) + count, buffer);
+      }
+    }
+
+    /** \brief Copies a number of voxels from the given buffer, the values must fit in the voxels.
+     * \param[in] count number of voxels.
+     * \param[in] buffer source buffer.
+     *
+     */
+    void write(const unsigned long long int count, const LabelType *buffer) const
+    {
+      if (!m_narrow || (sizeof(NarrowLabelType) == sizeof(LabelType)))
+      {
+        std::memcpy(m_data, buffer, count * sizeof(LabelType));
+      }
+      else
+      {
+        auto data = static_cast<NarrowLabelType *>(m_data);
+        for (unsigned long long int i = 0; i < count; ++i)
+        {
+          data[i] = static_cast<NarrowLabelType>(buffer[i]);
+        }
+      }
+    }
+
+  private:
+    void *m_data;   /** first voxel.                                     */
+    bool  m_narrow; /** true if the voxels are stored as NarrowLabelType. */
+};
+
+#endif // _LABELVOXELS_H_
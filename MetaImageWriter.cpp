@@ -0,0 +1,162 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: MetaImageWriter.cpp
+// Purpose: Writes a label volume to a compressed MetaImage file slab by slab
+// Notes: The itk writer can't stream compressed MetaImage files and needs the whole image in
+//        memory. The voxels are compressed to a temporary file first as the header must have the
+//        size of the compressed data.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// itk includes
+#include <itk_zlib.h>
+
+// project includes
+#include "MetaImageWriter.h"
+#include "BrickedVolume.h"
+
+// c++ includes
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// Qt
+#include <QFile>
+#include <QTemporaryFile>
+#include <QtGlobal>
+
+namespace
+{
+  const unsigned int CHUNK_SIZE = 1024 * 1024;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+MetaImageWriter::MetaImageWriter(const Vector3ui &dimensions, const Vector3d &spacing, const Vector3d &origin, Source source)
+: m_dimensions{dimensions}
+, m_spacing   {spacing}
+, m_origin    {origin}
+, m_source    {source}
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool MetaImageWriter::write(const QString &filename, std::function<void(const int)> progress)
+{
+  QTemporaryFile data(filename + QString("-XXXXXX"));
+  if (!data.open())
+  {
+    m_error = QString("couldn't create the temporary file - ") + data.errorString();
+    return false;
+  }
+
+  z_stream stream;
+  std::memset(&stream, 0, sizeof(z_stream));
+  if (Z_OK != deflateInit(&stream, Z_DEFAULT_COMPRESSION))
+  {
+    m_error = QString("couldn't initialize the compression");
+    return false;
+  }
+
+  const auto slice = static_cast<unsigned long long int>(m_dimensions[0]) * m_dimensions[1];
+  const auto slabs = (m_dimensions[2] + BrickedVolume::BRICK_SIZE - 1) / BrickedVolume::BRICK_SIZE;
+
+  std::vector<LabelType> buffer(slice * std::min(BrickedVolume::BRICK_SIZE, m_dimensions[2]));
+  std::vector<unsigned char> compressed(CHUNK_SIZE);
+
+  bool failed = false;
+  for (unsigned int slab = 0; !failed && slab < slabs; ++slab)
+  {
+    auto min = Vector3ui{0u, 0u, slab * BrickedVolume::BRICK_SIZE};
+    auto max = Vector3ui{m_dimensions[0] - 1, m_dimensions[1] - 1, std::min(min[2] + BrickedVolume::BRICK_SIZE, m_dimensions[2]) - 1};
+    m_source(min, max, buffer.data());
+
+    auto input = reinterpret_cast<unsigned char *>(buffer.data());
+    auto remaining = slice * (max[2] - min[2] + 1) * sizeof(LabelType);
+
+    // the input is given in chunks as the stream counts the bytes in 32 bits.
+    do
+    {
+      auto length = std::min<unsigned long long int>(remaining, CHUNK_SIZE);
+      stream.next_in  = input;
+      stream.avail_in = static_cast<uInt>(length);
+      input     += length;
+      remaining -= length;
+
+      auto flush = ((slab + 1 == slabs) && (0 == remaining)) ? Z_FINISH : Z_NO_FLUSH;
+      do
+      {
+        stream.next_out  = compressed.data();
+        stream.avail_out = CHUNK_SIZE;
+        deflate(&stream, flush);
+
+        auto bytes = static_cast<qint64>(CHUNK_SIZE - stream.avail_out);
+        if (data.write(reinterpret_cast<const char *>(compressed.data()), bytes) != bytes)
+        {
+          failed = true;
+          break;
+        }
+      }
+      while (0 == stream.avail_out);
+    }
+    while (!failed && (0 != remaining));
+
+    if (progress) progress((90 * (slab + 1)) / slabs);
+  }
+  deflateEnd(&stream);
+
+  if (failed)
+  {
+    m_error = QString("couldn't write the temporary file - ") + data.errorString();
+    return false;
+  }
+
+  QFile file(filename);
+  if (!file.open(QIODevice::WriteOnly|QIODevice::Truncate) || (-1 == file.write(header(data.size()).toLatin1())) || !data.seek(0))
+  {
+    m_error = QString("couldn't write the file - ") + file.errorString();
+    return false;
+  }
+
+  // the compressed voxels are copied after the header.
+  while (!data.atEnd())
+  {
+    auto bytes = data.read(reinterpret_cast<char *>(compressed.data()), CHUNK_SIZE);
+    if ((bytes <= 0) || (file.write(reinterpret_cast<const char *>(compressed.data()), bytes) != bytes))
+    {
+      m_error = QString("couldn't write the file - ") + file.errorString();
+      return false;
+    }
+  }
+
+  if (progress) progress(100);
+
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+QString MetaImageWriter::header(const long long int compressedSize) const
+{
+  auto triplet = [](const double x, const double y, const double z)
+  {
+    return QString("%1 %2 %3").arg(x, 0, 'g', 16).arg(y, 0, 'g', 16).arg(z, 0, 'g', 16);
+  };
+
+  QString text;
+  text += QString("ObjectType = Image\n");
+  text += QString("NDims = 3\n");
+  text += QString("BinaryData = True\n");
+  text += QString("BinaryDataByteOrderMSB = %1\n").arg((Q_BYTE_ORDER == Q_BIG_ENDIAN) ? "True" : "False");
+  text += QString("CompressedData = True\n");
+  text += QString("CompressedDataSize = %1\n").arg(compressedSize);
+  text += QString("TransformMatrix = 1 0 0 0 1 0 0 0 1\n");
+  text += QString("Offset = %1\n").arg(triplet(m_origin[0], m_origin[1], m_origin[2]));
+  text += QString("CenterOfRotation = 0 0 0\n");
+  text += QString("AnatomicalOrientation = RAI\n");
+  text += QString("ElementSpacing = %1\n").arg(triplet(m_spacing[0], m_spacing[1], m_spacing[2]));
+  text += QString("DimSize = %1 %2 %3\n").arg(m_dimensions[0]).arg(m_dimensions[1]).arg(m_dimensions[2]);
+  text += QString("ElementType = %1\n").arg((sizeof(LabelType) == sizeof(unsigned short)) ? "MET_USHORT" : "MET_UINT");
+  text += QString("ElementDataFile = LOCAL\n");
+
+  return text;
+}
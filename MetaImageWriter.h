@@ -0,0 +1,74 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: MetaImageWriter.h
+// Purpose: Writes a label volume to a compressed MetaImage file slab by slab
+// Notes: The itk writer can't stream compressed MetaImage files and needs the whole image in
+//        memory. The voxels are compressed to a temporary file first as the header must have the
+//        size of the compressed data.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _METAIMAGEWRITER_H_
+#define _METAIMAGEWRITER_H_
+
+// project includes
+#include "LabelType.h"
+#include "VectorSpaceAlgebra.h"
+
+// c++ includes
+#include <functional>
+
+// Qt
+#include <QString>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// MetaImageWriter class
+//
+class MetaImageWriter
+{
+  public:
+    /** \brief Function that copies the voxels of a region (inclusive bounds) to a buffer, x varying
+     * fastest.
+     *
+     */
+    using Source = std::function<void(const Vector3ui &min, const Vector3ui &max, LabelType *buffer)>;
+
+    /** \brief MetaImageWriter class constructor.
+     * \param[in] dimensions volume dimensions.
+     * \param[in] spacing volume spacing.
+     * \param[in] origin volume origin.
+     * \param[in] source reader of the voxels of the volume.
+     *
+     */
+    MetaImageWriter(const Vector3ui &dimensions, const Vector3d &spacing, const Vector3d &origin, Source source);
+
+    /** \brief Writes the volume to the given file reading it in slabs of BrickedVolume::BRICK_SIZE
+     * slices. Returns false on error, see errorString().
+     * \param[in] filename file name.
+     * \param[in] progress called with the progress of the writing in [0, 100], can be null.
+     *
+     */
+    bool write(const QString &filename, std::function<void(const int)> progress = nullptr);
+
+    /** \brief Returns the description of the last error.
+     *
+     */
+    const QString &errorString() const
+    { return m_error; }
+
+  private:
+    /** \brief Returns the MetaImage header of the volume.
+     * \param[in] compressedSize size in bytes of the compressed voxels.
+     *
+     */
+    QString header(const long long int compressedSize) const;
+
+    Vector3ui m_dimensions; /** volume dimensions.                 */
+    Vector3d  m_spacing;    /** volume spacing.                    */
+    Vector3d  m_origin;     /** volume origin.                     */
+    Source    m_source;     /** reader of the voxels of the volume. */
+    QString   m_error;      /** description of the last error.     */
+};
+
+#endif // _METAIMAGEWRITER_H_
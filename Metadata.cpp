@@ -11,6 +11,9 @@
 #include <QTextStream>
 #include <QRegExp>
 
+// c++ includes
+#include <algorithm>
+
 // project includes
 #include "Metadata.h"
 #include "DataManager.h"
@@ -234,7 +237,7 @@ void Metadata::setUnassignedTagPosition(const unsigned int position)
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-std::string Metadata::objectSegmentName(const unsigned short objectNum) const
+std::string Metadata::objectSegmentName(const LabelType objectNum) const
 {
   if (objectNum > ObjectVector.size()) return std::string("Unassigned");
 
@@ -243,7 +246,7 @@ std::string Metadata::objectSegmentName(const unsigned short objectNum) const
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-bool Metadata::markAsUsed(const unsigned short label)
+bool Metadata::markAsUsed(const LabelType label)
 {
   for (auto it: ObjectVector)
   {
@@ -292,7 +295,19 @@ QList<unsigned int> Metadata::unusedLabels()
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-unsigned short Metadata::objectScalar(const unsigned short label) const
+unsigned int Metadata::maximumScalar() const
+{
+  unsigned int scalar = 0;
+  for (auto object: ObjectVector)
+  {
+    scalar = std::max(scalar, object->scalar);
+  }
+
+  return scalar;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+LabelType Metadata::objectScalar(const LabelType label) const
 {
   // vector index goes 0->(n-1)
   return ObjectVector[label - 1]->scalar;
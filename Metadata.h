@@ -21,6 +21,7 @@
 #include <QColor>
 
 // project includes
+#include "LabelType.h"
 #include "VectorSpaceAlgebra.h"
 
 class DataManager;
@@ -57,13 +58,13 @@ class Metadata
      * \param[in] objectNum object number.
      *
      */
-    std::string objectSegmentName(unsigned short objectNum) const;
+    std::string objectSegmentName(LabelType objectNum) const;
 
     /** \brief Returns the segment scalar.
      * \param[in] objectNum object number.
      *
      */
-    unsigned short objectScalar(unsigned short objectNum) const;
+    LabelType objectScalar(LabelType objectNum) const;
 
     /** \brief Compact object vector deleting unused objects and storing them into UnusedObjects vector.
      *
@@ -74,13 +75,18 @@ class Metadata
      * \param[in] objectNum object number.
      *
      */
-    bool markAsUsed(unsigned short objectNum);
+    bool markAsUsed(LabelType objectNum);
 
     /** \brief Returns a vector containing unused objects.
      *
      */
     QList<unsigned int> unusedLabels();
 
+    /** \brief Returns the greatest scalar value of the objects.
+     *
+     */
+    unsigned int maximumScalar() const;
+
     friend class SaveSessionThread;
     friend class EspinaVolumeEditor;
   private:
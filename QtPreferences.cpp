@@ -38,7 +38,8 @@ void QtPreferences::SetInitialOptions(const unsigned long int size,
                                       const int               opacity,
                                       const unsigned int      saveTime,
                                       bool                    saveEnabled,
-                                      const unsigned int      paintRadius)
+                                      const unsigned int      paintRadius,
+                                      const bool              mappedStorage)
 {
   m_undoSize       = size;
   m_undoCapacity   = capacity;
@@ -53,6 +54,8 @@ void QtPreferences::SetInitialOptions(const unsigned long int size,
     saveSessionBox->setChecked(false);
   }
 
+  mappedStorageBox->setChecked(mappedStorage);
+
   capacityBar   ->setValue(static_cast<int>((static_cast<float>(m_undoCapacity) / static_cast<float>(m_undoSize)) * 100.0));
   sizeBox       ->setValue(static_cast<int>(m_undoSize / (1024 * 1024)));
   radiusBox     ->setValue(m_filtersRadius);
@@ -167,3 +170,9 @@ unsigned int QtPreferences::brushRadius() const
 {
   return m_brushRadius;
 }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool QtPreferences::isMappedStorageEnabled() const
+{
+  return mappedStorageBox->isChecked();
+}
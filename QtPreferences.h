@@ -43,6 +43,7 @@ class QtPreferences
      * \param[in] saveTime auto-save time interval in minutes.
      * \param[in] saveEnabled true to enable auto-save feature.
      * \param[in] paintRadius paint disk radius value.
+     * \param[in] mappedStorage true to enable memory mapped storage of the segmentation.
      *
      */
     void SetInitialOptions(const unsigned long int size,
@@ -52,7 +53,8 @@ class QtPreferences
                            const int               opacity,
                            const unsigned int      saveTime,
                            const bool              saveEnabled,
-                           const unsigned int      paintRadius);
+                           const unsigned int      paintRadius,
+                           const bool              mappedStorage);
 
     /** \brief Returns the size of the undo/redo system.
      *
@@ -98,6 +100,11 @@ class QtPreferences
      *
      */
     unsigned int brushRadius() const;
+
+    /** \brief Returns true if the memory mapped storage of the segmentation is enabled.
+     *
+     */
+    bool isMappedStorageEnabled() const;
   public slots:
     // slots for signals
     virtual void SelectSize(int);
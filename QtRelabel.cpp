@@ -32,7 +32,7 @@ QtRelabel::QtRelabel(QWidget *parent, Qt::WindowFlags f)
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void QtRelabel::setInitialOptions(const std::set<unsigned short> labels, std::shared_ptr<Metadata> data, std::shared_ptr<DataManager> dataManager)
+void QtRelabel::setInitialOptions(const std::set<LabelType> labels, std::shared_ptr<Metadata> data, std::shared_ptr<DataManager> dataManager)
 {
   newlabelbox->setSelectionMode(QAbstractItemView::SingleSelection);
   m_maxcolors = dataManager->GetNumberOfLabels();
@@ -99,9 +99,9 @@ bool QtRelabel::isModified() const
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-const unsigned short QtRelabel::selectedLabel() const
+const LabelType QtRelabel::selectedLabel() const
 {
-  return static_cast<unsigned short int>(newlabelbox->currentRow());
+  return static_cast<LabelType>(newlabelbox->currentRow());
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
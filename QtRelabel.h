@@ -44,12 +44,12 @@ class QtRelabel
      * \param[in] dataManager session data manager.
      *
      */
-    void setInitialOptions(const std::set<unsigned short> labels, std::shared_ptr<Metadata> data, std::shared_ptr<DataManager> dataManager);
+    void setInitialOptions(const std::set<LabelType> labels, std::shared_ptr<Metadata> data, std::shared_ptr<DataManager> dataManager);
 
     /** \brief Returns the selected label in the combobox.
      *
      */
-    const unsigned short selectedLabel() const;
+    const LabelType selectedLabel() const;
 
     /** \brief Returns true if it's a new label.
      *
@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: QtUndoHistory.cpp
+// Purpose: shows the actions of the undo/redo buffers and the memory they use
+// Notes:
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Qt includes
+#include "QtUndoHistory.h"
+
+namespace
+{
+  /** \brief Returns the size in bytes as text in the most suitable unit.
+   *
+   */
+  QString sizeText(const unsigned long long int bytes)
+  {
+    if (bytes >= 1024 * 1024) return QString("%1 MB").arg(bytes / (1024.0 * 1024.0), 0, 'f', 2);
+    if (bytes >= 1024)        return QString("%1 KB").arg(bytes / 1024.0, 0, 'f', 2);
+
+    return QString("%1 bytes").arg(bytes);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// QtUndoHistory class
+//
+QtUndoHistory::QtUndoHistory(QWidget *parent, Qt::WindowFlags f)
+: QDialog{parent, f}
+{
+  setupUi(this);
+
+  // want to make the dialog appear centered
+  move(parent->geometry().center() - rect().center());
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void QtUndoHistory::SetActions(const std::vector<DataManager::ActionInformation> &undo, const std::vector<DataManager::ActionInformation> &redo)
+{
+  actionsTable->setRowCount(0);
+
+  // redo actions are shown above the undo ones, the farthest first.
+  addActions(std::vector<DataManager::ActionInformation>(redo.rbegin(), redo.rend()), tr("Redo"));
+  addActions(undo, tr("Undo"));
+
+  actionsTable->resizeColumnsToContents();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void QtUndoHistory::addActions(const std::vector<DataManager::ActionInformation> &actions, const QString &buffer)
+{
+  for (auto &action: actions)
+  {
+    auto row = actionsTable->rowCount();
+    actionsTable->insertRow(row);
+
+    actionsTable->setItem(row, 0, new QTableWidgetItem(buffer));
+    actionsTable->setItem(row, 1, new QTableWidgetItem(QString::fromStdString(action.description)));
+    actionsTable->setItem(row, 2, new QTableWidgetItem(action.region ? tr("Compressed region") : tr("Voxel list")));
+    actionsTable->setItem(row, 3, new QTableWidgetItem(QString::number(action.voxels)));
+    actionsTable->setItem(row, 4, new QTableWidgetItem(sizeText(action.memory)));
+    actionsTable->setItem(row, 5, new QTableWidgetItem(action.spilled == 0 ? QString("-") : sizeText(action.spilled)));
+
+    for (int column = 3; column < actionsTable->columnCount(); ++column)
+    {
+      actionsTable->item(row, column)->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void QtUndoHistory::SetBufferUsage(const unsigned long int used, const unsigned long int size)
+{
+  usageLabel->setText(tr("Memory used: %1 of %2").arg(sizeText(used)).arg(sizeText(size)));
+}
@@ -0,0 +1,60 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: QtUndoHistory.h
+// Purpose: shows the actions of the undo/redo buffers and the memory they use
+// Notes:
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _QTUNDOHISTORY_H_
+#define _QTUNDOHISTORY_H_
+
+// Qt includes
+#include <QtGui>
+#include "ui_QtUndoHistory.h"
+
+// project includes
+#include "DataManager.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// QtUndoHistory class
+//
+class QtUndoHistory
+: public QDialog
+, private Ui_UndoHistory
+{
+  Q_OBJECT
+
+  public:
+    /** \brief QtUndoHistory class constructor.
+     * \param[in] parent pointer to the QWidget parent of this one.
+     * \param[in] f window flags.
+     *
+     */
+    QtUndoHistory(QWidget *parent = nullptr, Qt::WindowFlags f = Qt::Dialog);
+
+    /** \brief Sets the actions of the undo and redo buffers.
+     * \param[in] undo undo actions, from the next one to be undone.
+     * \param[in] redo redo actions, from the next one to be redone.
+     *
+     */
+    void SetActions(const std::vector<DataManager::ActionInformation> &undo, const std::vector<DataManager::ActionInformation> &redo);
+
+    /** \brief Sets the memory used by the undo/redo buffers.
+     * \param[in] used used bytes.
+     * \param[in] size size of the buffers in bytes.
+     *
+     */
+    void SetBufferUsage(const unsigned long int used, const unsigned long int size);
+
+  private:
+    /** \brief Adds the actions to the table.
+     * \param[in] actions actions information.
+     * \param[in] buffer buffer name.
+     *
+     */
+    void addActions(const std::vector<DataManager::ActionInformation> &actions, const QString &buffer);
+};
+
+#endif // _QTUNDOHISTORY_H_
@@ -16,16 +16,14 @@
 
 // itk includes
 #include <itkSmartPointer.h>
-#include <itkImageFileWriter.h>
-#include <itkMetaImageIO.h>
 
 // project includes
 #include "SaveSession.h"
 #include "DataManager.h"
 #include "Metadata.h"
+#include "MetaImageWriter.h"
 #include <fstream>
-
-using WriterType = itk::ImageFileWriter<ImageType>;
+#include <sstream>
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // SaveSessionThread class
@@ -49,10 +47,7 @@ void SaveSessionThread::run()
   std::string baseFilename = homedir + std::string("/.espinaeditor-") + username;
   std::string temporalFilename = baseFilename + std::string(".session");
   std::string temporalFilenameMHA = baseFilename + std::string(".mha");
-
-  // needed to save the program state in the right moment so we wait for the lock to be open. Grab the lock and notify of action.
-  QMutexLocker locker(&(m_editor->m_mutex));
-  emit startedSaving();
+  std::string temporalFilenameUndo = baseFilename + std::string(".undo");
 
   QFile file(QString(temporalFilename.c_str()));
   if(file.exists() && !file.remove())
@@ -78,30 +73,140 @@ void SaveSessionThread::run()
     return;
   }
 
-  auto image = ImageType::New();
-  image = m_editor->m_editorOperations->m_selection->itkImage();
+  // needed to save the program state in the right moment so we wait for the lock to be open. Grab the lock only
+  // to take a snapshot of the image and the session data, the user can keep editing while they are written.
+  std::shared_ptr<VolumeSnapshot> snapshot;
+  std::ostringstream session;
+  std::set<LabelType> labelScalars;
+  {
+    QMutexLocker locker(&(m_editor->m_mutex));
+    emit startedSaving();
+
+    snapshot = m_editor->m_dataManager->CreateSnapshot();
+
+    // only the undo actions added since the last save are appended to the journal.
+    m_editor->m_dataManager->SaveActionsJournal(QString(temporalFilenameUndo.c_str()));
+
+    // dump all relevant data and objects to file, first the size of the std::map or std::vector, the objects
+    // themselves and also all the relevant data.
+    // the order:
+    //    - EspinaEditor relevant data: POI and file names...
+    //    - metadata ObjectMetadata
+    //    - metadata CountingBrickMetadata
+    //    - metadata SegmentMetadata
+    //    - metadata relevant data: hasUnassignedTag, unassignedTadPosition
+    //    - datamanager ObjectInformation
+    // in the editor we must follow the same order while loading this data, obviously...
+
+    // EspinaEditor relevant data
+    auto size = m_editor->m_segmentationFileName.size();
+    write(session, size);
+    session << m_editor->m_segmentationFileName.toStdString();
+
+    write(session, m_editor->m_hasReferenceImage);
+    if (m_editor->m_hasReferenceImage)
+    {
+      size = m_editor->m_referenceFileName.size();
+      write(session, size);
+      session << m_editor->m_referenceFileName.toStdString();
+    }
+
+    write(session, m_editor->m_POI[0]);
+    write(session, m_editor->m_POI[1]);
+    write(session, m_editor->m_POI[2]);
+
+    // Metadata::ObjectMetadata std::vector dump
+    size = m_editor->m_fileMetadata->ObjectVector.size();
+    write(session, size);
+
+    for (auto it: m_editor->m_fileMetadata->ObjectVector)
+    {
+      write(session, it->scalar);
+      write(session, it->segment);
+      write(session, it->selected);
+      // we could write the whole structure just by doing write(session, object) but i don't want to write down the
+      // "used" bool field, i already know it's true
+    }
+
+    // Metadata::CountingBrickMetadata std::vector dump
+    size = m_editor->m_fileMetadata->CountingBrickVector.size();
+    write(session, size);
+
+    for (auto it: m_editor->m_fileMetadata->CountingBrickVector)
+    {
+      write(session, it->inclusive[0]);
+      write(session, it->inclusive[1]);
+      write(session, it->inclusive[2]);
+      write(session, it->exclusive[0]);
+      write(session, it->exclusive[1]);
+      write(session, it->exclusive[2]);
+    }
+
+    // Metadata::SegmentMetadata std::vector dump
+    size = m_editor->m_fileMetadata->SegmentVector.size();
+    write(session, size);
+
+    for (auto it: m_editor->m_fileMetadata->SegmentVector)
+    {
+      write(session, it->color.red());
+      write(session, it->color.green());
+      write(session, it->color.blue());
+      write(session, it->value);
+      size = it->name.size();
+      write(session, size);
+      session << it->name;
+    }
+
+    // Metadata relevant data
+    write(session, m_editor->m_fileMetadata->hasUnassignedTag);
+    write(session, m_editor->m_fileMetadata->unassignedTagPosition);
+
+    // DataManager::ObjectInformation label table dump
+    auto &labelTable = m_editor->m_dataManager->m_labelTable;
+    write(session, static_cast<LabelType>(labelTable.size()));
+
+    for (unsigned int position = 0; position < labelTable.size(); ++position)
+    {
+      auto object = labelTable.object(position);
+      write(session, static_cast<LabelType>(position));
+      write(session, object.scalar);
+      write(session, object.size);
+      write(session, object.centroid[0]);
+      write(session, object.centroid[1]);
+      write(session, object.centroid[2]);
+      write(session, object.min[0]);
+      write(session, object.min[1]);
+      write(session, object.min[2]);
+      write(session, object.max[0]);
+      write(session, object.max[1]);
+      write(session, object.max[2]);
+    }
+
+    for (auto it: m_editor->m_dataManager->GetSelectedLabelsSet())
+    {
+      labelScalars.insert(m_editor->m_dataManager->GetScalarForLabel(it));
+    }
+  }
 
-  // save as an mha
-  auto io = itk::MetaImageIO::New();
-  io->SetFileName(temporalFilenameMHA.c_str());
+  // the voxels written by the user from now on are read from the copies of the snapshot. The
+  // image is written slab by slab from the snapshot.
+  auto view = snapshot.get();
+  auto source = [view](const Vector3ui &min, const Vector3ui &max, LabelType *buffer)
+  {
+    view->copyRegion(min, max, buffer);
+  };
 
-  auto writer = WriterType::New();
-  writer->SetImageIO(io);
-  writer->SetFileName(temporalFilenameMHA.c_str());
-  writer->SetInput(image);
-  writer->UseCompressionOn();
+  MetaImageWriter writer(snapshot->dimensions(), snapshot->spacing(), snapshot->origin(), source);
+  auto written = writer.write(QString(temporalFilenameMHA.c_str()), [this](const int value) { emit progress(value / 2); });
+  snapshot = nullptr;
 
-  try
-  {
-    writer->Write();
-  }
-  catch (itk::ExceptionObject &excp)
+  if (!written)
   {
     QMessageBox msgBox;
     msgBox.setWindowTitle("Error saving session");
     msgBox.setIcon(QMessageBox::Critical);
     msgBox.setText("An error occurred saving the editor MHA session file.\nThe operation has been aborted.");
-    msgBox.setDetailedText(excp.what());
+    msgBox.setDetailedText(writer.errorString());
     msgBox.exec();
     return;
   }
@@ -122,101 +227,7 @@ void SaveSessionThread::run()
     return;
   }
 
-  // dump all relevant data and objects to file, first the size of the std::map or std::vector, the objects
-  // themselves and also all the relevant data.
-  // the order:
-  //    - EspinaEditor relevant data: POI and file names...
-  //    - metadata ObjectMetadata
-  //    - metadata CountingBrickMetadata
-  //    - metadata SegmentMetadata
-  //    - metadata relevant data: hasUnassignedTag, unassignedTadPosition
-  //    - datamanager ObjectInformation
-  // in the editor we must follow the same order while loading this data, obviously...
-
-  // EspinaEditor relevant data
-  auto size = m_editor->m_segmentationFileName.size();
-  write(outfile, size);
-  outfile << m_editor->m_segmentationFileName.toStdString();
-
-  write(outfile, m_editor->m_hasReferenceImage);
-  if (m_editor->m_hasReferenceImage)
-  {
-    size = m_editor->m_referenceFileName.size();
-    write(outfile, size);
-    outfile << m_editor->m_referenceFileName.toStdString();
-  }
-
-  write(outfile, m_editor->m_POI[0]);
-  write(outfile, m_editor->m_POI[1]);
-  write(outfile, m_editor->m_POI[2]);
-
-  // Metadata::ObjectMetadata std::vector dump
-  size = m_editor->m_fileMetadata->ObjectVector.size();
-  write(outfile, size);
-
-  for (auto it: m_editor->m_fileMetadata->ObjectVector)
-  {
-    write(outfile, it->scalar);
-    write(outfile, it->segment);
-    write(outfile, it->selected);
-    // we could write the whole structure just by doing write(outfile, object) but i don't want to write down the
-    // "used" bool field, i already know it's true
-  }
-
-  // Metadata::CountingBrickMetadata std::vector dump
-  size = m_editor->m_fileMetadata->CountingBrickVector.size();
-  write(outfile, size);
-
-  for (auto it: m_editor->m_fileMetadata->CountingBrickVector)
-  {
-    write(outfile, it->inclusive[0]);
-    write(outfile, it->inclusive[1]);
-    write(outfile, it->inclusive[2]);
-    write(outfile, it->exclusive[0]);
-    write(outfile, it->exclusive[1]);
-    write(outfile, it->exclusive[2]);
-  }
-
-  // Metadata::SegmentMetadata std::vector dump
-  size = m_editor->m_fileMetadata->SegmentVector.size();
-  write(outfile, size);
-
-  for (auto it: m_editor->m_fileMetadata->SegmentVector)
-  {
-    write(outfile, it->color.red());
-    write(outfile, it->color.green());
-    write(outfile, it->color.blue());
-    write(outfile, it->value);
-    size = it->name.size();
-    write(outfile, size);
-    outfile << it->name;
-  }
-
-  // Metadata relevant data
-  write(outfile, m_editor->m_fileMetadata->hasUnassignedTag);
-  write(outfile, m_editor->m_fileMetadata->unassignedTagPosition);
-
-  // DataManager::ObjectInformation std::map dump
-  size = m_editor->m_dataManager->ObjectVector.size();
-  write(outfile, size);
-
-  for (auto it: m_editor->m_dataManager->ObjectVector)
-  {
-    unsigned short int position = it.first;
-    write(outfile, position);
-    write(outfile, it.second->scalar);
-    write(outfile, it.second->size);
-    write(outfile, it.second->centroid[0]);
-    write(outfile, it.second->centroid[1]);
-    write(outfile, it.second->centroid[2]);
-    write(outfile, it.second->min[0]);
-    write(outfile, it.second->min[1]);
-    write(outfile, it.second->min[2]);
-    write(outfile, it.second->max[0]);
-    write(outfile, it.second->max[1]);
-    write(outfile, it.second->max[2]);
-  }
-
+  outfile << session.str();
   outfile.close();
   emit progress(100);
 
@@ -226,14 +237,6 @@ void SaveSessionThread::run()
   filename.replace(QChar('/'), QChar('\\'));
   editorSettings.beginGroup("Editor");
 
-  std::set<unsigned short> labelIndexes = m_editor->m_dataManager->GetSelectedLabelsSet();
-  std::set<unsigned short> labelScalars;
-
-  for (auto it: labelIndexes)
-  {
-    labelScalars.insert(m_editor->m_dataManager->GetScalarForLabel(it));
-  }
-
   QList<QVariant> labelList;
   for (auto it: labelScalars)
   {
@@ -47,7 +47,7 @@ class SaveSessionThread
 		/** \brief Helper method to write to a stream.
 		 *
 		 */
-		template<typename T>void write(std::ofstream& out, T t)
+		template<typename T>void write(std::ostream& out, T t)
 		{
 			out.write(reinterpret_cast<char*>(&t), sizeof(T));
 		}
@@ -32,7 +32,6 @@
 #include <itkConnectedThresholdImageFilter.h>
 #include <itkVTKImageExport.h>
 #include <itkImageRegionConstIteratorWithIndex.h>
-#include <itkImageDuplicator.h>
 
 // project includes
 #include "Selection.h"
@@ -49,8 +48,6 @@
 
 using ConnectedThresholdFilterType = itk::ConnectedThresholdImageFilter<ImageType, ImageTypeUC>;
 using ITKExport = itk::VTKImageExport<ImageTypeUC>;
-using ITKImport = itk::VTKImageImport<ImageType>;
-using DuplicatorType = itk::ImageDuplicator<ImageType>;
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // Selection class
@@ -452,46 +449,16 @@ void Selection::addArea(const Vector3ui &point)
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-itk::SmartPointer<ImageType> Selection::segmentationItkImage(const unsigned short label) const
+itk::SmartPointer<ImageType> Selection::segmentationItkImage(const LabelType label) const
 {
-  auto objectMin = m_dataManager->GetBoundingBoxMin(label);
-  auto objectMax = m_dataManager->GetBoundingBoxMax(label);
-
-  // first crop the region and then use the vtk-itk pipeline to get a itk::Image of the region
-  auto imageClip = vtkSmartPointer<vtkImageClip>::New();
-  imageClip->SetInputData(m_dataManager->GetStructuredPoints());
-  imageClip->SetOutputWholeExtent(objectMin[0], objectMax[0], objectMin[1], objectMax[1], objectMin[2], objectMax[2]);
-  imageClip->ClipDataOn();
-  imageClip->Update();
-
-  auto itkImport = ITKImport::New();
-  auto vtkExport = vtkSmartPointer<vtkImageExport>::New();
-  vtkExport->SetInputData(imageClip->GetOutput());
-  ConnectPipelines(vtkExport, itkImport);
-  itkImport->Update();
-
-  // need to duplicate the output, or it will be destroyed when the pipeline goes
-  // out of scope, and register it to increase the reference count to return the image.
-  auto duplicator = DuplicatorType::New();
-  duplicator->SetInputImage(itkImport->GetOutput());
-  duplicator->Update();
-
-  auto image = ImageType::New();
-  image = duplicator->GetOutput();
-  image->Register();
-
-  return image;
+  return m_dataManager->GetItkImage(m_dataManager->GetBoundingBoxMin(label), m_dataManager->GetBoundingBoxMax(label));
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-itk::SmartPointer<ImageType> Selection::itkImage(const unsigned short label, const unsigned int boundsGrow) const
+itk::SmartPointer<ImageType> Selection::itkImage(const LabelType label, const unsigned int boundsGrow) const
 {
   Vector3ui objectMin, objectMax;
 
-  // first crop the region and then use the vtk-itk pipeline to get a itk::Image of the region
-  auto imageClip = vtkSmartPointer<vtkImageClip>::New();
-  imageClip->SetInputData(m_dataManager->GetStructuredPoints());
-
   switch (m_selectionType)
   {
     case Type::EMPTY:
@@ -560,49 +527,14 @@ itk::SmartPointer<ImageType> Selection::itkImage(const unsigned short label, con
     objectMax[2] += boundsGrow;
   }
 
-  imageClip->SetOutputWholeExtent(objectMin[0], objectMax[0], objectMin[1], objectMax[1], objectMin[2], objectMax[2]);
-  imageClip->ClipDataOn();
-  imageClip->Update();
-
-  auto itkImport = ITKImport::New();
-  auto vtkExport = vtkSmartPointer<vtkImageExport>::New();
-  vtkExport->SetInputData(imageClip->GetOutput());
-  ConnectPipelines(vtkExport, itkImport);
-  itkImport->Update();
-
-  // need to duplicate the output, or it will be destroyed when the pipeline goes
-  // out of scope, and register it to increase the reference count to return the image.
-  auto duplicator = DuplicatorType::New();
-  duplicator->SetInputImage(itkImport->GetOutput());
-  duplicator->Update();
-
-  auto image = ImageType::New();
-  image = duplicator->GetOutput();
-  image->Register();
-
-  return image;
+  // the region is clipped to the image extent by the data manager.
+  return m_dataManager->GetItkImage(objectMin, objectMax);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 itk::SmartPointer<ImageType> Selection::itkImage() const
 {
-  auto itkImport = ITKImport::New();
-  auto vtkExport = vtkSmartPointer<vtkImageExport>::New();
-  vtkExport->SetInputData(m_dataManager->GetStructuredPoints());
-  ConnectPipelines(vtkExport, itkImport);
-  itkImport->Update();
-
-  // need to duplicate the output, or it will be destroyed when the pipeline goes
-  // out of scope, and register it to increase the reference count to return the image.
-  itk::SmartPointer<DuplicatorType> duplicator = DuplicatorType::New();
-  duplicator->SetInputImage(itkImport->GetOutput());
-  duplicator->Update();
-
-  auto image = ImageType::New();
-  image = duplicator->GetOutput();
-  image->Register();
-
-  return image;
+  return m_dataManager->GetItkImage();
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -632,6 +564,26 @@ bool Selection::isInsideSelection(const Vector3ui &point) const
   return false;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+std::vector<unsigned char> Selection::selectionMask(const Vector3ui &min, const Vector3ui &max) const
+{
+  std::vector<unsigned char> mask;
+  mask.reserve(static_cast<unsigned long long int>(max[0] - min[0] + 1) * (max[1] - min[1] + 1) * (max[2] - min[2] + 1));
+
+  for (unsigned int z = min[2]; z <= max[2]; ++z)
+  {
+    for (unsigned int y = min[1]; y <= max[1]; ++y)
+    {
+      for (unsigned int x = min[0]; x <= max[0]; ++x)
+      {
+        mask.push_back(isInsideSelection(Vector3ui{x, y, z}) ? 1 : 0);
+      }
+    }
+  }
+
+  return mask;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 bool Selection::isInsideSelectionSubvolume(vtkSmartPointer<vtkImageData> subvolume, const Vector3ui &point) const
 {
@@ -38,7 +38,7 @@
 #include <vector>
 
 // image typedefs
-using ImageType   = itk::Image<unsigned short, 3>;
+using ImageType   = itk::Image<LabelType, 3>;
 using ImageTypeUC = itk::Image<unsigned char, 3>;
 
 // forward declarations
@@ -110,22 +110,32 @@ class Selection
      */
     bool isInsideSelection(const Vector3ui &point) const;
 
+    /** \brief Returns the selection mask of the given region, one value per voxel with x varying fastest,
+     * non-zero if the voxel is inside the selection.
+     * \param[in] min region minimum coordinates.
+     * \param[in] max region maximum coordinates.
+     *
+     */
+    std::vector<unsigned char> selectionMask(const Vector3ui &min, const Vector3ui &max) const;
+
     /** \brief Returns a itk image from the selection, or the segmentation if there is nothing selected.
      * The image bounds are adjusted for filter radius (the selection grows with boundsGrow voxels in
      * each side). Label must be specified always, but it's only used when there's nothing selected.
+     * The image can share the voxels with the data manager, it must not be modified.
      * \param[in] label segmentation label.
      * \param[in] boundsGrow number of voxels to grow the selection on each side.
      *
      */
-    itk::SmartPointer<ImageType> itkImage(const unsigned short label, const unsigned int boundsGrow = 0) const;
+    itk::SmartPointer<ImageType> itkImage(const LabelType label, const unsigned int boundsGrow = 0) const;
 
-    /** \brief Returns a itk image from the segmentation.
+    /** \brief Returns a itk image from the segmentation, it must not be modified.
      * \param[in] label segmentation label.
      *
      */
-    itk::SmartPointer<ImageType> segmentationItkImage(const unsigned short label) const;
+    itk::SmartPointer<ImageType> segmentationItkImage(const LabelType label) const;
 
-    /** \brief Returns a itk image of the whole data.
+    /** \brief Returns a itk image of the whole data, without copying it unless the volume is stored
+     * in bricks. It must not be modified.
      *
      */
     itk::SmartPointer<ImageType> itkImage() const;
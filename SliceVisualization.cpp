@@ -9,6 +9,8 @@
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
 // c++ includes
+#include <algorithm>
+#include <cmath>
 #include <sstream>
 
 // vtk includes
@@ -43,6 +45,7 @@
 //
 SliceVisualization::SliceVisualization(Orientation type)
 : m_orientation{type}
+, m_dataManager{nullptr}
 , m_picker{nullptr}
 , m_renderer{nullptr}
 , m_thumbRenderer{nullptr}
@@ -98,8 +101,10 @@ void SliceVisualization::initialize(std::shared_ptr<DataManager>    data,
                                     vtkSmartPointer<vtkRenderer>    renderer,
                                     std::shared_ptr<Coordinates>    coordinates)
 {
-  connect(data.get(), SIGNAL(modified()),
-          this,       SLOT(onDataModified()));
+  connect(data.get(), SIGNAL(modified(const DirtyRegion &)),
+          this,       SLOT(onDataModified(const DirtyRegion &)));
+
+  m_dataManager = data;
 
   // get data properties
   m_size    = coordinates->GetTransformedSize();
@@ -226,7 +231,7 @@ void SliceVisualization::generateSlice(std::shared_ptr<DataManager> data)
   m_segmentationReslice = vtkSmartPointer<vtkImageReslice>::New();
   m_segmentationReslice->SetOptimization(true);
   m_segmentationReslice->BorderOn();
-  m_segmentationReslice->SetInputData(data->GetStructuredPoints());
+  m_segmentationReslice->SetInputData(segmentationData());
   m_segmentationReslice->SetOutputDimensionality(2);
   m_segmentationReslice->SetResliceAxes(m_axesMatrix);
   m_segmentationReslice->Update();
@@ -251,6 +256,22 @@ void SliceVisualization::generateSlice(std::shared_ptr<DataManager> data)
   m_renderer->AddActor(m_segmentationsActor);
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+vtkSmartPointer<vtkImageData> SliceVisualization::segmentationData() const
+{
+  if (!m_dataManager->IsBrickedStorage()) return m_dataManager->GetStructuredPoints();
+
+  // slice index from the reslice axes.
+  auto index = static_cast<int>(m_orientation);
+  auto slice = static_cast<unsigned int>(std::round(m_axesMatrix->GetElement(index, 3) / m_spacing[index]));
+
+  auto min = Vector3ui(0, 0, 0);
+  auto max = m_size - Vector3ui(1, 1, 1);
+  min[index] = max[index] = std::min(slice, m_size[index] - 1);
+
+  return m_dataManager->GetImageData(min, max);
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 void SliceVisualization::generateCrosshair()
 {
@@ -341,6 +362,11 @@ void SliceVisualization::updateSlice(const Vector3ui &point)
   m_axesMatrix->SetElement(index, 3, slice_point);
   m_axesMatrix->Modified();
 
+  if (m_dataManager->IsBrickedStorage())
+  {
+    m_segmentationReslice->SetInputData(segmentationData());
+  }
+
   for(auto actor: m_actorList)
   {
     updateActorVisibility(actor);
@@ -1005,8 +1031,18 @@ vtkSmartPointer<vtkImageActor> SliceVisualization::actor() const
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void SliceVisualization::onDataModified()
+void SliceVisualization::onDataModified(const DirtyRegion &region)
 {
-  updateSlice(m_point);
+  // the slice is only computed again if the modified region intersects it.
+  auto index = static_cast<int>(m_orientation);
+  auto min = Vector3ui(0, 0, 0);
+  auto max = m_size - Vector3ui(1, 1, 1);
+  min[index] = max[index] = m_point[index];
+
+  if (region.intersects(min, max))
+  {
+    updateSlice(m_point);
+  }
+
   m_renderer->GetRenderWindow()->Render();
 }
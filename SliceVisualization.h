@@ -167,7 +167,7 @@ class SliceVisualization
 
   public slots:
     void onCrosshairChange(const Vector3ui &crosshair);
-    void onDataModified();
+    void onDataModified(const DirtyRegion &region);
 
   private:
     /** \brief Generate imageactor and adds it to renderer.
@@ -176,6 +176,12 @@ class SliceVisualization
      */
     void generateSlice(std::shared_ptr<DataManager> data);
 
+    /** \brief Returns the segmentation image to reslice. If the image is stored in bricks only the
+     * voxels of the current slice are returned.
+     *
+     */
+    vtkSmartPointer<vtkImageData> segmentationData() const;
+
     /** \brief Generate crosshairs actors and adds them to renderer.
      *
      */
@@ -214,6 +220,8 @@ class SliceVisualization
     Vector3ui   m_size;        /** size in voxels of the visualization. */
     Vector3ui   m_point;       /** crosshair point, to not redraw if slider is already in the correct position. */
 
+    std::shared_ptr<DataManager> m_dataManager; /** data manager. */
+
     vtkSmartPointer<vtkPropPicker>     m_picker;        /** actor's picker. */
     vtkSmartPointer<vtkRenderer>       m_renderer;      /** view's main renderer. */
     vtkSmartPointer<vtkRenderer>       m_thumbRenderer; /** thumbnail renderer. */
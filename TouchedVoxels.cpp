@@ -0,0 +1,36 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: TouchedVoxels.cpp
+// Purpose: Set of voxels modified by the action in progress, used by the undo/redo system
+// Notes: Sparse bitmap of linear offsets. Bits are allocated in chunks of consecutive offsets
+//        when the first voxel of the chunk is inserted, so memory follows the modified region.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// project includes
+#include "TouchedVoxels.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+TouchedVoxels::TouchedVoxels()
+: m_lastIndex{0}
+, m_last     {nullptr}
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void TouchedVoxels::clear()
+{
+  std::unordered_map<unsigned long long int, std::vector<std::uint64_t>>().swap(m_chunks);
+  m_lastIndex = 0;
+  m_last = nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const unsigned long long int TouchedVoxels::memoryUsage() const
+{
+  // each chunk is a node of the map with the vector and its bits, plus a bucket pointer.
+  auto node = sizeof(std::pair<const unsigned long long int, std::vector<std::uint64_t>>) + 2 * sizeof(void *);
+
+  return m_chunks.size() * (node + CHUNK_VOXELS / 8) + m_chunks.bucket_count() * sizeof(void *);
+}
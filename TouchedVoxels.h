@@ -0,0 +1,85 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: TouchedVoxels.h
+// Purpose: Set of voxels modified by the action in progress, used by the undo/redo system
+// Notes: Sparse bitmap of linear offsets. Bits are allocated in chunks of consecutive offsets
+//        when the first voxel of the chunk is inserted, so memory follows the modified region.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _TOUCHEDVOXELS_H_
+#define _TOUCHEDVOXELS_H_
+
+// c++ includes
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// TouchedVoxels class
+//
+class TouchedVoxels
+{
+  public:
+    /** \brief TouchedVoxels class constructor.
+     *
+     */
+    TouchedVoxels();
+
+    /** \brief Adds a voxel to the set. Returns true if it wasn't in the set.
+     * \param[in] offset linear offset of the voxel.
+     *
+     */
+    inline bool insert(const unsigned long long int offset);
+
+    /** \brief Returns true if there are no voxels.
+     *
+     */
+    const bool empty() const
+    { return m_chunks.empty(); }
+
+    /** \brief Removes all the voxels and releases the memory.
+     *
+     */
+    void clear();
+
+    /** \brief Returns the memory used by the bitmap in bytes.
+     *
+     */
+    const unsigned long long int memoryUsage() const;
+
+  private:
+    static const unsigned int CHUNK_VOXELS = 4096; /** voxels of a chunk of the bitmap. */
+
+    std::unordered_map<unsigned long long int, std::vector<std::uint64_t>> m_chunks;    /** allocated chunks by index.   */
+    unsigned long long int                                                 m_lastIndex; /** index of the last chunk.     */
+    std::uint64_t                                                         *m_last;      /** bits of the last chunk used. */
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+inline bool TouchedVoxels::insert(const unsigned long long int offset)
+{
+  auto index = offset / CHUNK_VOXELS;
+
+  // consecutive inserts usually fall in the same chunk, the lookup is skipped.
+  if (!m_last || (index != m_lastIndex))
+  {
+    auto &chunk = m_chunks[index];
+    if (chunk.empty()) chunk.resize(CHUNK_VOXELS / 64, 0);
+
+    m_lastIndex = index;
+    m_last = chunk.data();
+  }
+
+  auto bit = offset % CHUNK_VOXELS;
+  auto &word = m_last[bit / 64];
+  auto mask = std::uint64_t{1} << (bit % 64);
+
+  if (word & mask) return false;
+
+  word |= mask;
+  return true;
+}
+
+#endif // _TOUCHEDVOXELS_H_
@@ -8,6 +8,8 @@
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
 // qt includes
+#include <QDebug>
+#include <QDir>
 #include <QMessageBox>
 #include <QObject>
 #include <QAbstractButton>
@@ -16,6 +18,77 @@
 // project includes
 #include "UndoRedoSystem.h"
 
+// c++ includes
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <map>
+
+namespace
+{
+  /** minimum number of voxels of an action to consider storing it as a region. */
+  const unsigned long long int REGION_MINIMUM_VOXELS = 65536;
+
+  /** minimum size of the points of the action in progress to move them to the scratch file. */
+  const unsigned long long int SPILL_MINIMUM_BYTES = 4 * 1024 * 1024;
+
+  /** maximum size of the scratch file as a multiple of the size of the undo/redo system. */
+  const unsigned long long int SPILL_MAXIMUM_FACTOR = 8;
+
+  /** size of a node of the labels set: the value, the color and three pointers. */
+  const unsigned long long int LABEL_NODE_SIZE = sizeof(LabelType) + 4 * sizeof(void *);
+
+  /** \brief Returns the memory allocated by the string, zero if the characters are stored in the object.
+   *
+   */
+  unsigned long long int stringMemory(const std::string &text)
+  {
+    static const auto inlineCapacity = std::string().capacity();
+
+    return (text.capacity() > inlineCapacity) ? text.capacity() + 1 : 0;
+  }
+
+  /** size of a node of the colors map: the label, the color and four pointers. */
+  const unsigned long long int COLOR_NODE_SIZE = sizeof(DataManager::ColorChanges::value_type) + 4 * sizeof(void *);
+
+  /** identifier and version of the journal file format. */
+  const std::uint32_t JOURNAL_MAGIC   = 0x4A524445;
+  const std::uint32_t JOURNAL_VERSION = 1;
+
+  /** types of the journal records. */
+  const unsigned char ACTION_RECORD = 1;
+  const unsigned char HEAD_RECORD   = 2;
+
+  /** minimum size of the discarded records of the journal to write it again. */
+  const unsigned long long int JOURNAL_MINIMUM_BYTES = 16 * 1024 * 1024;
+
+  /** \brief Appends the bytes of a value to a journal record.
+   *
+   */
+  template<typename T> void append(std::vector<char> &record, const T value)
+  {
+    auto data = reinterpret_cast<const char *>(&value);
+    record.insert(record.end(), data, data + sizeof(T));
+  }
+
+  /** \brief Reads a value from the journal file, returns false if the file ends before it.
+   *
+   */
+  template<typename T> bool extract(QFile &file, T &value)
+  {
+    return file.read(reinterpret_cast<char *>(&value), sizeof(T)) == sizeof(T);
+  }
+
+  /** \brief Returns the memory allocated by the object information, not including the object.
+   *
+   */
+  unsigned long long int objectMemory(const std::pair<LabelType, DataManager::ObjectInformation> &object)
+  {
+    return object.second.centroid.memoryUsage() + object.second.min.memoryUsage() + object.second.max.memoryUsage();
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 UndoRedoSystem::UndoRedoSystem(DataManager *dataManager)
 : m_current{nullptr}
@@ -23,62 +96,37 @@ UndoRedoSystem::UndoRedoSystem(DataManager *dataManager)
 , m_used{0}
 , m_dataManager{dataManager}
 , m_bufferFull{false}
-, m_sizePoint{sizeof(std::pair<Vector3ui, unsigned short>)}
-, m_sizeAction{sizeof(struct action)}
-, m_sizeObject{sizeof(std::pair<unsigned short, struct DataManager::ObjectInformation*>)}
-, m_sizeColor{4 * sizeof(unsigned char)}
-, m_sizeLabel{sizeof(unsigned short)}
+, m_serial{0}
+, m_journalSerial{0}
 {
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 UndoRedoSystem::~UndoRedoSystem()
 {
-  // NOTE: for this and the rest of UndoRedoSystem operations: the pointers to objects allocated
-  // in the undo buffer are never freed because are in use by DataManager and it will free them
-  // on destruction. On the other hand clearing the redo buffer deletes dynamically allocated
-  // objects created by DataManager, stored in UndoRedoSystem and NOT in use by DataManager.
   clear(Type::ALL);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 void UndoRedoSystem::clear(const Type type)
 {
-  // in destruction of the object we must check if objects are NULL because some could have
-  // been previously deallocated while DataManager object destruction. we don't check for
-  // NULL on the rest of the class because we know that we're deleting existing objects.
   unsigned long int capacity = 0;
 
   switch (type)
   {
     case Type::UNDO:
-      for (auto it: m_undo)
+      for (auto &it: m_undo)
       {
-        capacity += it.points.size() * m_sizePoint;
-        capacity += it.objects.size() * m_sizeObject;
-        capacity += it.description.capacity();
-        capacity += it.lut->GetNumberOfTableValues() * m_sizeColor;
-        capacity += it.labels.size() * m_sizeLabel;
-        capacity += m_sizeAction;
+        capacity += actionMemory(it);
+        releaseSpilled(it.spilled);
       }
       m_undo.clear();
       break;
     case Type::REDO:
-      for (auto it: m_redo)
+      for (auto &it: m_redo)
       {
-        capacity += it.points.size() * m_sizePoint;
-        capacity += it.objects.size() * m_sizeObject;
-        capacity += it.description.capacity();
-        capacity += it.lut->GetNumberOfTableValues() * m_sizeColor;
-        capacity += it.labels.size() * m_sizeLabel;
-        capacity += m_sizeAction;
-
-        // delete dinamically allocated objects no longer needed by DataManager
-        while (!it.objects.empty())
-        {
-          it.objects.back().second = nullptr;
-          it.objects.pop_back();
-        }
+        capacity += actionMemory(it);
+        releaseSpilled(it.spilled);
       }
       m_redo.clear();
       break;
@@ -95,49 +143,36 @@ void UndoRedoSystem::clear(const Type type)
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void UndoRedoSystem::signalBeginAction(const std::string &actionstring, const std::set<unsigned short> labelSet, vtkSmartPointer<vtkLookupTable> lut)
+void UndoRedoSystem::signalBeginAction(const std::string &actionstring, const std::set<LabelType> labelSet, const unsigned int colors)
 {
   unsigned long int capacity = 0;
 
   //because an action started, the redo buffer must be empty
   clear(Type::REDO);
 
-  // we need to copy the values of the table
-  double rgba[4];
-  vtkSmartPointer<vtkLookupTable> lutCopy = vtkSmartPointer<vtkLookupTable>::New();
-  lutCopy->Allocate();
-  lutCopy->SetNumberOfTableValues(lut->GetNumberOfTableValues());
-
-  for (int index = 0; index != lut->GetNumberOfTableValues(); index++)
-  {
-    lut->GetTableValue(index, rgba);
-    lutCopy->SetTableValue(index, rgba);
-  }
-  lutCopy->SetTableRange(0, lut->GetNumberOfTableValues() - 1);
-
-  // create new action
+  // create new action, only the colors modified by the action are stored, when they change.
   m_current = new struct action;
   m_current->description = actionstring;
   m_current->labels = labelSet;
-  m_current->lut = lutCopy;
+  m_current->tableValues = colors;
+  m_current->storage = Storage::POINTS;
+  m_current->voxels = 0;
+  m_current->serial = 0;
+  m_current->journalSize = 0;
 
-  capacity += m_sizeAction;
-  capacity += (*m_current).description.capacity();
-  capacity += (*m_current).labels.size() * m_sizeLabel;
-  capacity += (*m_current).lut->GetNumberOfTableValues() * m_sizeColor;
+  capacity += actionMemory(*m_current);
 
   // we need to know if we are at the limit of our buffer
   while ((m_used + capacity) > m_size)
   {
+    // older actions are moved to the scratch file before deleting them
+    if (spillOldest()) continue;
+
     assert(!m_undo.empty());
 
     // start deleting undo actions from the beginning of the list
-    m_used -= (*m_undo.begin()).points.size() * m_sizePoint;
-    m_used -= (*m_undo.begin()).objects.size() * m_sizeObject;
-    m_used -= (*m_undo.begin()).description.capacity();
-    m_used -= ((*m_undo.begin()).lut)->GetNumberOfTableValues() * m_sizeColor;
-    m_used -= (*m_undo.begin()).labels.size() * m_sizeLabel;
-    m_used -= m_sizeAction;
+    m_used -= actionMemory(*m_undo.begin());
+    releaseSpilled((*m_undo.begin()).spilled);
 
     m_undo.erase(m_undo.begin());
   }
@@ -151,7 +186,23 @@ void UndoRedoSystem::signalEndAction(void)
 {
   if (!m_bufferFull)
   {
-    m_undo.push_back(*m_current);
+    // the points won't grow anymore, the reserved memory is released.
+    m_used -= (*m_current).touched.memoryUsage();
+    (*m_current).touched.clear();
+
+    m_used -= (*m_current).points.memoryUsage();
+    (*m_current).points.compact();
+    m_used += (*m_current).points.memoryUsage();
+
+    storeRegion(*m_current);
+
+    // the statistics are applied on undo/redo instead of being computed again from the voxels.
+    (*m_current).statistics = m_dataManager->GetActionStatistics();
+    m_used += (*m_current).statistics.capacity() * sizeof(long long int);
+
+    (*m_current).serial = ++m_serial;
+    m_undo.push_back(std::move(*m_current));
+    delete m_current;
     m_current = nullptr;
   }
   else
@@ -161,27 +212,76 @@ void UndoRedoSystem::signalEndAction(void)
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void UndoRedoSystem::storePoint(const Vector3ui &point, const unsigned short label)
+void UndoRedoSystem::storePoint(const unsigned long long int offset, const LabelType label)
 {
   // if buffer has been marked as full (one action is too big and doesn't fit in the
   // buffer) don't do anything else.
   if (m_bufferFull) return;
 
-  (*m_current).points.push_back(std::pair<Vector3ui, unsigned short>(point, label));
-  m_used += m_sizePoint;
+  // only the first value of a voxel is needed to undo the action, the rest are skipped.
+  auto &touched = (*m_current).touched;
+  auto touchedUsed = touched.memoryUsage();
+  if (!touched.insert(offset)) return;
+
+  auto &points = (*m_current).points;
+  auto used = points.memoryUsage();
+  points.add(offset, label);
+  m_used += points.memoryUsage() - used + touched.memoryUsage() - touchedUsed;
+
+  // we need to know if we are at the limit of our buffer
+  checkLimits();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void UndoRedoSystem::storePoints(const VoxelDeltas &points)
+{
+  if (m_bufferFull || points.empty()) return;
+
+  auto &touched = (*m_current).touched;
+  auto touchedUsed = touched.memoryUsage();
+
+  auto &actionPoints = (*m_current).points;
+  auto used = actionPoints.memoryUsage();
+  for (auto &run: points.runs())
+  {
+    for (unsigned int i = 0; i < run.length; ++i)
+    {
+      if (touched.insert(run.offset + i)) actionPoints.add(run.offset + i, run.value);
+    }
+  }
+  m_used += actionPoints.memoryUsage() - used + touched.memoryUsage() - touchedUsed;
 
   // we need to know if we are at the limit of our buffer
   checkLimits();
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void UndoRedoSystem::storeObject(std::pair<unsigned short, std::shared_ptr<DataManager::ObjectInformation>> value)
+void UndoRedoSystem::storeObject(const std::pair<LabelType, DataManager::ObjectInformation> &value)
 {
   // if buffer marked as full, just return. complete action doesn't fit into memory
   if (m_bufferFull) return;
 
-  (*m_current).objects.push_back(value);
-  m_used += m_sizeObject;
+  auto &objects = (*m_current).objects;
+  auto capacity = objects.capacity();
+  objects.push_back(value);
+  m_used += (objects.capacity() - capacity) * sizeof(value) + objectMemory(value);
+
+  // we need to know if we are at the limit of our buffer
+  checkLimits();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void UndoRedoSystem::storeColor(const LabelType label, const double rgba[4])
+{
+  if (!m_current || m_bufferFull) return;
+
+  // the colors of the labels created in the action are removed with the values of the table.
+  if (label >= (*m_current).tableValues) return;
+
+  auto inserted = (*m_current).colors.insert(std::make_pair(label, std::array<double, 4>{rgba[0], rgba[1], rgba[2], rgba[3]}));
+  if (!inserted.second) return;
+
+  m_used += COLOR_NODE_SIZE;
 
   // we need to know if we are at the limit of our buffer
   checkLimits();
@@ -192,37 +292,361 @@ void UndoRedoSystem::checkLimits()
 {
   while (m_used > m_size)
   {
+    // older actions and the points of the current one are moved to the scratch file first, actions
+    // are only deleted if there is nothing left to move.
+    if (spillOldest()) continue;
+
     // start deleting undo actions from the beginning of the list, check first if this action
     // fits in our buffer, and if not, delete all points entered until now and mark buffer as
     // completely full (the action doesn't fit)
-    if (m_undo.empty())
+    if (m_undo.empty() && m_current)
     {
       m_bufferFull = true;
 
-      m_used -= (*m_current).points.size() * m_sizePoint;
-      m_used -= (*m_current).objects.size() * m_sizeObject;
-      m_used -= (*m_current).description.capacity();
-      m_used -= ((*m_current).lut)->GetNumberOfTableValues() * m_sizeColor;
-      m_used -= (*m_current).labels.size() * m_sizeLabel;
-      m_used -= m_sizeAction;
+      m_used -= actionMemory(*m_current);
+      releaseSpilled((*m_current).spilled);
 
       delete m_current;
       m_current = nullptr;
     }
+    else if (m_undo.empty())
+    {
+      // outside an action only the redo actions are left, the farthest one is deleted first.
+      if (m_redo.empty()) break;
+
+      m_used -= actionMemory(*m_redo.begin());
+      releaseSpilled((*m_redo.begin()).spilled);
+
+      m_redo.erase(m_redo.begin());
+    }
     else
     {
-      m_used -= (*m_undo.begin()).points.size() * m_sizePoint;
-      m_used -= (*m_undo.begin()).objects.size() * m_sizeObject;
-      m_used -= (*m_undo.begin()).description.capacity();
-      m_used -= ((*m_undo.begin()).lut)->GetNumberOfTableValues() * m_sizeColor;
-      m_used -= (*m_undo.begin()).labels.size() * m_sizeLabel;
-      m_used -= m_sizeAction;
+      m_used -= actionMemory(*m_undo.begin());
+      releaseSpilled((*m_undo.begin()).spilled);
 
       m_undo.erase(m_undo.begin());
     }
   }
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void UndoRedoSystem::storeRegion(struct action &action)
+{
+  // small actions are always cheaper as points, spilled ones are already out of memory.
+  if ((action.points.voxels() < REGION_MINIMUM_VOXELS) || !action.spilled.empty()) return;
+
+  int extent[6];
+  m_dataManager->GetStructuredPoints()->GetExtent(extent);
+
+  // bounds of the modified voxels, runs that continue in other rows or slices cover them completely.
+  auto runs = action.points.runs();
+  auto min = m_dataManager->GetVoxelCoordinates(runs.front().offset);
+  auto max = min;
+  for (auto &run: runs)
+  {
+    auto first = m_dataManager->GetVoxelCoordinates(run.offset);
+    auto last  = m_dataManager->GetVoxelCoordinates(run.offset + run.length - 1);
+
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+      min[i] = std::min(min[i], std::min(first[i], last[i]));
+      max[i] = std::max(max[i], std::max(first[i], last[i]));
+    }
+
+    if (first[2] != last[2])
+    {
+      min[1] = extent[2];
+      max[1] = extent[3];
+    }
+
+    if ((first[1] != last[1]) || (first[2] != last[2]))
+    {
+      min[0] = extent[0];
+      max[0] = extent[1];
+    }
+  }
+
+  unsigned long long int rowLength   = max[0] - min[0] + 1;
+  unsigned long long int rowsY       = max[1] - min[1] + 1;
+  unsigned long long int sliceVoxels = static_cast<unsigned long long int>(extent[1] - extent[0] + 1) * (extent[3] - extent[2] + 1);
+
+  std::vector<QByteArray> slabs;
+  slabs.reserve((max[2] - min[2]) / BrickedVolume::BRICK_SIZE + 1);
+  for (auto z = min[2]; z <= max[2]; z += BrickedVolume::BRICK_SIZE)
+  {
+    auto slabMin = Vector3ui{min[0], min[1], z};
+    auto slabMax = Vector3ui{max[0], max[1], std::min(z + BrickedVolume::BRICK_SIZE - 1, max[2])};
+
+    // the previous values are the current ones with the points restored in reverse order.
+    auto image  = m_dataManager->GetImageData(slabMin, slabMax);
+    auto buffer = static_cast<LabelType *>(image->GetScalarPointer());
+
+    auto slabBegin = (slabMin[2] - extent[4]) * sliceVoxels;
+    auto slabEnd   = (slabMax[2] - extent[4] + 1) * sliceVoxels;
+    for (auto run = runs.rbegin(); run != runs.rend(); ++run)
+    {
+      auto begin = std::max((*run).offset, slabBegin);
+      auto end   = std::min((*run).offset + (*run).length, slabEnd);
+      for (auto offset = begin; offset < end; ++offset)
+      {
+        auto point = m_dataManager->GetVoxelCoordinates(offset);
+        buffer[(point[0] - slabMin[0]) + ((point[1] - slabMin[1]) + (point[2] - slabMin[2]) * rowsY) * rowLength] = (*run).value;
+      }
+    }
+
+    auto voxels = rowLength * rowsY * (slabMax[2] - slabMin[2] + 1);
+    slabs.push_back(qCompress(reinterpret_cast<const uchar *>(buffer), static_cast<int>(voxels * sizeof(LabelType))));
+
+    // stop as soon as the region is bigger than the points.
+    if (regionMemory(slabs) >= action.points.memoryUsage()) return;
+  }
+
+  m_used -= actionMemory(action);
+
+  action.voxels   += action.points.voxels();
+  action.points.clear();
+
+  action.storage   = Storage::REGION;
+  action.regionMin = min;
+  action.regionMax = max;
+  action.slabs     = std::move(slabs);
+  m_used += actionMemory(action);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const unsigned long long int UndoRedoSystem::regionMemory(const std::vector<QByteArray> &slabs)
+{
+  unsigned long long int memory = slabs.capacity() * sizeof(QByteArray);
+  for (auto &slab: slabs)
+  {
+    memory += slab.size();
+  }
+
+  return memory;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const unsigned long long int UndoRedoSystem::actionMemory(const struct action &action) const
+{
+  unsigned long long int memory = sizeof(struct action);
+  memory += action.points.memoryUsage();
+  memory += regionMemory(action.slabs);
+  memory += action.regionMin.memoryUsage() + action.regionMax.memoryUsage();
+  memory += action.spilled.capacity() * sizeof(SpillChunk);
+  memory += action.statistics.capacity() * sizeof(long long int);
+  memory += action.touched.memoryUsage();
+  memory += action.objects.capacity() * sizeof(std::pair<LabelType, DataManager::ObjectInformation>);
+  for (auto &object: action.objects)
+  {
+    memory += objectMemory(object);
+  }
+  memory += stringMemory(action.description);
+  memory += action.labels.size() * LABEL_NODE_SIZE;
+  memory += action.colors.size() * COLOR_NODE_SIZE;
+
+  return memory;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool UndoRedoSystem::spillOldest()
+{
+  auto inMemory = [](const struct action &action)
+  {
+    return !action.points.empty() || !action.slabs.empty();
+  };
+
+  // oldest undo actions first, then the ones farthest in the redo buffer.
+  for (auto list: {&m_undo, &m_redo})
+  {
+    for (auto &action: *list)
+    {
+      if (inMemory(action)) return spill(action);
+    }
+  }
+
+  // the points of the action in progress are moved in segments big enough to be worth it.
+  if (m_current && ((*m_current).points.memoryUsage() >= SPILL_MINIMUM_BYTES))
+  {
+    return spill(*m_current);
+  }
+
+  return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool UndoRedoSystem::spill(struct action &action)
+{
+  if (!m_spillFile)
+  {
+    auto file = std::unique_ptr<QTemporaryFile>(new QTemporaryFile(QDir::tempPath() + QString("/espinaeditor-undo-XXXXXX")));
+    if (!file->open())
+    {
+      qWarning() << "couldn't create the undo scratch file, old actions will be discarded -" << file->errorString();
+      return false;
+    }
+
+    m_spillFile = std::move(file);
+  }
+
+  // slabs are already compressed, points are compressed as a single segment.
+  std::vector<QByteArray> blocks;
+  if (Storage::REGION == action.storage)
+  {
+    blocks = action.slabs;
+  }
+  else
+  {
+    auto data = action.points.encoded();
+    blocks.push_back(qCompress(data.data(), static_cast<int>(data.size())));
+  }
+
+  // the chunks go to the free space left by released chunks if they fit, the file isn't allowed to
+  // grow past its limit, the oldest actions are discarded instead.
+  std::vector<SpillChunk> chunks;
+  for (auto &block: blocks)
+  {
+    SpillChunk chunk{allocateSpilled(block.size()), block.size(), false};
+    if (chunk.offset < 0)
+    {
+      releaseSpilled(chunks);
+      return false;
+    }
+
+    chunks.push_back(chunk);
+
+    if (!m_spillFile->seek(chunk.offset) || (m_spillFile->write(block.constData(), chunk.size) != chunk.size))
+    {
+      qWarning() << "couldn't write the undo scratch file, old actions will be discarded -" << m_spillFile->errorString();
+      releaseSpilled(chunks);
+      return false;
+    }
+  }
+
+  m_used -= actionMemory(action);
+  action.spilled.insert(action.spilled.end(), chunks.begin(), chunks.end());
+  std::vector<QByteArray>().swap(action.slabs);
+  if (Storage::POINTS == action.storage) action.voxels += action.points.voxels();
+  action.points.clear();
+  m_used += actionMemory(action);
+
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+QByteArray UndoRedoSystem::readSpilled(const SpillChunk &chunk)
+{
+  QByteArray data;
+  data.resize(static_cast<int>(chunk.size));
+
+  QFile *file = chunk.journal ? m_journal.get() : m_spillFile.get();
+  if (!file->seek(chunk.offset) || (file->read(data.data(), chunk.size) != chunk.size))
+  {
+    qWarning() << "couldn't read the undo" << (chunk.journal ? "journal" : "scratch file") << "-" << file->errorString();
+    return QByteArray();
+  }
+
+  return data;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+VoxelDeltas UndoRedoSystem::spilledPoints(const SpillChunk &chunk)
+{
+  auto data = qUncompress(readSpilled(chunk));
+
+  return VoxelDeltas(reinterpret_cast<const unsigned char *>(data.constData()), data.size());
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const unsigned long long int UndoRedoSystem::spilledMemory(const std::vector<SpillChunk> &chunks)
+{
+  unsigned long long int memory = 0;
+  for (auto &chunk: chunks)
+  {
+    memory += chunk.size;
+  }
+
+  return memory;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void UndoRedoSystem::releaseSpilled(const std::vector<SpillChunk> &chunks)
+{
+  // the journal isn't released, its records are kept until it's written again.
+  for (auto &chunk: chunks)
+  {
+    if (chunk.journal) continue;
+
+    // adjacent free extents are merged.
+    auto offset = chunk.offset;
+    auto size = chunk.size;
+
+    auto next = m_spillFree.lower_bound(offset);
+    if ((next != m_spillFree.end()) && ((*next).first == offset + size))
+    {
+      size += (*next).second;
+      next = m_spillFree.erase(next);
+    }
+
+    if (next != m_spillFree.begin())
+    {
+      auto previous = std::prev(next);
+      if ((*previous).first + (*previous).second == offset)
+      {
+        offset = (*previous).first;
+        size += (*previous).second;
+        m_spillFree.erase(previous);
+      }
+    }
+
+    m_spillFree[offset] = size;
+  }
+
+  // free space at the end of the file is returned to the system.
+  if (m_spillFile && !m_spillFree.empty())
+  {
+    auto last = std::prev(m_spillFree.end());
+    if ((*last).first + (*last).second >= m_spillFile->size())
+    {
+      m_spillFile->resize((*last).first);
+      m_spillFree.erase(last);
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+qint64 UndoRedoSystem::allocateSpilled(const qint64 size)
+{
+  // the smallest free extent that fits the chunk.
+  auto best = m_spillFree.end();
+  for (auto it = m_spillFree.begin(); it != m_spillFree.end(); ++it)
+  {
+    if (((*it).second >= size) && ((best == m_spillFree.end()) || ((*it).second < (*best).second))) best = it;
+  }
+
+  if (best != m_spillFree.end())
+  {
+    auto offset = (*best).first;
+    auto remaining = (*best).second - size;
+    m_spillFree.erase(best);
+
+    if (remaining > 0) m_spillFree[offset + size] = remaining;
+
+    return offset;
+  }
+
+  auto offset = m_spillFile->size();
+  if (static_cast<unsigned long long int>(offset + size) > SPILL_MAXIMUM_FACTOR * m_size) return -1;
+
+  // reserved now so the next chunk isn't given the same position.
+  if (!m_spillFile->resize(offset + size))
+  {
+    qWarning() << "couldn't grow the undo scratch file, old actions will be discarded -" << m_spillFile->errorString();
+    return -1;
+  }
+
+  return offset;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 const bool UndoRedoSystem::isEmpty(const Type type) const
 {
@@ -249,34 +673,23 @@ void UndoRedoSystem::changeSize(const unsigned long int size)
 
   if (size >= m_used) return;
 
+  // move actions to the scratch file before deleting them
+  while ((m_used > size) && spillOldest());
+
   // we need to delete actions to fit in that size, first redo
   while ((m_used > size) && (!isEmpty(Type::REDO)))
   {
-    m_used -= (*m_redo.begin()).points.size() * m_sizePoint;
-    m_used -= (*m_redo.begin()).objects.size() * m_sizeObject;
-    m_used -= (*m_redo.begin()).description.capacity();
-    m_used -= ((*m_redo.begin()).lut)->GetNumberOfTableValues() * m_sizeColor;
-    m_used -= (*m_redo.begin()).labels.size() * m_sizeLabel;
-    m_used -= m_sizeAction;
+    m_used -= actionMemory(*m_redo.begin());
+    releaseSpilled((*m_redo.begin()).spilled);
 
-    // delete dinamically allocated objects in redo
-    while (!(*m_redo.begin()).objects.empty())
-    {
-      (*m_redo.begin()).objects.back().second = nullptr;
-      (*m_redo.begin()).objects.pop_back();
-    }
     m_redo.erase(m_redo.begin());
   }
 
   // then undo
   while ((m_used > size) && (!isEmpty(Type::UNDO)))
   {
-    m_used -= (*m_undo.begin()).points.size() * m_sizePoint;
-    m_used -= (*m_undo.begin()).objects.size() * m_sizeObject;
-    m_used -= (*m_undo.begin()).description.capacity();
-    m_used -= ((*m_undo.begin()).lut)->GetNumberOfTableValues() * m_sizeColor;
-    m_used -= (*m_undo.begin()).labels.size() * m_sizeLabel;
-    m_used -= m_sizeAction;
+    m_used -= actionMemory(*m_undo.begin());
+    releaseSpilled((*m_undo.begin()).spilled);
 
     m_undo.erase(m_undo.begin());
   }
@@ -297,7 +710,11 @@ const unsigned long int UndoRedoSystem::capacity() const
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 void UndoRedoSystem::doAction(const Type type)
 {
-  std::vector<std::pair<Vector3ui, unsigned short> > action_vector;
+  VoxelDeltas action_vector;
+  std::vector<QByteArray> slabs;
+  std::vector<SpillChunk> spilled;
+  std::vector<long long int> statistics;
+  unsigned long long int voxels = 0;
 
   assert(!m_current);
 
@@ -307,16 +724,32 @@ void UndoRedoSystem::doAction(const Type type)
   switch (type)
   {
     case Type::UNDO:
-      action_vector = m_undo.back().points;
+      action_vector = std::move(m_undo.back().points);
+      slabs = std::move(m_undo.back().slabs);
+      spilled = std::move(m_undo.back().spilled);
+      statistics = std::move(m_undo.back().statistics);
+      voxels = m_undo.back().voxels;
+      (*m_current).storage = m_undo.back().storage;
+      (*m_current).regionMin = m_undo.back().regionMin;
+      (*m_current).regionMax = m_undo.back().regionMax;
       (*m_current).description = m_undo.back().description;
-      (*m_current).lut = m_undo.back().lut;
+      (*m_current).tableValues = m_undo.back().tableValues;
+      (*m_current).colors = std::move(m_undo.back().colors);
       (*m_current).objects = m_undo.back().objects;
       (*m_current).labels = m_undo.back().labels;
       break;
     case Type::REDO:
-      action_vector = m_redo.back().points;
+      action_vector = std::move(m_redo.back().points);
+      slabs = std::move(m_redo.back().slabs);
+      spilled = std::move(m_redo.back().spilled);
+      statistics = std::move(m_redo.back().statistics);
+      voxels = m_redo.back().voxels;
+      (*m_current).storage = m_redo.back().storage;
+      (*m_current).regionMin = m_redo.back().regionMin;
+      (*m_current).regionMax = m_redo.back().regionMax;
       (*m_current).description = m_redo.back().description;
-      (*m_current).lut = m_redo.back().lut;
+      (*m_current).tableValues = m_redo.back().tableValues;
+      (*m_current).colors = std::move(m_redo.back().colors);
       (*m_current).objects = m_redo.back().objects;
       (*m_current).labels = m_redo.back().labels;
       break;
@@ -324,69 +757,114 @@ void UndoRedoSystem::doAction(const Type type)
       break;
   }
 
-  // vector size changes while updating data, need to get the size before
-  auto numberOfPoints = action_vector.size();
+  // points are moved out of the action, checkLimits() could drop it while storing the new ones.
+  // we "delete" the size of the points not to mess with memory while using RestoreVoxelScalars,
+  // the restored points are stored in the opposite action with about the same size.
+  m_used -= action_vector.memoryUsage();
+  m_used -= regionMemory(slabs);
+  m_used -= spilled.capacity() * sizeof(SpillChunk);
+  m_used -= statistics.capacity() * sizeof(long long int);
+  m_used -= (*m_current).colors.size() * COLOR_NODE_SIZE;
+
+  // the opposite action is accounted from now on, the rest of the action is released at the end.
+  (*m_current).voxels = 0;
+  (*m_current).serial = ++m_serial;
+  (*m_current).journalSize = 0;
+  m_used += actionMemory(*m_current);
+
+  if (Storage::REGION == (*m_current).storage)
+  {
+    // the slabs are swapped with the voxels of the volume, the replaced voxels are the slabs of the
+    // opposite action.
+    auto &min = (*m_current).regionMin;
+    auto &max = (*m_current).regionMax;
+
+    // spilled regions are read back slab by slab.
+    auto count = std::max(slabs.size(), spilled.size());
+    (*m_current).voxels = voxels;
+
+    (*m_current).slabs.reserve(count);
+    for (unsigned int i = 0; i < count; ++i)
+    {
+      auto slabMin = Vector3ui{min[0], min[1], min[2] + i * BrickedVolume::BRICK_SIZE};
+      auto slabMax = Vector3ui{max[0], max[1], std::min(slabMin[2] + BrickedVolume::BRICK_SIZE - 1, max[2])};
+
+      auto data = qUncompress(spilled.empty() ? slabs[i] : readSpilled(spilled[i]));
+      if (!slabs.empty()) slabs[i] = QByteArray();
 
-  // we "delete" the size of the points not to mess with memory while using
-  // SetVoxelScalar, at the end the memory size it's the same, in fact memory
-  // used for points is constant during "do undo/redo action" as we delete
-  // one point while adding a new one to the opposite action, so the memory
-  // variation is about the size of a point plus the size of a label.
-  m_used -= (numberOfPoints * m_sizePoint);
+      std::vector<LabelType> values(data.size() / sizeof(LabelType));
+      std::memcpy(values.data(), data.constData(), values.size() * sizeof(LabelType));
+      data = QByteArray();
 
-  // reverse labels from all points in the action
-  for (unsigned long int i = 0; i < numberOfPoints; i++)
+      m_dataManager->SwapVoxelScalars(slabMin, slabMax, values);
+
+      (*m_current).slabs.push_back(qCompress(reinterpret_cast<const uchar *>(values.data()), static_cast<int>(values.size() * sizeof(LabelType))));
+    }
+
+    m_used += regionMemory((*m_current).slabs);
+  }
+  else
   {
-    auto action_point = action_vector.back();
-    action_vector.pop_back();
+    // reverse labels from all points in the action, from last to first. The points in memory are
+    // the last ones, the spilled segments are read back after them from the last one.
+    m_dataManager->RestoreVoxelScalars(action_vector);
+    for (auto chunk = spilled.rbegin(); chunk != spilled.rend(); ++chunk)
+    {
+      m_dataManager->RestoreVoxelScalars(spilledPoints(*chunk));
+    }
 
-    Vector3ui point = action_point.first;
-    m_dataManager->SetVoxelScalar(point, action_point.second);
+    m_used -= (*m_current).points.memoryUsage();
+    (*m_current).points.compact();
+    m_used += (*m_current).points.memoryUsage();
+
+    storeRegion(*m_current);
   }
 
+  releaseSpilled(spilled);
+
+  m_used -= (*m_current).touched.memoryUsage();
+  (*m_current).touched.clear();
+
+  // the voxels are restored without statistics, the ones of the action are reverted instead and
+  // become the statistics of the opposite action.
+  m_dataManager->ApplyActionStatistics(statistics, true);
+  (*m_current).statistics = m_dataManager->GetActionStatistics();
+  m_used += (*m_current).statistics.capacity() * sizeof(long long int);
+
   m_dataManager->SignalDataAsModified();
 
-  // insert the changed action in the right buffer and apply the actual LookupTable and table values
-  // in fact only the pointers in the original ObjectVector (a std::map) are changed the objects are
-  // only deleted when the undoredosystem deletes them
-  auto temporalSet = m_dataManager->GetSelectedLabelsSet();
+  // insert the changed action in the right buffer and apply the colors and selection of the action,
+  // labels created in the action are removed from the label table on undo and restored on redo.
   switch (type)
   {
     case Type::UNDO:
-      m_redo.push_back(*m_current);
+      m_used -= actionMemory(m_undo.back());
       m_undo.pop_back();
+      m_redo.push_back(std::move(*m_current));
 
-      m_used -= m_redo.back().lut->GetNumberOfColors() * m_sizeColor;
-      m_dataManager->SwitchLookupTables(m_redo.back().lut);
-      m_used += m_redo.back().lut->GetNumberOfColors() * m_sizeColor;
+      m_used -= actionMemory(m_redo.back());
+      m_dataManager->SwitchLookupTables(m_redo.back().tableValues, m_redo.back().colors, m_redo.back().labels);
+      m_used += actionMemory(m_redo.back());
 
-      m_used -= m_redo.back().labels.size() * m_sizeLabel;
-      m_dataManager->SetSelectedLabelsSet(m_redo.back().labels);
-      m_redo.back().labels = temporalSet;
-      m_used += m_redo.back().labels.size() * m_sizeLabel;
-
-      for (auto it: m_redo.back().objects)
+      // labels are positions in the table, must be removed from the last one.
+      for (auto it = m_redo.back().objects.rbegin(); it != m_redo.back().objects.rend(); ++it)
       {
-        (*m_dataManager->GetObjectTablePointer()).erase(it.first);
+        m_dataManager->GetObjectTablePointer()->erase((*it).first);
       }
 
       break;
     case Type::REDO:
-      m_undo.push_back(*m_current);
+      m_used -= actionMemory(m_redo.back());
       m_redo.pop_back();
+      m_undo.push_back(std::move(*m_current));
 
-      m_used -= m_undo.back().lut->GetNumberOfColors() * m_sizeColor;
-      m_dataManager->SwitchLookupTables(m_undo.back().lut);
-      m_used += m_undo.back().lut->GetNumberOfColors() * m_sizeColor;
-
-      m_used -= m_undo.back().labels.size() * m_sizeLabel;
-      m_dataManager->SetSelectedLabelsSet(m_undo.back().labels);
-      m_undo.back().labels = temporalSet;
-      m_used += m_undo.back().labels.size() * m_sizeLabel;
+      m_used -= actionMemory(m_undo.back());
+      m_dataManager->SwitchLookupTables(m_undo.back().tableValues, m_undo.back().colors, m_undo.back().labels);
+      m_used += actionMemory(m_undo.back());
 
       for (auto it: m_undo.back().objects)
       {
-        (*m_dataManager->GetObjectTablePointer())[it.first] = it.second;
+        m_dataManager->GetObjectTablePointer()->insert(it.first, it.second);
       }
 
       break;
@@ -394,8 +872,10 @@ void UndoRedoSystem::doAction(const Type type)
       break;
   }
 
-  checkLimits();
+  delete m_current;
   m_current = nullptr;
+
+  checkLimits();
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -429,41 +909,519 @@ const std::string UndoRedoSystem::getActionString(const Type type) const
   return std::string();
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const struct UndoRedoSystem::action *UndoRedoSystem::getAction(const Type type) const
+{
+  switch (type)
+  {
+    case Type::UNDO:
+      if (!isEmpty(Type::UNDO)) return &m_undo.back();
+      break;
+    case Type::REDO:
+      if (!isEmpty(Type::REDO)) return &m_redo.back();
+      break;
+    case Type::ACTUAL:
+      return m_current;
+      break;
+    case Type::ALL:
+    default:
+      break;
+  }
+
+  return nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const UndoRedoSystem::Storage UndoRedoSystem::getActionStorage(const Type type) const
+{
+  auto action = getAction(type);
+
+  return action ? action->storage : Storage::POINTS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const std::string UndoRedoSystem::getActionStorageString(const Type type) const
+{
+  auto action = getAction(type);
+  if (!action) return std::string();
+
+  auto spilledBytes = spilledMemory(action->spilled);
+
+  std::string spilled;
+  if (spilledBytes != 0)
+  {
+    spilled = std::string(" in memory, ") + std::to_string(spilledBytes / 1024) + " KB in the scratch file";
+  }
+
+  if (Storage::REGION == action->storage)
+  {
+    auto size = action->regionMax - action->regionMin + Vector3ui{1, 1, 1};
+
+    return std::string("Stored as compressed region of ") + std::to_string(size[0]) + "x" + std::to_string(size[1]) + "x" + std::to_string(size[2]) +
+           " voxels (" + std::to_string(regionMemory(action->slabs) / 1024) + " KB" + spilled + ")";
+  }
+
+  return std::string("Stored as list of ") + std::to_string(action->voxels + action->points.voxels()) + " voxels (" + std::to_string(action->points.memoryUsage() / 1024) + " KB" + spilled + ")";
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+std::vector<DataManager::ActionInformation> UndoRedoSystem::getActionsInformation(const Type type) const
+{
+  std::vector<DataManager::ActionInformation> result;
+
+  auto information = [this, &result](const struct action &action)
+  {
+    DataManager::ActionInformation info;
+    info.description = action.description;
+    info.region      = (Storage::REGION == action.storage);
+    info.voxels      = action.voxels + action.points.voxels();
+    info.memory      = actionMemory(action);
+    info.spilled     = spilledMemory(action.spilled);
+
+    result.push_back(info);
+  };
+
+  // from the next action to be undone or redone.
+  switch (type)
+  {
+    case Type::UNDO:
+      std::for_each(m_undo.rbegin(), m_undo.rend(), information);
+      break;
+    case Type::REDO:
+      std::for_each(m_redo.rbegin(), m_redo.rend(), information);
+      break;
+    case Type::ALL:
+      std::for_each(m_undo.rbegin(), m_undo.rend(), information);
+      std::for_each(m_redo.rbegin(), m_redo.rend(), information);
+      break;
+    case Type::ACTUAL:
+      if (m_current) information(*m_current);
+      break;
+    default:
+      break;
+  }
+
+  return result;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 void UndoRedoSystem::signalCancelAction()
 {
   m_bufferFull = false;
 
-  m_used -= (*m_current).points.size() * m_sizePoint;
-  m_used -= (*m_current).objects.size() * m_sizeObject;
-  m_used -= (*m_current).description.capacity();
-  m_used -= ((*m_current).lut)->GetNumberOfTableValues() * m_sizeColor;
-  m_used -= (*m_current).labels.size() * m_sizeLabel;
-  m_used -= m_sizeAction;
+  m_used -= actionMemory(*m_current);
 
   // undo changes if there are some, bypassing the undo system as we don't want to store this
-  // modifications to the data
-  while ((*m_current).points.size() != 0)
+  // modifications to the data. The points in memory are the last ones, then the spilled ones
+  // from the last segment.
+  auto restore = [this](const VoxelDeltas &points)
   {
-    auto action_point = (*m_current).points.back();
-    (*m_current).points.pop_back();
+    auto runs = points.runs();
+    for (auto run = runs.rbegin(); run != runs.rend(); ++run)
+    {
+      for (unsigned int i = 0; i < (*run).length; ++i)
+      {
+        m_dataManager->SetVoxelScalarRaw(m_dataManager->GetVoxelCoordinates((*run).offset + i), (*run).value);
+      }
+    }
+  };
 
-    auto point = action_point.first;
-    m_dataManager->SetVoxelScalarRaw(point, action_point.second);
+  restore((*m_current).points);
+  for (auto chunk = (*m_current).spilled.rbegin(); chunk != (*m_current).spilled.rend(); ++chunk)
+  {
+    restore(spilledPoints(*chunk));
   }
+  releaseSpilled((*m_current).spilled);
+  (*m_current).points.clear();
 
   m_dataManager->SignalDataAsModified();
 
-  // delete dinamically allocated objects
+  // remove the labels created in the action, from the last one
   while (!(*m_current).objects.empty())
   {
-    auto pair = (*m_current).objects.back();
-    (*m_dataManager->GetObjectTablePointer()).erase(pair.first);
-    pair.second = nullptr;
+    m_dataManager->GetObjectTablePointer()->erase((*m_current).objects.back().first);
     (*m_current).objects.pop_back();
   }
 
+  // the table size, colors and selection before the action are restored as when it's undone, the
+  // voxels are narrowed again if they were widened for the removed labels.
+  m_dataManager->SwitchLookupTables((*m_current).tableValues, (*m_current).colors, (*m_current).labels);
+  m_dataManager->FitVoxelWidth();
+
   delete m_current;
 
   m_current = nullptr;
 }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool UndoRedoSystem::writeJournal(const QString &fileName)
+{
+  // the records of the actions that aren't in the undo buffer anymore are kept in the file, it's
+  // written again when they are most of it.
+  unsigned long long int live = 0;
+  for (auto &action: m_undo)
+  {
+    live += action.journalSize;
+  }
+
+  if (!m_journal || (m_journal->fileName() != fileName) || (static_cast<unsigned long long int>(m_journal->size()) > 2 * live + JOURNAL_MINIMUM_BYTES))
+  {
+    return rewriteJournal(fileName);
+  }
+
+  // serial numbers increase from the bottom of the undo buffer, the new actions are on top.
+  unsigned long long int previous = 0;
+  for (auto &action: m_undo)
+  {
+    std::vector<SpillChunk> chunks;
+    if ((action.serial > m_journalSerial) && !writeRecord(*m_journal, action, previous, chunks)) return false;
+
+    previous = action.serial;
+  }
+
+  m_journalSerial = m_serial;
+
+  return writeHead(*m_journal);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool UndoRedoSystem::rewriteJournal(const QString &fileName)
+{
+  auto file = std::unique_ptr<QFile>(new QFile(fileName + QString(".new")));
+  if (!file->open(QIODevice::ReadWrite | QIODevice::Truncate))
+  {
+    qWarning() << "couldn't create the undo journal -" << file->errorString();
+    return false;
+  }
+
+  std::vector<char> header;
+  append(header, JOURNAL_MAGIC);
+  append(header, JOURNAL_VERSION);
+  append(header, static_cast<unsigned char>(sizeof(LabelType)));
+
+  if (file->write(header.data(), header.size()) != static_cast<qint64>(header.size()))
+  {
+    qWarning() << "couldn't write the undo journal -" << file->errorString();
+    file->remove();
+    return false;
+  }
+
+  std::vector<std::vector<SpillChunk>> chunks(m_undo.size());
+  unsigned long long int previous = 0;
+  unsigned int i = 0;
+  for (auto &action: m_undo)
+  {
+    if (!writeRecord(*file, action, previous, chunks[i++]))
+    {
+      file->remove();
+      return false;
+    }
+
+    previous = action.serial;
+  }
+
+  if (!writeHead(*file))
+  {
+    file->remove();
+    return false;
+  }
+
+  // the actions restored from the old journal read their voxels from the new one.
+  i = 0;
+  for (auto &action: m_undo)
+  {
+    if (!action.spilled.empty() && action.spilled.front().journal)
+    {
+      action.spilled = chunks[i];
+    }
+    ++i;
+  }
+
+  // renaming closes the file.
+  if (m_journal) m_journal->close();
+  QFile::remove(fileName);
+  if (!file->rename(fileName) || !file->open(QIODevice::ReadWrite))
+  {
+    qWarning() << "couldn't rename the undo journal -" << file->errorString();
+  }
+
+  m_journal = std::move(file);
+  m_journalSerial = m_serial;
+
+  return m_journal->isOpen();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool UndoRedoSystem::writeRecord(QFile &file, struct action &action, const unsigned long long int previous, std::vector<SpillChunk> &chunks)
+{
+  // the voxels are stored as the blocks of the scratch file: spilled blocks first, then the slabs
+  // or the points still in memory, compressed.
+  std::vector<QByteArray> blocks;
+  for (auto &chunk: action.spilled)
+  {
+    blocks.push_back(readSpilled(chunk));
+    if (blocks.back().isEmpty()) return false;
+  }
+
+  blocks.insert(blocks.end(), action.slabs.begin(), action.slabs.end());
+
+  auto voxels = action.voxels;
+  if ((Storage::POINTS == action.storage) && !action.points.empty())
+  {
+    auto data = action.points.encoded();
+    blocks.push_back(qCompress(data.data(), static_cast<int>(data.size())));
+    voxels += action.points.voxels();
+  }
+
+  std::vector<char> record;
+  append(record, ACTION_RECORD);
+  append(record, action.serial);
+  append(record, previous);
+
+  append(record, static_cast<std::uint32_t>(action.description.size()));
+  record.insert(record.end(), action.description.begin(), action.description.end());
+
+  append(record, static_cast<unsigned char>(action.storage));
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    append(record, action.regionMin[i]);
+    append(record, action.regionMax[i]);
+  }
+  append(record, voxels);
+  append(record, action.tableValues);
+
+  append(record, static_cast<std::uint32_t>(action.labels.size()));
+  for (auto label: action.labels)
+  {
+    append(record, label);
+  }
+
+  append(record, static_cast<std::uint32_t>(action.colors.size()));
+  for (auto &color: action.colors)
+  {
+    append(record, color.first);
+    for (auto component: color.second)
+    {
+      append(record, component);
+    }
+  }
+
+  append(record, static_cast<std::uint32_t>(action.statistics.size()));
+  for (auto value: action.statistics)
+  {
+    append(record, value);
+  }
+
+  append(record, static_cast<std::uint32_t>(action.objects.size()));
+  for (auto &object: action.objects)
+  {
+    append(record, object.first);
+    append(record, object.second.scalar);
+    append(record, object.second.size);
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+      append(record, object.second.centroid[i]);
+      append(record, object.second.min[i]);
+      append(record, object.second.max[i]);
+    }
+  }
+
+  auto start = file.size();
+
+  chunks.clear();
+  append(record, static_cast<std::uint32_t>(blocks.size()));
+  for (auto &block: blocks)
+  {
+    append(record, static_cast<qint64>(block.size()));
+    chunks.push_back(SpillChunk{start + static_cast<qint64>(record.size()), block.size(), true});
+    record.insert(record.end(), block.constData(), block.constData() + block.size());
+  }
+
+  if (!file.seek(start) || (file.write(record.data(), record.size()) != static_cast<qint64>(record.size())))
+  {
+    qWarning() << "couldn't write the undo journal -" << file.errorString();
+    file.resize(start);
+    return false;
+  }
+
+  action.journalSize = record.size();
+
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool UndoRedoSystem::writeHead(QFile &file)
+{
+  // the undo buffer is the chain of actions from the top one to the bottom one.
+  std::vector<char> record;
+  append(record, HEAD_RECORD);
+  append(record, m_undo.empty() ? 0ULL : m_undo.back().serial);
+  append(record, m_undo.empty() ? 0ULL : m_undo.front().serial);
+
+  auto start = file.size();
+  if (!file.seek(start) || (file.write(record.data(), record.size()) != static_cast<qint64>(record.size())) || !file.flush())
+  {
+    qWarning() << "couldn't write the undo journal -" << file.errorString();
+    file.resize(start);
+    return false;
+  }
+
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool UndoRedoSystem::readRecord(QFile &file, struct action &action, unsigned long long int &previous)
+{
+  auto start = file.pos() - 1;
+
+  std::uint32_t size;
+  if (!extract(file, action.serial) || !extract(file, previous) || !extract(file, size)) return false;
+
+  action.description.resize(size);
+  if ((0 != size) && (file.read(&action.description[0], size) != size)) return false;
+
+  unsigned char storage;
+  if (!extract(file, storage)) return false;
+  action.storage = static_cast<Storage>(storage);
+
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    if (!extract(file, action.regionMin[i]) || !extract(file, action.regionMax[i])) return false;
+  }
+
+  if (!extract(file, action.voxels) || !extract(file, action.tableValues) || !extract(file, size)) return false;
+
+  for (std::uint32_t i = 0; i < size; ++i)
+  {
+    LabelType label;
+    if (!extract(file, label)) return false;
+    action.labels.insert(label);
+  }
+
+  if (!extract(file, size)) return false;
+  for (std::uint32_t i = 0; i < size; ++i)
+  {
+    LabelType label;
+    std::array<double, 4> color;
+    if (!extract(file, label) || !extract(file, color)) return false;
+    action.colors[label] = color;
+  }
+
+  if (!extract(file, size)) return false;
+  action.statistics.resize(size);
+  for (auto &value: action.statistics)
+  {
+    if (!extract(file, value)) return false;
+  }
+
+  if (!extract(file, size)) return false;
+  action.objects.resize(size);
+  for (auto &object: action.objects)
+  {
+    if (!extract(file, object.first) || !extract(file, object.second.scalar) || !extract(file, object.second.size)) return false;
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+      if (!extract(file, object.second.centroid[i]) || !extract(file, object.second.min[i]) || !extract(file, object.second.max[i])) return false;
+    }
+  }
+
+  // the voxels are skipped, they are read when the action is undone.
+  if (!extract(file, size)) return false;
+  for (std::uint32_t i = 0; i < size; ++i)
+  {
+    qint64 chunkSize;
+    if (!extract(file, chunkSize) || (file.pos() + chunkSize > file.size())) return false;
+
+    action.spilled.push_back(SpillChunk{file.pos(), chunkSize, true});
+    if (!file.seek(file.pos() + chunkSize)) return false;
+  }
+
+  action.journalSize = file.pos() - start;
+
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool UndoRedoSystem::readJournal(const QString &fileName)
+{
+  Q_ASSERT(m_undo.empty() && m_redo.empty() && !m_current);
+
+  auto file = std::unique_ptr<QFile>(new QFile(fileName));
+  if (!file->exists()) return false;
+
+  if (!file->open(QIODevice::ReadWrite))
+  {
+    qWarning() << "couldn't open the undo journal -" << file->errorString();
+    return false;
+  }
+
+  std::uint32_t magic, version;
+  unsigned char labelSize;
+  if (!extract(*file, magic) || !extract(*file, version) || !extract(*file, labelSize) ||
+      (JOURNAL_MAGIC != magic) || (JOURNAL_VERSION != version) || (sizeof(LabelType) != labelSize))
+  {
+    qWarning() << "the undo journal" << fileName << "isn't valid, the undo actions have been discarded";
+    return false;
+  }
+
+  // the records are read up to the last complete head one, the rest was interrupted.
+  std::map<unsigned long long int, std::pair<unsigned long long int, struct action>> records;
+  unsigned long long int top = 0;
+  unsigned long long int bottom = 0;
+  auto end = file->pos();
+
+  unsigned char type;
+  while (extract(*file, type))
+  {
+    if (HEAD_RECORD == type)
+    {
+      if (!extract(*file, top) || !extract(*file, bottom)) break;
+      end = file->pos();
+      continue;
+    }
+
+    if (ACTION_RECORD != type) break;
+
+    struct action action;
+    unsigned long long int previous;
+    if (!readRecord(*file, action, previous)) break;
+
+    auto serial = action.serial;
+    records[serial] = std::make_pair(previous, std::move(action));
+  }
+
+  file->resize(end);
+
+  // the undo buffer is rebuilt from the top action following the previous ones.
+  std::list<struct action> actions;
+  auto serial = top;
+  while (0 != serial)
+  {
+    auto record = records.find(serial);
+    if (record == records.end())
+    {
+      qWarning() << "the undo journal" << fileName << "is incomplete, the undo actions have been discarded";
+      actions.clear();
+      break;
+    }
+
+    actions.push_front(std::move((*record).second.second));
+    if (serial == bottom) break;
+
+    serial = (*record).second.first;
+  }
+
+  for (auto &action: actions)
+  {
+    m_used += actionMemory(action);
+  }
+
+  m_undo = std::move(actions);
+  m_serial = records.empty() ? 0 : (*records.rbegin()).first;
+  m_journalSerial = m_serial;
+  m_journal = std::move(file);
+
+  checkLimits();
+
+  return true;
+}
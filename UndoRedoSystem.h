@@ -10,17 +10,22 @@
 #ifndef _UNDOREDOSYSTEM_H_
 #define _UNDOREDOSYSTEM_H_
 
-// vtk include
-#include <vtkSmartPointer.h>
-#include <vtkLookupTable.h>
-
 // project includes
 #include "VectorSpaceAlgebra.h"
 #include "DataManager.h"
+#include "TouchedVoxels.h"
+#include "VoxelDeltas.h"
+
+// qt includes
+#include <QByteArray>
+#include <QFile>
+#include <QTemporaryFile>
 
 // c++ includes
 #include <vector>
 #include <list>
+#include <map>
+#include <memory>
 
 class UndoRedoSystem
 {
@@ -38,6 +43,13 @@ class UndoRedoSystem
 
     enum class Type: char { UNDO, REDO, ALL, ACTUAL };
 
+    /** \brief Representation of the voxels modified by an action, chosen when the action ends.
+     * POINTS: list of modified voxels and their previous values.
+     * REGION: compressed copy of the previous values of the region containing the modified voxels.
+     *
+     */
+    enum class Storage: char { POINTS, REGION };
+
     /** \brief Do action.
      * 1 - BEWARE: this action modify current data (touches DataManager data)
      * 2 - this action doesn't modify undo/redo system capacity
@@ -56,11 +68,17 @@ class UndoRedoSystem
     void clear(const Type type);
 
     /** \brief Add a point to current undo action
-     * \param[in] point point coordinates.
+     * \param[in] offset point linear offset in the image buffer.
      * \param[in] label object label.
      *
      */
-    void storePoint(const Vector3ui &point, const unsigned short label);
+    void storePoint(const unsigned long long int offset, const LabelType label);
+
+    /** \brief Adds a group of points to current undo action.
+     * \param[in] points points offsets and labels.
+     *
+     */
+    void storePoints(const VoxelDeltas &points);
 
     /** \brief Returns true if the type buffer is empty and false otherwise.
      * \param[in] type buffer type.
@@ -87,10 +105,10 @@ class UndoRedoSystem
     /** \brief Create a new action.
      * \param[in] actionString action description string.
      * \param[in] labelSet group of affected labels.
-     * \param[in] lut color table for the labels.
+     * \param[in] colors number of values of the color table of the labels.
      *
      */
-    void signalBeginAction(const std::string &actionString, const std::set<unsigned short> labelSet, vtkSmartPointer<vtkLookupTable> lut);
+    void signalBeginAction(const std::string &actionString, const std::set<LabelType> labelSet, const unsigned int colors);
 
     /** \brief Ends an action.
      *
@@ -101,7 +119,15 @@ class UndoRedoSystem
      * \param[in] object object information pair <label, object information>.
      *
      */
-    void storeObject(std::pair<unsigned short, std::shared_ptr<DataManager::ObjectInformation>> object);
+    void storeObject(const std::pair<LabelType, DataManager::ObjectInformation> &object);
+
+    /** \brief Stores the color of a label before the action modifies it, only the first one of each
+     * label is kept. Does nothing if there isn't an action in progress.
+     * \param[in] label label value.
+     * \param[in] rgba color components.
+     *
+     */
+    void storeColor(const LabelType label, const double rgba[4]);
 
     /** \brief Returns the action string of the specified buffer.
      * \param[in] type buffer type.
@@ -109,29 +135,187 @@ class UndoRedoSystem
      */
     const std::string getActionString(const Type type) const;
 
+    /** \brief Returns the representation of the voxels of the action of the specified buffer.
+     * \param[in] type buffer type.
+     *
+     */
+    const Storage getActionStorage(const Type type) const;
+
+    /** \brief Returns a description of the representation of the voxels of the action of the
+     * specified buffer and its size, or an empty string if there is no action.
+     * \param[in] type buffer type.
+     *
+     */
+    const std::string getActionStorageString(const Type type) const;
+
+    /** \brief Returns the information of the actions of the specified buffer, from the next one to
+     * be undone or redone. ALL returns the undo actions followed by the redo ones.
+     * \param[in] type buffer type.
+     *
+     */
+    std::vector<DataManager::ActionInformation> getActionsInformation(const Type type) const;
+
     /** \brief Deletes all the data stored in actual action buffer.
      *
      */
     void signalCancelAction();
+
+    /** \brief Writes the undo actions to the journal file, only the ones added since the last call
+     * are appended. The journal is written again from the start if the file changes or most of it
+     * belongs to actions that aren't in the undo buffer anymore. Returns true on success.
+     * \param[in] fileName journal file name.
+     *
+     */
+    bool writeJournal(const QString &fileName);
+
+    /** \brief Restores the undo actions of the journal file, the buffers must be empty. The voxels of
+     * the actions are read from the file when they are undone. Returns true on success.
+     * \param[in] fileName journal file name.
+     *
+     */
+    bool readJournal(const QString &fileName);
   private:
-    /** \brief Helper method to check if we are at the limit of our buffer and if so, makes room for more actions.
+    /** \brief Block of data of an action stored in the scratch file or in the journal.
      *
      */
-    void checkLimits();
+    struct SpillChunk
+    {
+        qint64 offset;  /** position in the file.                                        */
+        qint64 size;    /** size in bytes.                                               */
+        bool   journal; /** true if stored in the journal, false if in the scratch file. */
+    };
 
     // this defines an action, the data needed to store the action's effect on internal data
-    // NOTE: to get size of members we'll use capacity() for vector and string, for the
-    //       vtkLookupTable the size is 4*sizeof(unsigned char)*(number of colors) always)
+    // NOTE: the memory used by an action is computed by actionMemory() from the allocated size of its
+    //       members, the color table and the heap storage of the vectors included.
     struct action
     {
-        std::vector<std::pair<Vector3ui, unsigned short> > points;      /** points and labels information. */
-        vtkSmartPointer<vtkLookupTable>                    lut;         /** color table of the labels. */
+        VoxelDeltas                                        points;      /** points and labels information. */
+        unsigned int                                       tableValues; /** number of values of the color table before the action. */
+        DataManager::ColorChanges                          colors;      /** colors of the table before the action modified them. */
         std::string                                        description; /** description of the action. */
-        std::set<unsigned short>                           labels;      /** labels of the action. */
+        std::set<LabelType>                                labels;      /** labels of the action. */
+        Storage                                            storage;     /** representation of the voxels. */
+        Vector3ui                                          regionMin;   /** region minimum coordinates, if stored as region. */
+        Vector3ui                                          regionMax;   /** region maximum coordinates, if stored as region. */
+        std::vector<QByteArray>                            slabs;       /** compressed slabs of the region, if stored as region. */
+        std::vector<SpillChunk>                            spilled;     /** segments of points or slabs moved to the scratch file. */
+        unsigned long long int                             voxels;      /** modified voxels that aren't in the points. */
+        std::vector<long long int>                         statistics;  /** packed variation of the label statistics. */
+        TouchedVoxels                                      touched;     /** voxels already stored, only while in progress. */
+        unsigned long long int                             serial;      /** number of the action in the undo buffer, increasing. */
+        unsigned long long int                             journalSize; /** size of the record of the action in the journal, 0 if not written. */
 
-        std::vector<std::pair<unsigned short, std::shared_ptr<DataManager::ObjectInformation>> > objects; /** list of objects. */
+        std::vector<std::pair<LabelType, DataManager::ObjectInformation> > objects; /** list of objects created in the action. */
     };
 
+    /** \brief Helper method to check if we are at the limit of our buffer and if so, makes room for more actions.
+     *
+     */
+    void checkLimits();
+
+    /** \brief Replaces the points of the action with a compressed copy of the region they cover if
+     * it uses less memory. The region is compressed in slabs of BRICK_SIZE slices.
+     * \param[in] action action with the points already stored.
+     *
+     */
+    void storeRegion(struct action &action);
+
+    /** \brief Returns the memory used by the compressed slabs of a region in bytes.
+     * \param[in] slabs compressed slabs.
+     *
+     */
+    static const unsigned long long int regionMemory(const std::vector<QByteArray> &slabs);
+
+    /** \brief Returns the memory used by the action in bytes.
+     * \param[in] action undo/redo action.
+     *
+     */
+    const unsigned long long int actionMemory(const struct action &action) const;
+
+    /** \brief Moves the points or slabs of the oldest action that has them in memory to the scratch
+     * file, including the points of the action in progress. Returns false if there was nothing to
+     * move or it couldn't be moved.
+     *
+     */
+    bool spillOldest();
+
+    /** \brief Moves the points or slabs of the action to the scratch file. Returns true on success.
+     * \param[in] action undo/redo action.
+     *
+     */
+    bool spill(struct action &action);
+
+    /** \brief Reads a chunk from the scratch file.
+     * \param[in] chunk chunk position and size.
+     *
+     */
+    QByteArray readSpilled(const SpillChunk &chunk);
+
+    /** \brief Reads a segment of points from the scratch file.
+     * \param[in] chunk chunk position and size.
+     *
+     */
+    VoxelDeltas spilledPoints(const SpillChunk &chunk);
+
+    /** \brief Releases the scratch file space of the given chunks, must be called before dropping
+     * an action that has spilled chunks. The space is reused by the next chunks moved to the file.
+     * \param[in] chunks chunks of the action.
+     *
+     */
+    void releaseSpilled(const std::vector<SpillChunk> &chunks);
+
+    /** \brief Returns the position of the scratch file for a chunk of the given size, in the smallest
+     * free space that fits it or at the end of the file. Returns -1 if the file would grow past its
+     * maximum size, SPILL_MAXIMUM_FACTOR times the size of the undo/redo system.
+     * \param[in] size chunk size in bytes.
+     *
+     */
+    qint64 allocateSpilled(const qint64 size);
+
+    /** \brief Returns the size of the given chunks in the scratch file in bytes.
+     * \param[in] chunks spilled chunks.
+     *
+     */
+    static const unsigned long long int spilledMemory(const std::vector<SpillChunk> &chunks);
+
+    /** \brief Writes the undo actions to a new journal file that replaces the current one.
+     * \param[in] fileName journal file name.
+     *
+     */
+    bool rewriteJournal(const QString &fileName);
+
+    /** \brief Appends the record of the action to the journal file. Returns true on success.
+     * \param[in] file journal file.
+     * \param[in,out] action undo action, its serial number and record size are updated.
+     * \param[in] previous serial number of the action below it in the undo buffer, 0 if none.
+     * \param[out] chunks blocks of the voxels of the action in the file.
+     *
+     */
+    bool writeRecord(QFile &file, struct action &action, const unsigned long long int previous, std::vector<SpillChunk> &chunks);
+
+    /** \brief Appends the record of the current undo buffer to the journal file, the actions must
+     * have been written before. Returns true on success.
+     * \param[in] file journal file.
+     *
+     */
+    bool writeHead(QFile &file);
+
+    /** \brief Reads the record of an action from the journal file, the voxels are left in the file.
+     * Returns false if the record is incomplete.
+     * \param[in] file journal file.
+     * \param[out] action undo action.
+     * \param[out] previous serial number of the action below it in the undo buffer, 0 if none.
+     *
+     */
+    bool readRecord(QFile &file, struct action &action, unsigned long long int &previous);
+
+    /** \brief Returns the action of the specified buffer or nullptr if there is none.
+     * \param[in] type buffer type.
+     *
+     */
+    const struct action *getAction(const Type type) const;
+
     struct action *m_current; /** \brief Action in progress. */
 
     unsigned long int m_size; /** size of the undo/redo system. */
@@ -144,11 +328,11 @@ class UndoRedoSystem
 
     bool m_bufferFull; /** true if the buffer is full and we must delete an action before storing another. */
 
-    int m_sizePoint;  /** point storage size, can differ in different CPU word sizes. */
-    int m_sizeAction; /** action storage size, can differ in different CPU word sizes. */
-    int m_sizeObject; /** object storage size, can differ in different CPU word sizes. */
-    int m_sizeColor;  /** color storage size, can differ in different CPU word sizes. */
-    int m_sizeLabel;  /** label storage size, can differ in different CPU word sizes. */
+    std::unique_ptr<QTemporaryFile> m_spillFile;     /** scratch file of the actions that don't fit in memory.       */
+    std::map<qint64, qint64>        m_spillFree;     /** free extents of the scratch file, position and size.        */
+    std::unique_ptr<QFile>          m_journal;       /** journal of the undo actions, restored with the session.     */
+    unsigned long long int          m_serial;        /** serial number of the last action stored.                    */
+    unsigned long long int          m_journalSerial; /** serial number of the last action written to the journal.    */
 };
 
 #endif // _UNDOREDOSYSTEM_H_
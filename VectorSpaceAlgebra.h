@@ -187,6 +187,12 @@ template<class T> class Vector3
       data[2] = static_cast<T>(z);
       return *this;
     }
+
+    /** \brief Returns the memory allocated for the components in bytes.
+     *
+     */
+    inline const unsigned long long int memoryUsage() const
+    { return data.capacity() * sizeof(T); }
   private:
     std::vector<T> data;
 };
@@ -0,0 +1,163 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: VolumeSnapshot.cpp
+// Purpose: Frozen view of the label volume for readers running in other threads
+// Notes: Copy on write at brick granularity. The snapshot reads the live volume until a brick is
+//        going to be written, then the writer copies the brick into the snapshot first.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// project includes
+#include "VolumeSnapshot.h"
+#include "BrickedVolume.h"
+
+// c++ includes
+#include <algorithm>
+#include <cstring>
+
+// Qt
+#include <QtGlobal>
+
+namespace
+{
+  const unsigned int BRICK_SIZE = BrickedVolume::BRICK_SIZE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+VolumeSnapshot::VolumeSnapshot(const Vector3ui &dimensions, const Vector3d &spacing, const Vector3d &origin, Source source)
+: m_dimensions{dimensions}
+, m_spacing   {spacing}
+, m_origin    {origin}
+, m_bricks    {Vector3ui{(dimensions[0] + BRICK_SIZE - 1) / BRICK_SIZE, (dimensions[1] + BRICK_SIZE - 1) / BRICK_SIZE, (dimensions[2] + BRICK_SIZE - 1) / BRICK_SIZE}}
+, m_source    {source}
+, m_memory    {0}
+{
+  m_preserved.resize(static_cast<unsigned long long int>(m_bricks[0]) * m_bricks[1] * m_bricks[2]);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void VolumeSnapshot::brickBounds(const unsigned long long int index, Vector3ui &min, Vector3ui &max) const
+{
+  auto x = static_cast<unsigned int>(index % m_bricks[0]);
+  auto y = static_cast<unsigned int>((index / m_bricks[0]) % m_bricks[1]);
+  auto z = static_cast<unsigned int>(index / (static_cast<unsigned long long int>(m_bricks[0]) * m_bricks[1]));
+
+  min = Vector3ui{x * BRICK_SIZE, y * BRICK_SIZE, z * BRICK_SIZE};
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    max[i] = std::min(min[i] + BRICK_SIZE, m_dimensions[i]) - 1;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void VolumeSnapshot::preserveBrick(const unsigned long long int index)
+{
+  if (m_preserved[index] || !m_source) return;
+
+  Vector3ui min, max;
+  brickBounds(index, min, max);
+
+  auto voxels = static_cast<unsigned long long int>(max[0] - min[0] + 1) * (max[1] - min[1] + 1) * (max[2] - min[2] + 1);
+  m_preserved[index].reset(new LabelType[voxels]);
+  m_source(min, max, m_preserved[index].get());
+  m_memory += voxels * sizeof(LabelType);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void VolumeSnapshot::preserve(const unsigned long long int index)
+{
+  Q_ASSERT(index < m_preserved.size());
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  preserveBrick(index);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void VolumeSnapshot::detach()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  for (unsigned long long int index = 0; index < m_preserved.size(); ++index)
+  {
+    preserveBrick(index);
+  }
+
+  m_source = nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void VolumeSnapshot::copyRegion(const Vector3ui &min, const Vector3ui &max, LabelType *buffer) const
+{
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    Q_ASSERT((min[i] <= max[i]) && (max[i] < m_dimensions[i]));
+  }
+
+  unsigned long long int rowLength = max[0] - min[0] + 1;
+  unsigned long long int rowsY     = max[1] - min[1] + 1;
+
+  std::vector<LabelType> live;
+
+  for (auto bz = min[2] / BRICK_SIZE; bz <= max[2] / BRICK_SIZE; ++bz)
+  {
+    for (auto by = min[1] / BRICK_SIZE; by <= max[1] / BRICK_SIZE; ++by)
+    {
+      for (auto bx = min[0] / BRICK_SIZE; bx <= max[0] / BRICK_SIZE; ++bx)
+      {
+        auto index = bx + by * static_cast<unsigned long long int>(m_bricks[0]) + bz * static_cast<unsigned long long int>(m_bricks[0]) * m_bricks[1];
+
+        Vector3ui brickMin, brickMax, regionMin, regionMax;
+        brickBounds(index, brickMin, brickMax);
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+          regionMin[i] = std::max(min[i], brickMin[i]);
+          regionMax[i] = std::min(max[i], brickMax[i]);
+        }
+
+        // the lock keeps the writers from modifying the brick while the live voxels are read.
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        const LabelType *source;
+        Vector3ui sourceMin, sourceMax;
+        if (m_preserved[index])
+        {
+          source    = m_preserved[index].get();
+          sourceMin = brickMin;
+          sourceMax = brickMax;
+        }
+        else
+        {
+          Q_ASSERT(m_source);
+          live.resize(static_cast<unsigned long long int>(regionMax[0] - regionMin[0] + 1) * (regionMax[1] - regionMin[1] + 1) * (regionMax[2] - regionMin[2] + 1));
+          m_source(regionMin, regionMax, live.data());
+          source    = live.data();
+          sourceMin = regionMin;
+          sourceMax = regionMax;
+        }
+
+        unsigned long long int sourceRow    = sourceMax[0] - sourceMin[0] + 1;
+        unsigned long long int sourceRowsY  = sourceMax[1] - sourceMin[1] + 1;
+        unsigned long long int length       = regionMax[0] - regionMin[0] + 1;
+
+        for (auto z = regionMin[2]; z <= regionMax[2]; ++z)
+        {
+          for (auto y = regionMin[1]; y <= regionMax[1]; ++y)
+          {
+            auto from = source + (regionMin[0] - sourceMin[0]) + ((y - sourceMin[1]) + (z - sourceMin[2]) * sourceRowsY) * sourceRow;
+            auto to   = buffer + (regionMin[0] - min[0]) + ((y - min[1]) + (z - min[2]) * rowsY) * rowLength;
+            std::memcpy(to, from, length * sizeof(LabelType));
+          }
+        }
+      }
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const unsigned long long int VolumeSnapshot::memoryUsage() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  return m_memory;
+}
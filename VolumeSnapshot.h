@@ -0,0 +1,121 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: VolumeSnapshot.h
+// Purpose: Frozen view of the label volume for readers running in other threads
+// Notes: Copy on write at brick granularity. The snapshot reads the live volume until a brick is
+//        going to be written, then the writer copies the brick into the snapshot first.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _VOLUMESNAPSHOT_H_
+#define _VOLUMESNAPSHOT_H_
+
+// project includes
+#include "LabelType.h"
+#include "VectorSpaceAlgebra.h"
+
+// c++ includes
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// VolumeSnapshot class
+//
+class VolumeSnapshot
+{
+  public:
+    /** \brief Function that copies the live voxels of a region (inclusive bounds, snapshot
+     * coordinates) to a buffer, x varying fastest.
+     *
+     */
+    using Source = std::function<void(const Vector3ui &min, const Vector3ui &max, LabelType *buffer)>;
+
+    /** \brief VolumeSnapshot class constructor.
+     * \param[in] dimensions volume dimensions.
+     * \param[in] spacing volume spacing.
+     * \param[in] origin volume origin.
+     * \param[in] source reader of the live volume.
+     *
+     */
+    VolumeSnapshot(const Vector3ui &dimensions, const Vector3d &spacing, const Vector3d &origin, Source source);
+
+    /** \brief Returns the volume dimensions.
+     *
+     */
+    const Vector3ui &dimensions() const
+    { return m_dimensions; }
+
+    /** \brief Returns the volume spacing.
+     *
+     */
+    const Vector3d &spacing() const
+    { return m_spacing; }
+
+    /** \brief Returns the volume origin.
+     *
+     */
+    const Vector3d &origin() const
+    { return m_origin; }
+
+    /** \brief Returns the number of bricks in each axis.
+     *
+     */
+    const Vector3ui &bricks() const
+    { return m_bricks; }
+
+    /** \brief Copies the voxels of a region as they were when the snapshot was taken. Can be called
+     * from any thread.
+     * \param[in] min region minimum coordinates.
+     * \param[in] max region maximum coordinates.
+     * \param[out] buffer region voxels, x varying fastest.
+     *
+     */
+    void copyRegion(const Vector3ui &min, const Vector3ui &max, LabelType *buffer) const;
+
+    /** \brief Copies the live voxels of the brick to the snapshot if it hasn't been done before.
+     * Must be called by the writer before modifying the brick.
+     * \param[in] index brick linear index.
+     *
+     */
+    void preserve(const unsigned long long int index);
+
+    /** \brief Copies all the bricks that haven't been preserved and stops reading the live volume.
+     * Must be called before the live volume is released or replaced.
+     *
+     */
+    void detach();
+
+    /** \brief Returns the memory used by the preserved bricks in bytes.
+     *
+     */
+    const unsigned long long int memoryUsage() const;
+
+  private:
+    /** \brief Computes the bounds of the given brick.
+     * \param[in] index brick linear index.
+     * \param[out] min brick minimum coordinates.
+     * \param[out] max brick maximum coordinates.
+     *
+     */
+    void brickBounds(const unsigned long long int index, Vector3ui &min, Vector3ui &max) const;
+
+    /** \brief Copies the live voxels of the brick, must be called with the mutex locked.
+     * \param[in] index brick linear index.
+     *
+     */
+    void preserveBrick(const unsigned long long int index);
+
+    const Vector3ui                           m_dimensions; /** volume dimensions.                               */
+    const Vector3d                            m_spacing;    /** volume spacing.                                  */
+    const Vector3d                            m_origin;     /** volume origin.                                   */
+    const Vector3ui                           m_bricks;     /** number of bricks in each axis.                   */
+    mutable std::mutex                        m_mutex;      /** protects the preserved bricks and the source.    */
+    Source                                    m_source;     /** reader of the live volume, empty when detached.  */
+    std::vector<std::unique_ptr<LabelType[]>> m_preserved;  /** copies of the bricks written after the snapshot. */
+    unsigned long long int                    m_memory;     /** bytes used by the preserved bricks.              */
+};
+
+#endif // _VOLUMESNAPSHOT_H_
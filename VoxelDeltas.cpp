@@ -0,0 +1,153 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: VoxelDeltas.cpp
+// Purpose: Packed list of modified voxels and their values, used by the undo/redo system
+// Notes: Voxels are stored as runs of consecutive linear offsets with the same value. Each run is
+//        encoded as variable length integers: the distance to the end of the previous run, the
+//        length and the value, so usual edits take one or two bytes per run.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// project includes
+#include "VoxelDeltas.h"
+
+namespace
+{
+  /** \brief Maps signed distances to unsigned values, small magnitudes to small values.
+   *
+   */
+  inline unsigned long long int zigzag(const long long int value)
+  {
+    return (static_cast<unsigned long long int>(value) << 1) ^ static_cast<unsigned long long int>(value >> 63);
+  }
+
+  /** \brief Inverse of zigzag().
+   *
+   */
+  inline long long int unzigzag(const unsigned long long int value)
+  {
+    return static_cast<long long int>(value >> 1) ^ -static_cast<long long int>(value & 1);
+  }
+
+  /** \brief Decodes a variable length integer and advances the position.
+   *
+   */
+  inline unsigned long long int decode(const unsigned char *&position)
+  {
+    unsigned long long int value = 0;
+    unsigned int shift = 0;
+
+    while (*position & 0x80)
+    {
+      value |= static_cast<unsigned long long int>(*position++ & 0x7F) << shift;
+      shift += 7;
+    }
+
+    return value | (static_cast<unsigned long long int>(*position++) << shift);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+VoxelDeltas::VoxelDeltas()
+: m_last  {0, 0, 0}
+, m_end   {0}
+, m_voxels{0}
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+VoxelDeltas::VoxelDeltas(const unsigned char *data, const unsigned long long int size)
+: m_data  (data, data + size)
+, m_last  {0, 0, 0}
+, m_end   {0}
+, m_voxels{0}
+{
+  for (auto &run: runs())
+  {
+    m_voxels += run.length;
+    m_end = run.offset + run.length;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void VoxelDeltas::encode(unsigned long long int value)
+{
+  while (value >= 0x80)
+  {
+    m_data.push_back(static_cast<unsigned char>(value | 0x80));
+    value >>= 7;
+  }
+
+  m_data.push_back(static_cast<unsigned char>(value));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void VoxelDeltas::flush()
+{
+  if (0 == m_last.length) return;
+
+  encode(zigzag(static_cast<long long int>(m_last.offset - m_end)));
+  encode(m_last.length - 1);
+  encode(m_last.value);
+
+  m_end = m_last.offset + m_last.length;
+  m_last.length = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void VoxelDeltas::append(const VoxelDeltas &deltas)
+{
+  for (auto &run: deltas.runs())
+  {
+    add(run.offset, run.value, run.length);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+std::vector<VoxelDeltas::Run> VoxelDeltas::runs() const
+{
+  std::vector<Run> result;
+
+  unsigned long long int end = 0;
+  auto position = m_data.data();
+  auto last = m_data.data() + m_data.size();
+  while (position < last)
+  {
+    Run run;
+    run.offset = end + unzigzag(decode(position));
+    run.length = static_cast<unsigned int>(decode(position)) + 1;
+    run.value  = static_cast<LabelType>(decode(position));
+
+    end = run.offset + run.length;
+    result.push_back(run);
+  }
+
+  if (0 != m_last.length) result.push_back(m_last);
+
+  return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+std::vector<unsigned char> VoxelDeltas::encoded() const
+{
+  auto copy = *this;
+  copy.flush();
+
+  return copy.m_data;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void VoxelDeltas::clear()
+{
+  std::vector<unsigned char>().swap(m_data);
+  m_last.length = 0;
+  m_end = 0;
+  m_voxels = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void VoxelDeltas::compact()
+{
+  m_data.shrink_to_fit();
+}
@@ -0,0 +1,138 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: VoxelDeltas.h
+// Purpose: Packed list of modified voxels and their values, used by the undo/redo system
+// Notes: Voxels are stored as runs of consecutive linear offsets with the same value. Each run is
+//        encoded as variable length integers: the distance to the end of the previous run, the
+//        length and the value, so usual edits take one or two bytes per run.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _VOXELDELTAS_H_
+#define _VOXELDELTAS_H_
+
+// project includes
+#include "LabelType.h"
+
+// c++ includes
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// VoxelDeltas class
+//
+class VoxelDeltas
+{
+  public:
+    /** \brief Voxels of consecutive offsets with the same value.
+     *
+     */
+    struct Run
+    {
+        unsigned long long int offset; /** linear offset of the first voxel. */
+        unsigned int           length; /** number of voxels.                 */
+        LabelType              value;  /** value of the voxels.              */
+    };
+
+    /** \brief VoxelDeltas class constructor.
+     *
+     */
+    VoxelDeltas();
+
+    /** \brief VoxelDeltas class constructor from the runs encoded by encoded().
+     * \param[in] data encoded runs.
+     * \param[in] size size of the data in bytes.
+     *
+     */
+    VoxelDeltas(const unsigned char *data, const unsigned long long int size);
+
+    /** \brief Adds voxels with the given value, extending the last run if they are consecutive.
+     * \param[in] offset linear offset of the first voxel.
+     * \param[in] value value of the voxels.
+     * \param[in] length number of voxels.
+     *
+     */
+    inline void add(const unsigned long long int offset, const LabelType value, const unsigned int length = 1);
+
+    /** \brief Adds the voxels of the given list after the ones of this one.
+     * \param[in] deltas list of voxels.
+     *
+     */
+    void append(const VoxelDeltas &deltas);
+
+    /** \brief Returns the runs of voxels in the order they were added.
+     *
+     */
+    std::vector<Run> runs() const;
+
+    /** \brief Returns the encoded runs, used to store them outside of memory.
+     *
+     */
+    std::vector<unsigned char> encoded() const;
+
+    /** \brief Returns the number of voxels.
+     *
+     */
+    const unsigned long long int voxels() const
+    { return m_voxels; }
+
+    /** \brief Returns true if there are no voxels.
+     *
+     */
+    const bool empty() const
+    { return 0 == m_voxels; }
+
+    /** \brief Removes all the voxels and releases the memory.
+     *
+     */
+    void clear();
+
+    /** \brief Releases the memory reserved but not used.
+     *
+     */
+    void compact();
+
+    /** \brief Returns the memory used by the encoded runs in bytes.
+     *
+     */
+    const unsigned long long int memoryUsage() const
+    { return m_data.capacity(); }
+
+  private:
+    /** \brief Encodes the last run, it can't be extended after that.
+     *
+     */
+    void flush();
+
+    /** \brief Appends a variable length integer to the data.
+     * \param[in] value integer value.
+     *
+     */
+    void encode(unsigned long long int value);
+
+    std::vector<unsigned char> m_data;   /** encoded runs.                                    */
+    Run                        m_last;   /** last run, not encoded until the next one starts. */
+    unsigned long long int     m_end;    /** offset after the last encoded run.               */
+    unsigned long long int     m_voxels; /** number of voxels.                                */
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+inline void VoxelDeltas::add(const unsigned long long int offset, const LabelType value, const unsigned int length)
+{
+  if (0 == length) return;
+
+  m_voxels += length;
+
+  if ((0 != m_last.length) && (offset == m_last.offset + m_last.length) && (value == m_last.value))
+  {
+    m_last.length += length;
+    return;
+  }
+
+  flush();
+  m_last.offset = offset;
+  m_last.length = length;
+  m_last.value  = value;
+}
+
+#endif // _VOXELDELTAS_H_
@@ -29,13 +29,16 @@
 #include <vtkVolume.h>
 #include <vtkVolumeProperty.h>
 #include <vtkCamera.h>
-#include <vtkImageClip.h>
 #include <vtkImageCanvasSource2D.h>
 #include <vtkTexture.h>
 #include <vtkTextureMapToPlane.h>
 #include <vtkTransformTextureCoords.h>
 #include <vtkImageConstantPad.h>
 
+// c++ includes
+#include <algorithm>
+#include <iterator>
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // VoxelVolumeRender class
 //
@@ -55,8 +58,8 @@ VoxelVolumeRender::VoxelVolumeRender(std::shared_ptr<DataManager> dataManager, v
   computeVolumes();
   updateFocusExtent();
 
-  connect(dataManager.get(), SIGNAL(modified()),
-          this,              SLOT(onDataModified()));
+  connect(dataManager.get(), SIGNAL(modified(const DirtyRegion &)),
+          this,              SLOT(onDataModified(const DirtyRegion &)));
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -90,7 +93,11 @@ void VoxelVolumeRender::computeVolumes()
   m_volumeMapper = vtkSmartPointer<vtkSmartVolumeMapper>::New();
   m_volumeMapper->SetGlobalWarningDisplay(false);
   m_volumeMapper->SetDebug(false);
-  m_volumeMapper->SetInputData(m_dataManager->GetStructuredPoints());
+  if (!m_dataManager->IsBrickedStorage())
+  {
+    m_volumeMapper->SetInputData(m_dataManager->GetStructuredPoints());
+  }
+  updateVolumeInput();
   m_volumeMapper->SetScalarModeToUsePointData();
   m_volumeMapper->SetAutoAdjustSampleDistances(false);
   m_volumeMapper->SetInterpolationModeToNearestNeighbor();
@@ -99,7 +106,7 @@ void VoxelVolumeRender::computeVolumes()
   // assign label colors
   m_colorfunction = vtkSmartPointer<vtkColorTransferFunction>::New();
   m_colorfunction->AllowDuplicateScalarsOff();
-  for (unsigned short int i = 0; i != lookupTable->GetNumberOfTableValues(); i++)
+  for (LabelType i = 0; i != lookupTable->GetNumberOfTableValues(); i++)
   {
     lookupTable->GetTableValue(i, rgba);
     m_colorfunction->AddRGBPoint(i, rgba[0], rgba[1], rgba[2]);
@@ -136,7 +143,7 @@ void VoxelVolumeRender::computeVolumes()
 //       data to decimate or smooth if there is no voxel! as a matter of fact, it's
 //       not even an error.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void VoxelVolumeRender::computeMesh(const unsigned short label)
+void VoxelVolumeRender::computeMesh(const LabelType label)
 {
   std::shared_ptr<Pipeline> actorInfo;
 
@@ -153,22 +160,16 @@ void VoxelVolumeRender::computeMesh(const unsigned short label)
   actorInfo->min = m_dataManager->GetBoundingBoxMin(label);
   actorInfo->max = m_dataManager->GetBoundingBoxMax(label);
   actorInfo->mesh = vtkSmartPointer<vtkActor>::New();
-  m_actors.insert(std::pair<const unsigned short, std::shared_ptr<Pipeline>>(label, actorInfo));
+  m_actors.insert(std::pair<const LabelType, std::shared_ptr<Pipeline>>(label, actorInfo));
 
   // first crop the region and then use the vtk-itk pipeline to get a itk::Image of the region
   auto objectMin = m_dataManager->GetBoundingBoxMin(label);
   auto objectMax = m_dataManager->GetBoundingBoxMax(label);
   auto size      = m_dataManager->GetOrientationData()->GetTransformedSize();
-  auto weight    = 1.0 / 5.0;
+  auto weight    = 1.0 / 4.0;
 
-  // image clipping
-  auto imageClip = vtkSmartPointer<vtkImageClip>::New();
-  imageClip->SetInputData(m_dataManager->GetStructuredPoints());
-  imageClip->SetOutputWholeExtent(objectMin[0], objectMax[0], objectMin[1], objectMax[1], objectMin[2], objectMax[2]);
-  imageClip->ClipDataOn();
-  m_progress->Observe(imageClip, "Clip", weight);
-  imageClip->Update();
-  m_progress->Ignore(imageClip);
+  // image region of the object
+  auto region = m_dataManager->GetImageData(objectMin, objectMax);
 
   // the object bounds collide with the object, we must add one not to clip the mesh at the borders
   objectMin[0]--;
@@ -179,7 +180,7 @@ void VoxelVolumeRender::computeMesh(const unsigned short label)
   objectMax[2]++;
 
   auto pad = vtkSmartPointer<vtkImageConstantPad>::New();
-  pad->SetInputData(imageClip->GetOutput());
+  pad->SetInputData(region);
   pad->SetConstant(0);
   pad->SetNumberOfThreads(1);
   pad->SetOutputWholeExtent(objectMin[0], objectMax[0], objectMin[1], objectMax[1], objectMin[2], objectMax[2]);
@@ -256,6 +257,7 @@ void VoxelVolumeRender::updateFocusExtent(void)
   // no labels case
   if (m_highlightedLabels.empty())
   {
+    updateVolumeInput();
     m_volumeMapper->SetCroppingRegionPlanes(0, 0, 0, 0, 0, 0);
     m_volumeMapper->CroppingOn();
     m_volumeMapper->SetCroppingRegionFlagsToSubVolume();
@@ -300,6 +302,7 @@ void VoxelVolumeRender::updateFocusExtent(void)
                        (m_min[2] - 1.5) * spacing[2],
                        (m_max[2] + 1.5) * spacing[2] };
 
+  updateVolumeInput();
   m_volumeMapper->SetCroppingRegionPlanes(bounds);
   m_volumeMapper->CroppingOn();
   m_volumeMapper->SetCroppingRegionFlagsToSubVolume();
@@ -337,7 +340,7 @@ void VoxelVolumeRender::viewAsVolume(void)
   if (m_renderingIsVolume) return;
 
   // delete all actors and while we're at it modify opacity values for volume rendering
-  std::set<unsigned short> toDelete;
+  std::set<LabelType> toDelete;
   for (auto actor: m_actors)
   {
     m_renderer->RemoveActor(actor.second->mesh);
@@ -360,7 +363,7 @@ void VoxelVolumeRender::viewAsVolume(void)
 // NOTE: m_opacityfunction->Modified() not signaled. need to use UpdateColorTable() after
 // calling this one to signal changes to pipeline
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void VoxelVolumeRender::colorHighlight(const unsigned short label)
+void VoxelVolumeRender::colorHighlight(const LabelType label)
 {
   if (0 == label) return;
 
@@ -383,7 +386,7 @@ void VoxelVolumeRender::colorHighlight(const unsigned short label)
 // NOTE: m_opacityfunction->Modified() not signaled. need to use UpdateColorTable() after
 // calling this one to signal changes to pipeline.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void VoxelVolumeRender::colorDim(const unsigned short label, double alpha)
+void VoxelVolumeRender::colorDim(const LabelType label, double alpha)
 {
   if (0 == label) return;
 
@@ -406,7 +409,7 @@ void VoxelVolumeRender::colorDim(const unsigned short label, double alpha)
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void VoxelVolumeRender::colorHighlightExclusive(unsigned short label)
+void VoxelVolumeRender::colorHighlightExclusive(LabelType label)
 {
   auto highlighted = m_highlightedLabels;
   for (auto it: highlighted)
@@ -444,15 +447,21 @@ void VoxelVolumeRender::updateColorTable(void)
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void VoxelVolumeRender::onDataModified()
+void VoxelVolumeRender::onDataModified(const DirtyRegion &region)
 {
+  // only the highlighted labels are visible, the changes of other labels don't need an update.
+  std::set<LabelType> modifiedLabels;
+  std::set_intersection(region.labels.cbegin(), region.labels.cend(), m_highlightedLabels.cbegin(), m_highlightedLabels.cend(),
+                        std::inserter(modifiedLabels, modifiedLabels.begin()));
+
   if(m_renderingIsVolume)
   {
+    if (!modifiedLabels.empty()) updateVolumeInput();
     updateColorTable();
   }
   else
   {
-    for (auto label: m_highlightedLabels)
+    for (auto label: modifiedLabels)
     {
       computeMesh(label);
     }
@@ -461,3 +470,25 @@ void VoxelVolumeRender::onDataModified()
 
   m_renderer->Render();
 }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void VoxelVolumeRender::updateVolumeInput()
+{
+  // the volume mapper uses the image directly unless it's stored in bricks, then only the region
+  // of the highlighted labels is rendered.
+  if (!m_dataManager->IsBrickedStorage()) return;
+
+  auto min = Vector3ui(0, 0, 0);
+  auto max = Vector3ui(0, 0, 0);
+
+  if (!m_highlightedLabels.empty())
+  {
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+      min[i] = (m_min[i] > 0) ? m_min[i] - 1 : 0;
+      max[i] = m_max[i] + 1;
+    }
+  }
+
+  m_volumeMapper->SetInputData(m_dataManager->GetImageData(min, max));
+}
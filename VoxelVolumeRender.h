@@ -72,19 +72,19 @@ class VoxelVolumeRender
      * \param[in] label object label.
      *
      */
-    void colorHighlight(const unsigned short label);
+    void colorHighlight(const LabelType label);
 
     /** \brief Dims the given label color.
      * \param[in] label object label.
      * \param[in] opacity opacity value [0,1]
      *
      */
-    void colorDim(const unsigned short label, double opacity = 0.0);
+    void colorDim(const LabelType label, double opacity = 0.0);
 
     /** \brief Hightlights the given label color exclusively.
      *
      */
-    void colorHighlightExclusive(const unsigned short label);
+    void colorHighlightExclusive(const LabelType label);
 
     /** \brief Dims all colors.
      *
@@ -97,10 +97,11 @@ class VoxelVolumeRender
     void updateColorTable();
 
   public slots:
-    /** \brief Updates the actor when the data changes.
+    /** \brief Updates the actors of the modified labels when the data changes.
+     * \param[in] region modified region and labels.
      *
      */
-    void onDataModified();
+    void onDataModified(const DirtyRegion &region);
 
   private:
     /** \brief Computes volumes using plain CPU raycast.
@@ -112,8 +113,13 @@ class VoxelVolumeRender
      * \param[in] label object label.
      *
      */
-    void computeMesh(const unsigned short label);
+    void computeMesh(const LabelType label);
 
+    /** \brief Updates the volume mapper input with the region of the highlighted labels if the image
+     * is stored in bricks.
+     *
+     */
+    void updateVolumeInput();
 
     vtkSmartPointer<vtkRenderer>              m_renderer;          /** view's renderer.                             */
     std::shared_ptr<ProgressAccumulator>      m_progress;          /** progress accumlator to report progress.      */
@@ -126,7 +132,7 @@ class VoxelVolumeRender
     vtkSmartPointer<vtkVolume>                m_volume;            /** volumetric actor.                            */
     vtkSmartPointer<vtkActor>                 m_mesh;              /** mesh actor.                                  */
 
-    std::set<unsigned short>                  m_highlightedLabels; /** set of highlighted labels (selected labels). */
+    std::set<LabelType>                       m_highlightedLabels; /** set of highlighted labels (selected labels). */
 
     Vector3ui                                 m_min;               /** bounding box minimum point.                  */
     Vector3ui                                 m_max;               /** bounding box maximum point.                  */
@@ -140,7 +146,7 @@ class VoxelVolumeRender
         Pipeline(): min(Vector3ui{0,0,0}), max(Vector3ui{0,0,0}), mesh{nullptr} {};
     };
 
-    std::map<const unsigned short, std::shared_ptr<Pipeline>> m_actors; /** list of actors in the view. */
+    std::map<const LabelType, std::shared_ptr<Pipeline>> m_actors; /** list of actors in the view. */
 
     bool m_renderingIsVolume; /** true if rendering the volume as voxel and false if rendering the mesh. */
 };
@@ -0,0 +1,152 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: BenchmarkVolume.cpp
+// Purpose: Synthetic segmentation volumes, timing and memory helpers for the benchmarks
+// Notes: The volumes are written with the editor's own writer and read with the editor's own
+//        loader, so the benchmarks measure the same code paths as the application.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// itk includes
+#include <itkMetaImageIO.h>
+
+// project includes
+#include "BenchmarkVolume.h"
+#include "BrickedVolume.h"
+#include "Coordinates.h"
+#include "MetaImageWriter.h"
+
+// c++ includes
+#include <algorithm>
+#include <iostream>
+
+// Qt
+#include <QDir>
+#include <QTemporaryFile>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+QString WriteBenchmarkVolume(const Vector3ui &dimensions, const unsigned int scalars)
+{
+  QTemporaryFile file(QDir::tempPath() + QString("/espinabenchmark-XXXXXX.mha"));
+  file.setAutoRemove(false);
+  if (!file.open()) return QString();
+
+  auto filename = file.fileName();
+  file.close();
+
+  const auto cube = BrickedVolume::BRICK_SIZE;
+  auto source = [&dimensions, scalars, cube](const Vector3ui &min, const Vector3ui &max, LabelType *buffer)
+  {
+    for (auto z = min[2]; z <= max[2]; ++z)
+    {
+      for (auto y = min[1]; y <= max[1]; ++y)
+      {
+        for (auto x = min[0]; x <= max[0]; ++x)
+        {
+          auto cx = (x + cube / 2) / cube;
+          auto cy = (y + cube / 3) / cube;
+          auto cz = z / cube;
+          *buffer++ = (0 == (cx + cy + cz) % 2) ? 0 : 1 + (cx * 7 + cy * 13 + cz * 17) % scalars;
+        }
+      }
+    }
+  };
+
+  MetaImageWriter writer(dimensions, Vector3d(1, 1, 1), Vector3d(0, 0, 0), source);
+  if (!writer.write(filename))
+  {
+    std::cerr << "couldn't write the benchmark volume - " << writer.errorString().toStdString() << std::endl;
+    QFile::remove(filename);
+    return QString();
+  }
+
+  return filename;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+itk::SmartPointer<ImageReaderType> OpenBenchmarkVolume(const QString &filename)
+{
+  auto io = itk::MetaImageIO::New();
+  io->SetFileName(filename.toStdString().c_str());
+  auto reader = ImageReaderType::New();
+  reader->SetImageIO(io);
+  reader->SetFileName(filename.toStdString().c_str());
+  reader->ReleaseDataFlagOn();
+
+  try
+  {
+    reader->UpdateOutputInformation();
+  }
+  catch (itk::ExceptionObject &excp)
+  {
+    std::cerr << "couldn't read the benchmark volume - " << excp.what() << std::endl;
+    return nullptr;
+  }
+
+  return reader;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+std::shared_ptr<DataManager> LoadBenchmarkVolume(const QString &filename, const bool bricked, const bool mapped)
+{
+  auto reader = OpenBenchmarkVolume(filename);
+  if (!reader) return nullptr;
+
+  auto dataManager = std::make_shared<DataManager>();
+  dataManager->SetBrickedStorage(bricked);
+  dataManager->SetMappedStorage(mapped);
+
+  try
+  {
+    dataManager->Initialize(reader, std::make_shared<Coordinates>(reader->GetOutput()), nullptr);
+  }
+  catch (itk::ExceptionObject &excp)
+  {
+    std::cerr << "couldn't read the benchmark volume - " << excp.what() << std::endl;
+    return nullptr;
+  }
+
+  return dataManager;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PrintTimes(const QString &name, std::vector<double> &times)
+{
+  if (times.empty()) return;
+
+  std::sort(times.begin(), times.end());
+  auto percentile = [&times](const double p)
+  { return times[std::min<size_t>(times.size() - 1, static_cast<size_t>(p * times.size()))]; };
+
+  std::cout << name.toStdString() << ": median " << percentile(0.5) << " ms, p95 " << percentile(0.95)
+            << " ms, max " << times.back() << " ms (" << times.size() << " runs)" << std::endl;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+unsigned long long int PeakResidentMemory()
+{
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+
+  return counters.PeakWorkingSetSize;
+#else
+  struct rusage usage;
+  if (0 != getrusage(RUSAGE_SELF, &usage)) return 0;
+
+  // linux gives kilobytes and macOS bytes.
+#ifdef __APPLE__
+  return usage.ru_maxrss;
+#else
+  return usage.ru_maxrss * 1024ULL;
+#endif
+#endif
+}
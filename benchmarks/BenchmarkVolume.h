@@ -0,0 +1,71 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: BenchmarkVolume.h
+// Purpose: Synthetic segmentation volumes, timing and memory helpers for the benchmarks
+// Notes: The volumes are written with the editor's own writer and read with the editor's own
+//        loader, so the benchmarks measure the same code paths as the application.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _BENCHMARKVOLUME_H_
+#define _BENCHMARKVOLUME_H_
+
+// project includes
+#include "DataManager.h"
+#include "VectorSpaceAlgebra.h"
+
+// c++ includes
+#include <chrono>
+#include <memory>
+#include <vector>
+
+// Qt
+#include <QString>
+
+/** \brief Writes a segmentation of the given dimensions to a temporary MetaImage file and returns
+ * its name, or an empty string on error. The volume is a grid of boxes of BrickedVolume::BRICK_SIZE
+ * voxels, half of them background and the others with one of the given number of scalars. The grid
+ * is shifted in x and y so most bricks hold several values.
+ * \param[in] dimensions volume dimensions.
+ * \param[in] scalars number of different scalars besides the background.
+ *
+ */
+QString WriteBenchmarkVolume(const Vector3ui &dimensions, const unsigned int scalars);
+
+/** \brief Loads the given segmentation into a new data manager with the given storage. Returns
+ * nullptr on error.
+ * \param[in] filename MetaImage file name.
+ * \param[in] bricked true to use bricked storage.
+ * \param[in] mapped true to use memory mapped storage.
+ *
+ */
+std::shared_ptr<DataManager> LoadBenchmarkVolume(const QString &filename, const bool bricked, const bool mapped);
+
+/** \brief Returns the image reader of the given segmentation with its output information updated,
+ * or nullptr on error.
+ * \param[in] filename MetaImage file name.
+ *
+ */
+itk::SmartPointer<ImageReaderType> OpenBenchmarkVolume(const QString &filename);
+
+/** \brief Returns the milliseconds elapsed since the given time.
+ * \param[in] start start time.
+ *
+ */
+inline double ElapsedMilliseconds(const std::chrono::steady_clock::time_point &start)
+{ return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(); }
+
+/** \brief Prints the median, 95th percentile and maximum of the given times in milliseconds.
+ * \param[in] name name of the measure.
+ * \param[in] times measured times, sorted on return.
+ *
+ */
+void PrintTimes(const QString &name, std::vector<double> &times);
+
+/** \brief Returns the peak resident memory of the process in bytes, or 0 if it's not available.
+ *
+ */
+unsigned long long int PeakResidentMemory();
+
+#endif // _BENCHMARKVOLUME_H_
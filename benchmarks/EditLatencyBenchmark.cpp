@@ -0,0 +1,89 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: EditLatencyBenchmark.cpp
+// Purpose: Compares the latency of edits and undos with the image in heap memory and in a memory
+//          mapped file.
+// Notes: Usage: EditLatencyBenchmark [edits] [edge] [image.mha]. Without an image a synthetic
+//        512x512x512 volume is used. The edits paint cubes of the given edge at random positions of
+//        the whole volume, the same positions in both modes. The mapped mode only pages to disk with
+//        volumes larger than the free memory, use an image of that size to measure it.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// project includes
+#include "BenchmarkVolume.h"
+#include "DataManager.h"
+
+// c++ includes
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+// Qt
+#include <QFile>
+
+int main(int argc, char * argv[])
+{
+  auto edits    = (argc > 1) ? std::max(1, atoi(argv[1])) : 200;
+  auto edge     = (argc > 2) ? std::max(1, atoi(argv[2])) : 32;
+  auto filename = (argc > 3) ? QString(argv[3]) : WriteBenchmarkVolume(Vector3ui(512, 512, 512), 100);
+  if (filename.isEmpty()) return 1;
+
+  for (auto mapped: { false, true })
+  {
+    auto start = std::chrono::steady_clock::now();
+    auto dataManager = LoadBenchmarkVolume(filename, false, mapped);
+    if (!dataManager) return 1;
+
+    auto name = QString(mapped ? "mapped" : "memory");
+    if (mapped && !dataManager->IsMappedStorage())
+    {
+      std::cerr << "memory mapped storage isn't available." << std::endl;
+      return 1;
+    }
+    std::cout << name.toStdString() << " load: " << ElapsedMilliseconds(start) << " ms" << std::endl;
+
+    int extent[6];
+    dataManager->GetStructuredPoints()->GetExtent(extent);
+    auto size = Vector3ui(extent[1] + 1, extent[3] + 1, extent[5] + 1);
+    auto labels = dataManager->GetNumberOfLabels();
+
+    // same positions and labels in both modes.
+    std::mt19937 generator(42);
+    std::vector<double> editTimes, undoTimes;
+    for (int i = 0; i < edits; ++i)
+    {
+      Vector3ui min, max;
+      for (unsigned int j = 0; j < 3; ++j)
+      {
+        auto length = std::min<unsigned int>(edge, size[j]);
+        min[j] = std::uniform_int_distribution<unsigned int>(0, size[j] - length)(generator);
+        max[j] = min[j] + length - 1;
+      }
+      auto label = static_cast<LabelType>(1 + generator() % (labels - 1));
+
+      start = std::chrono::steady_clock::now();
+      dataManager->OperationStart("Benchmark edit");
+      dataManager->SetVoxelScalars(min, max, std::vector<unsigned char>(), label);
+      dataManager->OperationEnd();
+      editTimes.push_back(ElapsedMilliseconds(start));
+
+      // undo every other edit so the undo buffer keeps some actions.
+      if (0 == (i % 2))
+      {
+        start = std::chrono::steady_clock::now();
+        dataManager->DoUndoOperation();
+        undoTimes.push_back(ElapsedMilliseconds(start));
+      }
+    }
+
+    PrintTimes(name + QString(" edit"), editTimes);
+    PrintTimes(name + QString(" undo"), undoTimes);
+  }
+
+  if (argc <= 3) QFile::remove(filename);
+
+  return 0;
+}
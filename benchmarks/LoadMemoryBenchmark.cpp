@@ -0,0 +1,184 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: LoadMemoryBenchmark.cpp
+// Purpose: Measures the peak resident memory of loading a segmentation.
+// Notes: Usage: LoadMemoryBenchmark [all|dense|bricked|labelmap] [image]. The peak of a process
+//        never decreases, the all mode (the default) runs every other mode in its own process and
+//        prints the reduction of the peak against the labelmap mode. The labelmap mode does the
+//        allocations of the load path used before: the whole image, its label map, the label image
+//        converted back and the copy to the vtk image. Without an image a synthetic 512x512x512
+//        volume is used, written before starting the processes. The sample image is
+//        images/MRIcrop-seg.segmha.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// itk includes
+#include <itkLabelImageToLabelMapFilter.h>
+#include <itkLabelMapToLabelImageFilter.h>
+#include <itkShapeLabelMapFilter.h>
+
+// vtk includes
+#include <vtkPointData.h>
+#include <vtkStructuredPoints.h>
+
+// project includes
+#include "BenchmarkVolume.h"
+#include "DataManager.h"
+
+// c++ includes
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+// Qt
+#include <QFile>
+#include <QProcess>
+#include <QStringList>
+
+using ConverterType             = itk::LabelImageToLabelMapFilter<ImageType, LabelMapType>;
+using EvaluatorType             = itk::ShapeLabelMapFilter<LabelMapType>;
+using LabelMapToImageFilterType = itk::LabelMapToLabelImageFilter<LabelMapType, ImageType>;
+
+namespace
+{
+  /** \brief Loads the image of the given file as the editor did before reading it in slabs, returns
+   * false on error.
+   * \param[in] filename image file name.
+   *
+   */
+  bool LoadLabelMap(const QString &filename)
+  {
+    auto reader = OpenBenchmarkVolume(filename);
+    if (!reader) return false;
+
+    try
+    {
+      reader->Update();
+
+      auto converter = ConverterType::New();
+      converter->SetInput(reader->GetOutput());
+      converter->ReleaseDataFlagOn();
+      converter->Update();
+      converter->GetOutput()->Optimize();
+
+      auto evaluator = EvaluatorType::New();
+      evaluator->SetInput(converter->GetOutput());
+      evaluator->ComputePerimeterOff();
+      evaluator->ComputeFeretDiameterOff();
+      evaluator->SetInPlace(true);
+      evaluator->Update();
+
+      auto labelconverter = LabelMapToImageFilterType::New();
+      labelconverter->SetInput(evaluator->GetOutput());
+      labelconverter->SetNumberOfThreads(1);
+      labelconverter->Update();
+
+      auto image  = labelconverter->GetOutput();
+      auto size   = image->GetLargestPossibleRegion().GetSize();
+      auto points = vtkSmartPointer<vtkStructuredPoints>::New();
+      points->SetExtent(0, size[0] - 1, 0, size[1] - 1, 0, size[2] - 1);
+      points->AllocateScalars((sizeof(LabelType) == sizeof(unsigned short)) ? VTK_UNSIGNED_SHORT : VTK_UNSIGNED_INT, 1);
+      std::memcpy(points->GetScalarPointer(), image->GetBufferPointer(), size[0] * size[1] * size[2] * sizeof(LabelType));
+    }
+    catch (itk::ExceptionObject &excp)
+    {
+      std::cerr << "couldn't read the image - " << excp.what() << std::endl;
+      return false;
+    }
+
+    return true;
+  }
+
+  /** \brief Runs the benchmark of the given mode in a new process, prints its output and returns the
+   * peak resident memory after the load in megabytes, or a negative value on error.
+   * \param[in] program benchmark executable.
+   * \param[in] mode load mode.
+   * \param[in] filename image file name.
+   *
+   */
+  double RunMode(const QString &program, const QString &mode, const QString &filename)
+  {
+    QProcess process;
+    process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    process.start(program, QStringList() << mode << filename);
+    if (!process.waitForFinished(-1) || (process.exitStatus() != QProcess::NormalExit) || (0 != process.exitCode()))
+    {
+      std::cerr << "the " << mode.toStdString() << " process failed." << std::endl;
+      return -1;
+    }
+
+    const std::string peakLine = "peak after load: ";
+    auto peak = -1.0;
+    std::istringstream output(process.readAllStandardOutput().toStdString());
+    std::string line;
+    while (std::getline(output, line))
+    {
+      std::cout << line << std::endl;
+      if (0 == line.compare(0, peakLine.size(), peakLine)) peak = std::stod(line.substr(peakLine.size()));
+    }
+
+    return peak;
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  auto mode = (argc > 1) ? QString(argv[1]) : QString("all");
+  if ((mode != QString("all")) && (mode != QString("dense")) && (mode != QString("bricked")) && (mode != QString("labelmap")))
+  {
+    std::cerr << "usage: LoadMemoryBenchmark [all|dense|bricked|labelmap] [image]" << std::endl;
+    return 1;
+  }
+
+  auto filename = (argc > 2) ? QString(argv[2]) : WriteBenchmarkVolume(Vector3ui(512, 512, 512), 100);
+  if (filename.isEmpty()) return 1;
+
+  if (mode == QString("all"))
+  {
+    std::map<std::string, double> peaks;
+    for (auto name: { "labelmap", "dense", "bricked" })
+    {
+      peaks[name] = RunMode(QString(argv[0]), QString(name), filename);
+    }
+
+    if (argc <= 2) QFile::remove(filename);
+
+    for (auto name: { "dense", "bricked" })
+    {
+      if ((peaks[name] <= 0) || (peaks["labelmap"] <= 0)) return 1;
+
+      std::cout << name << " peak reduction against labelmap: " << peaks["labelmap"] - peaks[name] << " MB ("
+                << 100.0 * (peaks["labelmap"] - peaks[name]) / peaks["labelmap"] << "%)" << std::endl;
+    }
+
+    return 0;
+  }
+
+  const double megabyte = 1024.0 * 1024.0;
+  std::cout << "peak before load: " << PeakResidentMemory() / megabyte << " MB" << std::endl;
+
+  auto start = std::chrono::steady_clock::now();
+  auto loaded = false;
+  std::shared_ptr<DataManager> dataManager;
+  if (mode == QString("labelmap"))
+  {
+    loaded = LoadLabelMap(filename);
+  }
+  else
+  {
+    dataManager = LoadBenchmarkVolume(filename, mode == QString("bricked"), false);
+    loaded = (dataManager != nullptr);
+  }
+
+  if (loaded)
+  {
+    std::cout << mode.toStdString() << " load: " << ElapsedMilliseconds(start) << " ms" << std::endl;
+    std::cout << "peak after load: " << PeakResidentMemory() / megabyte << " MB" << std::endl;
+  }
+
+  if (argc <= 2) QFile::remove(filename);
+
+  return loaded ? 0 : 1;
+}
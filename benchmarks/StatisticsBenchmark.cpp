@@ -0,0 +1,147 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Project: Espina Volume Editor
+// Author: Félix de las Pozas Alvarez
+//
+// File: StatisticsBenchmark.cpp
+// Purpose: Compares the parallel label statistics of the data manager with the label map and
+//          itk::ShapeLabelMapFilter path used before, and checks that both give the same values.
+// Notes: Usage: StatisticsBenchmark [runs] [image.mha]. Without an image a synthetic 512x512x512
+//        volume is used. The image is read before timing the itk path, the data manager path is
+//        timed on the image already loaded in dense and in bricked storage.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// itk includes
+#include <itkLabelImageToLabelMapFilter.h>
+#include <itkShapeLabelMapFilter.h>
+
+// project includes
+#include "BenchmarkVolume.h"
+#include "DataManager.h"
+
+// c++ includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+// Qt
+#include <QFile>
+
+using ConverterType = itk::LabelImageToLabelMapFilter<ImageType, LabelMapType>;
+using EvaluatorType = itk::ShapeLabelMapFilter<LabelMapType>;
+
+int main(int argc, char * argv[])
+{
+  auto runs     = (argc > 1) ? std::max(1, atoi(argv[1])) : 5;
+  auto filename = (argc > 2) ? QString(argv[2]) : WriteBenchmarkVolume(Vector3ui(512, 512, 512), 100);
+  if (filename.isEmpty()) return 1;
+
+  // label map and ShapeLabelMapFilter, as the image was loaded before.
+  auto reader = OpenBenchmarkVolume(filename);
+  if (!reader) return 1;
+
+  try
+  {
+    reader->ReleaseDataFlagOff();
+    reader->Update();
+  }
+  catch (itk::ExceptionObject &excp)
+  {
+    std::cerr << "couldn't read the benchmark volume - " << excp.what() << std::endl;
+    return 1;
+  }
+
+  std::vector<double> times;
+  EvaluatorType::Pointer evaluator;
+  for (int i = 0; i < runs; ++i)
+  {
+    auto start = std::chrono::steady_clock::now();
+    auto converter = ConverterType::New();
+    converter->SetInput(reader->GetOutput());
+    converter->Update();
+    converter->GetOutput()->Optimize();
+
+    evaluator = EvaluatorType::New();
+    evaluator->SetInput(converter->GetOutput());
+    evaluator->ComputePerimeterOff();
+    evaluator->ComputeFeretDiameterOff();
+    evaluator->SetInPlace(true);
+    evaluator->Update();
+    times.push_back(ElapsedMilliseconds(start));
+  }
+  PrintTimes(QString("ShapeLabelMapFilter"), times);
+
+  auto labelMap = evaluator->GetOutput();
+  auto spacing  = reader->GetOutput()->GetSpacing();
+  auto origin   = reader->GetOutput()->GetOrigin();
+
+  for (auto bricked: { false, true })
+  {
+    auto dataManager = LoadBenchmarkVolume(filename, bricked, false);
+    if (!dataManager) return 1;
+
+    auto name = QString(bricked ? "VerifyStatistics bricked" : "VerifyStatistics dense");
+
+    times.clear();
+    for (int i = 0; i < runs; ++i)
+    {
+      auto start = std::chrono::steady_clock::now();
+      dataManager->VerifyStatistics();
+      times.push_back(ElapsedMilliseconds(start));
+    }
+    PrintTimes(name, times);
+
+    if (labelMap->GetNumberOfLabelObjects() + 1 != dataManager->GetNumberOfLabels())
+    {
+      std::cerr << name.toStdString() << ": " << dataManager->GetNumberOfLabels() - 1 << " labels, "
+                << labelMap->GetNumberOfLabelObjects() << " label objects." << std::endl;
+      return 1;
+    }
+
+    // the label map objects are ordered by scalar, as the labels.
+    unsigned int differences = 0, voxelsDifferences = 0, centroidDifferences = 0, boxDifferences = 0;
+    double maximumCentroidDifference = 0;
+    for (unsigned int i = 0; i < labelMap->GetNumberOfLabelObjects(); ++i)
+    {
+      auto labelObject = labelMap->GetNthLabelObject(i);
+      auto label       = static_cast<LabelType>(i + 1);
+      auto centroid    = labelObject->GetCentroid();
+      auto region      = labelObject->GetBoundingBox();
+      auto index       = region.GetIndex();
+      auto size        = region.GetSize();
+
+      auto sameVoxels = (labelObject->GetLabel() == dataManager->GetScalarForLabel(label)) &&
+                        (labelObject->Size() == dataManager->GetNumberOfVoxelsForLabel(label));
+      auto sameCentroid = true;
+      auto sameBox = true;
+      for (unsigned int j = 0; j < 3; ++j)
+      {
+        auto difference = std::abs((centroid[j] - origin[j]) / spacing[j] - dataManager->GetCentroidForObject(label)[j]);
+        maximumCentroidDifference = std::max(maximumCentroidDifference, difference);
+
+        sameCentroid &= (difference < 1e-3);
+        sameBox &= (static_cast<unsigned int>(index[j]) == dataManager->GetBoundingBoxMin(label)[j]);
+        sameBox &= (static_cast<unsigned int>(index[j] + size[j] - 1) == dataManager->GetBoundingBoxMax(label)[j]);
+      }
+
+      if (!sameVoxels)   ++voxelsDifferences;
+      if (!sameCentroid) ++centroidDifferences;
+      if (!sameBox)      ++boxDifferences;
+
+      if (!(sameVoxels && sameCentroid && sameBox) && (differences++ < 10))
+      {
+        std::cerr << "scalar " << labelObject->GetLabel() << ": voxels " << labelObject->Size() << " / " << dataManager->GetNumberOfVoxelsForLabel(label)
+                  << ", bounding box min " << dataManager->GetBoundingBoxMin(label) << " max " << dataManager->GetBoundingBoxMax(label) << std::endl;
+      }
+    }
+
+    std::cout << name.toStdString() << ": " << labelMap->GetNumberOfLabelObjects() << " labels compared with ShapeLabelMapFilter, "
+              << voxelsDifferences << " with different scalar or voxels, " << centroidDifferences << " with different centroid (maximum difference "
+              << maximumCentroidDifference << " voxels), " << boxDifferences << " with different bounding box." << std::endl;
+    if (0 != differences) return 1;
+  }
+
+  if (argc <= 2) QFile::remove(filename);
+
+  return 0;
+}